@@ -27,6 +27,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "debug.h"
 #include "adb.h"
 #include "matrix.h"
+#include "keyboard.h"
 #include "report.h"
 #include "host.h"
 #include "led.h"
@@ -152,11 +153,11 @@ void adb_mouse_task(void)
     // Accelerate mouse. (They weren't meant to be used on screens larger than 320x200).
     x *= mouseacc;
     y *= mouseacc;
-    // Cap our two bytes per axis to one byte.
+    // Cap our two bytes per axis to one byte(16-bit report holds them as they are).
     // Easier with a MIN-function, but since -MAX(-a,-b) = MIN(a,b)...
 	 // I.E. MIN(MAX(x,-127),127) = -MAX(-MAX(x, -127), -127) = MIN(-MIN(-x,127),127)
-    mouse_report.x = -MAX(-MAX(x, -127), -127);
-    mouse_report.y = -MAX(-MAX(y, -127), -127);
+    mouse_report.x = -MAX(-MAX(x, -MOUSE_XY_MAX), -MOUSE_XY_MAX);
+    mouse_report.y = -MAX(-MAX(y, -MOUSE_XY_MAX), -MOUSE_XY_MAX);
     if (debug_mouse) {
             print("adb_host_mouse_recv: "); print_bin16(codes); print("\n");
             print("adb_mouse raw: [");
@@ -244,6 +245,7 @@ uint8_t matrix_scan(void)
     }
 
     if (codes == 0) {                           // no keys
+        led_update();
         return 0;
     } else if (codes == 0x7F7F) {   // power key press
         register_key(0x7F);
@@ -35,6 +35,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define MATRIX_COLS 8   // keycode bit: 6-4
 
 
+/* LED is sent to keyboard when bus is idle: led_update() in matrix_scan() */
+#define LED_UPDATE_DEFERRED
+
 /* key combination for command */
 #define IS_COMMAND() ( \
     keyboard_report->mods == (MOD_BIT(KC_LSHIFT) | MOD_BIT(KC_RSHIFT)) || \
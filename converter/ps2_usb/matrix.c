@@ -24,6 +24,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "ps2.h"
 #include "host.h"
 #include "led.h"
+#include "keyboard.h"
 #include "matrix.h"
 
 
@@ -174,6 +175,11 @@ uint8_t matrix_scan(void)
 
     uint8_t code = ps2_host_recv();
     if (code) xprintf("%i\r\n", code);
+
+    // no scan code sequence in progress
+    if (!code && state == INIT) {
+        led_update();
+    }
     if (!ps2_error) {
         switch (state) {
             case INIT:
@@ -21,6 +21,9 @@ bool command_extra(uint8_t code)
             print("PgDown:      LED all Off\n");
             print("Insert:      Layout\n");
             print("Delete:      Reset\n");
+#ifndef HARDWARE_SERIAL
+            print("R:           Serial errors\n");
+#endif
             return false;
         case KC_DEL:
             print("Reset\n");
@@ -60,6 +63,12 @@ bool command_extra(uint8_t code)
             print("layout\n");
             serial_send(0x0F);
             break;
+#ifndef HARDWARE_SERIAL
+        case KC_R:
+            xprintf("framing: %u parity: %u overrun: %u\n", serial_framing_errors,
+                    serial_parity_errors, serial_overrun_errors);
+            break;
+#endif
         default:
             xprintf("Unknown extra command: %02X\n", code);
             return false;
@@ -80,53 +80,74 @@ void matrix_init(void)
     return;
 }
 
+/*
+ * Received codes are processed in a batch, but a key changed twice in a batch
+ * is left to next scan, otherwise keyboard_task() would miss short press.
+ */
 uint8_t matrix_scan(void)
 {
+    static uint8_t pending = 0;
+    uint8_t changed[MATRIX_ROWS] = {};
+    bool batch_changed = false;
     uint8_t code;
-    code = serial_recv();
-    if (!code) return 0;
+    uint8_t last = 0;
+
+    while ((code = (pending ? pending : serial_recv()))) {
+        pending = 0;
+
+        debug_hex(code); debug(" ");
+        switch (code) {
+            case 0xFF:  // reset success: FF 04
+                print("reset: ");
+                _delay_ms(500);
+                code = serial_recv();
+                xprintf("%02X\n", code);
+                if (code == 0x04) {
+                    // LED status
+                    led_set(host_keyboard_leds());
+                }
+                continue;
+            case 0xFE:  // layout: FE <layout>
+                print("layout: ");
+                _delay_ms(500);
+                xprintf("%02X\n", serial_recv());
+                continue;
+            case 0x7E:  // reset fail: 7E 01
+                print("reset fail: ");
+                _delay_ms(500);
+                xprintf("%02X\n", serial_recv());
+                continue;
+            case 0x7F:
+                if (batch_changed) {
+                    pending = code;
+                    return last;
+                }
+                // all keys up
+                for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix[i] = 0x00;
+                continue;
+        }
 
-    debug_hex(code); debug(" ");
+        if (changed[ROW(code)] & (1<<COL(code))) {
+            pending = code;
+            return last;
+        }
+        changed[ROW(code)] |= (1<<COL(code));
+        batch_changed = true;
 
-    switch (code) {
-        case 0xFF:  // reset success: FF 04
-            print("reset: ");
-            _delay_ms(500);
-            code = serial_recv();
-            xprintf("%02X\n", code);
-            if (code == 0x04) {
-                // LED status
-                led_set(host_keyboard_leds());
+        if (code&0x80) {
+            // break code
+            if (matrix_is_on(ROW(code), COL(code))) {
+                matrix[ROW(code)] &= ~(1<<COL(code));
+            }
+        } else {
+            // make code
+            if (!matrix_is_on(ROW(code), COL(code))) {
+                matrix[ROW(code)] |=  (1<<COL(code));
             }
-            return 0;
-        case 0xFE:  // layout: FE <layout>
-            print("layout: ");
-            _delay_ms(500);
-            xprintf("%02X\n", serial_recv());
-            return 0;
-        case 0x7E:  // reset fail: 7E 01
-            print("reset fail: ");
-            _delay_ms(500);
-            xprintf("%02X\n", serial_recv());
-            return 0;
-        case 0x7F:
-            // all keys up
-            for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix[i] = 0x00;
-            return 0;
-    }
-
-    if (code&0x80) {
-        // break code
-        if (matrix_is_on(ROW(code), COL(code))) {
-            matrix[ROW(code)] &= ~(1<<COL(code));
-        }
-    } else {
-        // make code
-        if (!matrix_is_on(ROW(code), COL(code))) {
-            matrix[ROW(code)] |=  (1<<COL(code));
         }
+        last = code;
     }
-    return code;
+    return last;
 }
 
 inline
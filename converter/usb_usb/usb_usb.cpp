@@ -22,8 +22,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "Usb.h"
 #include "usbhub.h"
 #include "hid.h"
-#include "hidboot.h"
-#include "parser.h"
+#include "hid_keyboard.h"
 
 #include "keycode.h"
 #include "util.h"
@@ -39,7 +38,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* KEY CODE to Matrix
  *
  * HID keycode(1 byte):
- * Higher 5 bits indicates ROW and lower 3 bits COL.
+ * Higher 4 bits indicates ROW and lower 4 bits COL.
  *
  *  7 6 5 4 3 2 1 0
  * +---------------+
@@ -52,17 +51,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *   : |                |
  *   : |                |
  *  16 +----------------+
+ *
+ * Modifiers are on row 0x0E as their keycodes 0xE0-0xE7.
+ * This is same layout as key state bitmap of HIDKeyboard.
  */
-#define ROW_MASK 0xF0
-#define COL_MASK 0x0F
-#define CODE(row, col)  (((row) << 4) | (col))
-#define ROW(code)       (((code) & ROW_MASK) >> 4)
-#define COL(code)       ((code) & COL_MASK)
-#define ROW_BITS(code)  (1 << COL(code))
 
 
 // Integrated key state of all keyboards
-static report_keyboard_t keyboard_report;
+static matrix_row_t matrix[MATRIX_ROWS];
 
 static bool matrix_is_mod =false;
 
@@ -73,14 +69,40 @@ static bool matrix_is_mod =false;
 USB usb_host;
 USBHub hub1(&usb_host);
 USBHub hub2(&usb_host);
-HIDBoot<HID_PROTOCOL_KEYBOARD>    kbd1(&usb_host);
-HIDBoot<HID_PROTOCOL_KEYBOARD>    kbd2(&usb_host);
-HIDBoot<HID_PROTOCOL_KEYBOARD>    kbd3(&usb_host);
-HIDBoot<HID_PROTOCOL_KEYBOARD>    kbd4(&usb_host);
-KBDReportParser kbd_parser1;
-KBDReportParser kbd_parser2;
-KBDReportParser kbd_parser3;
-KBDReportParser kbd_parser4;
+HIDKeyboard kbd1(&usb_host);
+HIDKeyboard kbd2(&usb_host);
+HIDKeyboard kbd3(&usb_host);
+HIDKeyboard kbd4(&usb_host);
+
+static HIDKeyboard *const kbds[] = { &kbd1, &kbd2, &kbd3, &kbd4 };
+#define KBD_COUNT   (sizeof(kbds) / sizeof(kbds[0]))
+
+
+/*
+ * USB Host task scheduling
+ *
+ * usb_host.Task() polls hubs and enumerates new devices besides polling keyboards,
+ * it can block for hundreds of milliseconds on hub port reset and device configuration.
+ * Keyboards are polled on their own first in every scan, and usb_host.Task() runs
+ * only when the scan is within USB_HOST_TASK_BUDGET and no key is being typed.
+ * With no key down it is not deferred longer than USB_HOST_TASK_DEFER_MAX.
+ *
+ * While a key is held down only interrupts of MAX3421E are serviced, which is a
+ * few register reads. usb_host.Task() runs then only to handle detach: root port
+ * lost its device or polling of a keyboard failed as it was pulled from hub.
+ * Either way keys of the keyboard are released by the task.
+ */
+#ifndef USB_HOST_TASK_BUDGET
+#define USB_HOST_TASK_BUDGET        2       // ms
+#endif
+#ifndef USB_HOST_TASK_DEFER_MAX
+#define USB_HOST_TASK_DEFER_MAX     500     // ms
+#endif
+
+// worst-case durations in ms and number of usb_host.Task() over budget
+static uint16_t kbd_poll_max = 0;
+static uint16_t host_task_max = 0;
+static uint16_t host_task_over = 0;
 
 
 uint8_t matrix_rows(void) { return MATRIX_ROWS; }
@@ -89,69 +111,83 @@ bool matrix_has_ghost(void) { return false; }
 void matrix_init(void) {
     // USB Host Shield setup
     usb_host.Init();
-    kbd1.SetReportParser(0, (HIDReportParser*)&kbd_parser1);
-    kbd2.SetReportParser(0, (HIDReportParser*)&kbd_parser2);
-    kbd3.SetReportParser(0, (HIDReportParser*)&kbd_parser3);
-    kbd4.SetReportParser(0, (HIDReportParser*)&kbd_parser4);
 }
 
-static void or_report(report_keyboard_t report) {
-    // integrate reports into keyboard_report
-    keyboard_report.mods |= report.mods;
-    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
-        if (IS_ANY(report.keys[i])) {
-            for (uint8_t j = 0; j < KEYBOARD_REPORT_KEYS; j++) {
-                if (! keyboard_report.keys[j]) {
-                    keyboard_report.keys[j] = report.keys[i];
-                    break;
-                }
-            }
+static uint16_t usb_host_poll_keyboards(bool *error)
+{
+    uint16_t t = timer_read();
+    *error = false;
+    for (uint8_t k = 0; k < KBD_COUNT; k++) {
+        if (kbds[k]->Poll()) *error = true;
+    }
+    t = timer_elapsed(t);
+    if (t > kbd_poll_max) {
+        kbd_poll_max = t;
+        dprintf("kbd.Poll max: %u\n", t);
+    }
+    return t;
+}
+
+static void usb_host_task(uint16_t elapsed, bool typing, bool poll_error)
+{
+    static uint16_t last_task = 0;
+
+    if (typing) {
+        if (!poll_error) {
+            usb_host.MAX3421E::Task();
+            if (usb_host.getVbusState() != SE0) return;
         }
+        dprintf("host.Task: detach\n");
+    } else if (elapsed >= USB_HOST_TASK_BUDGET &&
+            timer_elapsed(last_task) < USB_HOST_TASK_DEFER_MAX) {
+        return;
+    }
+
+    uint16_t t = timer_read();
+    usb_host.Task();
+    last_task = timer_read();
+    t = TIMER_DIFF_16(last_task, t);
+
+    if (t > USB_HOST_TASK_BUDGET) {
+        host_task_over++;
+    }
+    if (t > host_task_max) {
+        host_task_max = t;
+        dprintf("host.Task max: %u over: %u\n", host_task_max, host_task_over);
     }
 }
 
 uint8_t matrix_scan(void) {
-    static uint16_t last_time_stamp1 = 0;
-    static uint16_t last_time_stamp2 = 0;
-    static uint16_t last_time_stamp3 = 0;
-    static uint16_t last_time_stamp4 = 0;
-
-    // check report came from keyboards
-    if (kbd_parser1.time_stamp != last_time_stamp1 ||
-        kbd_parser2.time_stamp != last_time_stamp2 ||
-        kbd_parser3.time_stamp != last_time_stamp3 ||
-        kbd_parser4.time_stamp != last_time_stamp4) {
-
-        last_time_stamp1 = kbd_parser1.time_stamp;
-        last_time_stamp2 = kbd_parser2.time_stamp;
-        last_time_stamp3 = kbd_parser3.time_stamp;
-        last_time_stamp4 = kbd_parser4.time_stamp;
-
-        // clear and integrate all reports
-        keyboard_report = {};
-        or_report(kbd_parser1.report);
-        or_report(kbd_parser2.report);
-        or_report(kbd_parser3.report);
-        or_report(kbd_parser4.report);
-
-        matrix_is_mod = true;
-
-        dprintf("state:  %02X %02X", keyboard_report.mods, keyboard_report.reserved);
-        for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
-            dprintf(" %02X", keyboard_report.keys[i]);
+    // keyboards first
+    bool poll_error;
+    uint16_t elapsed = usb_host_poll_keyboards(&poll_error);
+
+    // rows updated by keyboards since last scan
+    uint16_t changed = 0;
+    for (uint8_t k = 0; k < KBD_COUNT; k++) {
+        changed |= kbds[k]->changed;
+        kbds[k]->changed = 0;
+    }
+
+    // integrate key state of keyboards only on changed rows
+    for (uint8_t r = 0; changed >> r; r++) {
+        if (!(changed & (1 << r))) continue;
+
+        matrix_row_t row = 0;
+        for (uint8_t k = 0; k < KBD_COUNT; k++) {
+            row |= kbds[k]->keys[r];
         }
-        dprint("\r\n");
-    } else {
-        matrix_is_mod = false;
+        matrix[r] = row;
     }
+    matrix_is_mod = changed;
 
-    uint16_t timer;
-    timer = timer_read();
-    usb_host.Task();
-    timer = timer_elapsed(timer);
-    if (timer > 100) {
-        dprintf("host.Task: %d\n", timer);
+    // hubs and enumeration of new devices with time left
+    bool typing = changed;
+    for (uint8_t r = 0; r < MATRIX_ROWS && !typing; r++) {
+        if (matrix[r]) typing = true;
     }
+    usb_host_task(elapsed, typing, poll_error);
+
 
     static uint8_t usb_state = 0;
     if (usb_state != usb_host.getUsbTaskState()) {
@@ -172,46 +208,17 @@ bool matrix_is_modified(void) {
 }
 
 bool matrix_is_on(uint8_t row, uint8_t col) {
-    uint8_t code = CODE(row, col);
-
-    if (IS_MOD(code)) {
-        if (keyboard_report.mods & ROW_BITS(code)) {
-            return true;
-        }
-    }
-    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
-        if (keyboard_report.keys[i] == code) {
-            return true;
-        }
-    }
-    return false;
+    return (matrix[row] & ((matrix_row_t)1<<col));
 }
 
 matrix_row_t matrix_get_row(uint8_t row) {
-    uint16_t row_bits = 0;
-
-    if (IS_MOD(CODE(row, 0)) && keyboard_report.mods) {
-        row_bits |= keyboard_report.mods;
-    }
-
-    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
-        if (IS_ANY(keyboard_report.keys[i])) {
-            if (row == ROW(keyboard_report.keys[i])) {
-                row_bits |= ROW_BITS(keyboard_report.keys[i]);
-            }
-        }
-    }
-    return row_bits;
+    return matrix[row];
 }
 
 uint8_t matrix_key_count(void) {
     uint8_t count = 0;
-
-    count += bitpop(keyboard_report.mods);
-    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
-        if (IS_ANY(keyboard_report.keys[i])) {
-            count++;
-        }
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        count += bitpop16(matrix[r]);
     }
     return count;
 }
@@ -227,8 +234,7 @@ void matrix_print(void) {
 
 void led_set(uint8_t usb_led)
 {
-    kbd1.SetReport(0, 0, 2, 0, 1, &usb_led);
-    kbd2.SetReport(0, 0, 2, 0, 1, &usb_led);
-    kbd3.SetReport(0, 0, 2, 0, 1, &usb_led);
-    kbd4.SetReport(0, 0, 2, 0, 1, &usb_led);
+    for (uint8_t k = 0; k < KBD_COUNT; k++) {
+        kbds[k]->SetLED(usb_led);
+    }
 }
@@ -31,6 +31,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define MATRIX_ROWS 8
 #define MATRIX_COLS 16
 
+/* rows to scan per matrix_scan() call; scan whole matrix at once when undefined */
+//#define MATRIX_SCAN_SLICE 2
+
+/* Topre scan waits(us) until calibrated with Magic+T */
+#define TOPRE_SETTLE_DEFAULT    2
+#define TOPRE_RECOVERY_DEFAULT  75
+
 
 /* key combination for command */
 #define IS_COMMAND() (keyboard_report->mods == (MOD_BIT(KC_LSHIFT) | MOD_BIT(KC_RSHIFT))) 
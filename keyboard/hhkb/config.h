@@ -35,6 +35,19 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 #define MATRIX_COLS 8
 
+/* rows to scan per matrix_scan() call; scan whole matrix at once when undefined */
+//#define MATRIX_SCAN_SLICE 2
+
+/* Topre scan waits(us) until calibrated with Magic+T */
+#define TOPRE_SETTLE_DEFAULT    5
+#ifdef HHKB_JP
+// Looks like JP needs faster scan due to its twice larger matrix
+// or it can drop keys in fast key typing
+#   define TOPRE_RECOVERY_DEFAULT  30
+#else
+#   define TOPRE_RECOVERY_DEFAULT  75
+#endif
+
 
 /* key combination for command */
 #define IS_COMMAND() (keyboard_report->mods == (MOD_BIT(KC_LSHIFT) | MOD_BIT(KC_RSHIFT))) 
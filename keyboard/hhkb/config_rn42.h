@@ -80,6 +80,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
     } while(0)
     #define SERIAL_UART_RTS_LO()    do { PORTD &= ~(1<<5); } while (0)
     #define SERIAL_UART_RTS_HI()    do { PORTD |=  (1<<5); } while (0)
+    /* TX queue of rn42.c: USART Data Register Empty interrupt */
+    #define SERIAL_UART_TXD_VECT    USART1_UDRE_vect
+    #define SERIAL_UART_TXD_INT_ON()    do { UCSR1B |=  (1<<UDRIE1); } while (0)
+    #define SERIAL_UART_TXD_INT_OFF()   do { UCSR1B &= ~(1<<UDRIE1); } while (0)
 #else
     #error "USART configuration is needed."
 #endif
@@ -26,6 +26,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "util.h"
 #include "timer.h"
 #include "matrix.h"
+#include "topre.h"
 #include "hhkb_avr.h"
 #include <avr/wdt.h>
 #include "suspend.h"
@@ -36,11 +37,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define MATRIX_POWER_SAVE       10000
 static uint32_t matrix_last_modified = 0;
 
+// rows scanned per matrix_scan() call
+#ifndef MATRIX_SCAN_SLICE
+#define MATRIX_SCAN_SLICE       MATRIX_ROWS
+#endif
+
 // matrix state buffer(1:on, 0:off)
-static matrix_row_t *matrix;
-static matrix_row_t *matrix_prev;
-static matrix_row_t _matrix0[MATRIX_ROWS];
-static matrix_row_t _matrix1[MATRIX_ROWS];
+static matrix_row_t matrix[MATRIX_ROWS];
 
 
 void matrix_init(void)
@@ -53,90 +56,131 @@ void matrix_init(void)
     KEY_INIT();
 
     // initialize matrix state: all keys off
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) _matrix0[i] = 0x00;
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) _matrix1[i] = 0x00;
-    matrix = _matrix0;
-    matrix_prev = _matrix1;
+    for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix[i] = 0x00;
+
+    topre_timing_init();
 }
 
-uint8_t matrix_scan(void)
+/* key access for topre_calibrate() */
+void topre_key_select(uint8_t row, uint8_t col)
 {
-    uint8_t *tmp;
+    if (!KEY_POWER_STATE()) KEY_POWER_ON();
+    KEY_SELECT(row, col);
+    _delay_us(5);
+    KEY_PREV_ON();
+    _delay_us(10);
+}
 
-    tmp = matrix_prev;
-    matrix_prev = matrix;
-    matrix = tmp;
+void topre_key_enable(void)
+{
+    KEY_ENABLE();
+}
 
-    // power on
-    if (!KEY_POWER_STATE()) KEY_POWER_ON();
-    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
-        for (uint8_t col = 0; col < MATRIX_COLS; col++) {
-            KEY_SELECT(row, col);
-            _delay_us(5);
-
-            // Not sure this is needed. This just emulates HHKB controller's behaviour.
-            if (matrix_prev[row] & (1<<col)) {
-                KEY_PREV_ON();
-            }
-            _delay_us(10);
-
-            // NOTE: KEY_STATE is valid only in 20us after KEY_ENABLE.
-            // If V-USB interrupts in this section we could lose 40us or so
-            // and would read invalid value from KEY_STATE.
-            uint8_t last = TIMER_RAW;
-
-            KEY_ENABLE();
-
-            // Wait for KEY_STATE outputs its value.
-            // 1us was ok on one HHKB, but not worked on another.
-            // no   wait doesn't work on Teensy++ with pro(1us works)
-            // no   wait does    work on tmk PCB(8MHz) with pro2
-            // 1us  wait does    work on both of above
-            // 1us  wait doesn't work on tmk(16MHz)
-            // 5us  wait does    work on tmk(16MHz)
-            // 5us  wait does    work on tmk(16MHz/2)
-            // 5us  wait does    work on tmk(8MHz)
-            // 10us wait does    work on Teensy++ with pro
-            // 10us wait does    work on 328p+iwrap with pro
-            // 10us wait doesn't work on tmk PCB(8MHz) with pro2(very lagged scan)
-            _delay_us(5);
-
-            if (KEY_STATE()) {
-                matrix[row] &= ~(1<<col);
-            } else {
-                matrix[row] |= (1<<col);
-            }
-
-            // Ignore if this code region execution time elapses more than 20us.
-            // MEMO: 20[us] * (TIMER_RAW_FREQ / 1000000)[count per us]
-            // MEMO: then change above using this rule: a/(b/c) = a*1/(b/c) = a*(c/b)
-            if (TIMER_DIFF_RAW(TIMER_RAW, last) > 20/(1000000/TIMER_RAW_FREQ)) {
-                matrix[row] = matrix_prev[row];
-            }
-
-            _delay_us(5);
-            KEY_PREV_OFF();
-            KEY_UNABLE();
-
-            // NOTE: KEY_STATE keep its state in 20us after KEY_ENABLE.
-            // This takes 25us or more to make sure KEY_STATE returns to idle state.
-#ifdef HHKB_JP
-            // Looks like JP needs faster scan due to its twice larger matrix
-            // or it can drop keys in fast key typing
-            _delay_us(30);
-#else
-            _delay_us(75);
-#endif
+void topre_key_unable(void)
+{
+    _delay_us(5);
+    KEY_PREV_OFF();
+    KEY_UNABLE();
+}
+
+bool topre_key_state(void)
+{
+    return KEY_STATE();
+}
+
+static void matrix_scan_row(uint8_t row)
+{
+    matrix_row_t prev = matrix[row];
+    matrix_row_t state = prev;
+
+    for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+        KEY_SELECT(row, col);
+        _delay_us(5);
+
+        // Not sure this is needed. This just emulates HHKB controller's behaviour.
+        if (prev & (1<<col)) {
+            KEY_PREV_ON();
+        }
+        _delay_us(10);
+
+        // NOTE: KEY_STATE is valid only in 20us after KEY_ENABLE.
+        // If V-USB interrupts in this section we could lose 40us or so
+        // and would read invalid value from KEY_STATE.
+        uint8_t last = TIMER_RAW;
+
+        KEY_ENABLE();
+
+        // Wait for KEY_STATE outputs its value.
+        // 1us was ok on one HHKB, but not worked on another.
+        // no   wait doesn't work on Teensy++ with pro(1us works)
+        // no   wait does    work on tmk PCB(8MHz) with pro2
+        // 1us  wait does    work on both of above
+        // 1us  wait doesn't work on tmk(16MHz)
+        // 5us  wait does    work on tmk(16MHz)
+        // 5us  wait does    work on tmk(16MHz/2)
+        // 5us  wait does    work on tmk(8MHz)
+        // 10us wait does    work on Teensy++ with pro
+        // 10us wait does    work on 328p+iwrap with pro
+        // 10us wait doesn't work on tmk PCB(8MHz) with pro2(very lagged scan)
+        // Default 5us; topre_calibrate() measures it on the board.
+        topre_delay_us(topre_settle_us);
+
+        if (KEY_STATE()) {
+            state &= ~(1<<col);
+        } else {
+            state |= (1<<col);
         }
-        if (matrix[row] ^ matrix_prev[row]) matrix_last_modified = timer_read32();
+
+        // Ignore if this code region execution time elapses more than 20us.
+        // MEMO: 20[us] * (TIMER_RAW_FREQ / 1000000)[count per us]
+        // MEMO: then change above using this rule: a/(b/c) = a*1/(b/c) = a*(c/b)
+        if (TIMER_DIFF_RAW(TIMER_RAW, last) > 20/(1000000/TIMER_RAW_FREQ)) {
+            state = prev;
+        }
+
+        _delay_us(5);
+        KEY_PREV_OFF();
+        KEY_UNABLE();
+
+        // NOTE: KEY_STATE keep its state in 20us after KEY_ENABLE.
+        // This takes 25us or more to make sure KEY_STATE returns to idle state.
+        topre_delay_us(topre_recovery_us);
     }
-    // power off
-    if (KEY_POWER_STATE() &&
-            (USB_DeviceState == DEVICE_STATE_Suspended ||
-             USB_DeviceState == DEVICE_STATE_Unattached ) &&
-            timer_elapsed32(matrix_last_modified) > MATRIX_POWER_SAVE) {
-        KEY_POWER_OFF();
-        suspend_power_down();
+    matrix[row] = state;
+    if (state ^ prev) matrix_last_modified = timer_read32();
+}
+
+/*
+ * Scans MATRIX_SCAN_SLICE rows per call and returns so that keyboard_task can
+ * handle timers and USB between them. State of a row is updated as a whole
+ * when its scan is completed.
+ */
+uint8_t matrix_scan(void)
+{
+    static uint8_t row = 0;
+    static uint16_t start = 0;
+
+    for (uint8_t i = 0; i < MATRIX_SCAN_SLICE; i++) {
+        if (row == 0) {
+            start = timer_read();
+            // power on
+            if (!KEY_POWER_STATE()) KEY_POWER_ON();
+        }
+
+        matrix_scan_row(row);
+
+        if (++row < MATRIX_ROWS) continue;
+        row = 0;
+
+        // power off
+        if (KEY_POWER_STATE() &&
+                (USB_DeviceState == DEVICE_STATE_Suspended ||
+                 USB_DeviceState == DEVICE_STATE_Unattached ) &&
+                timer_elapsed32(matrix_last_modified) > MATRIX_POWER_SAVE) {
+            KEY_POWER_OFF();
+            suspend_power_down();
+        }
+        topre_scan_stat(start);
     }
     return 1;
 }
@@ -4,6 +4,7 @@ SRC +=  serial_uart.c \
 	rn42/suart.S \
 	rn42/rn42.c \
 	rn42/rn42_task.c \
+	rn42/rn42_cmd.c \
 	rn42/battery.c \
 	rn42/main.c
 
@@ -1,6 +1,34 @@
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include <util/delay.h>
 #include "battery.h"
+#include "timer.h"
+
+
+/*
+ * Voltage sampling
+ *
+ * Every BATTERY_SAMPLE_INTERVAL battery_task() turns on the voltage divider
+ * and ADC, then conversions are auto-triggered by Timer0 compare match(1ms
+ * tick of timer.c) and handled in ADC interrupt. The first samples after
+ * power-up of divider and reference are discarded. Median of three samples
+ * drops spikes caused by load current of RN-42 and IIR filter smooths the
+ * rest. battery_voltage() only reads the filtered value.
+ */
+#ifndef BATTERY_SAMPLE_INTERVAL
+#define BATTERY_SAMPLE_INTERVAL 1000    // ms
+#endif
+#define SAMPLE_BURST    8
+#define SAMPLE_DISCARD  2
+#define IIR_SHIFT       3               // weight of new sample: 1/8
+
+static volatile uint16_t adc_filtered = 0;  // ADC value << IIR_SHIFT
+static volatile uint8_t adc_count = 0;      // samples left in burst
+static uint16_t adc_window[3];
+static uint8_t adc_window_len;
+static bool low = false;
+
+static uint16_t adc_read(void);
 
 
 /*
@@ -28,6 +56,66 @@ void battery_init(void)
     // ADC disable voltate divider(PF4)
     DDRF  |=  (1<<4);
     PORTF &= ~(1<<4);
+
+    // seed filter; trigger source: Timer0 compare match A
+    adc_filtered = adc_read() << IIR_SHIFT;
+    ADCSRB = (ADCSRB & ~0x0F) | (1<<ADTS1) | (1<<ADTS0);
+}
+
+static uint16_t median3(uint16_t a, uint16_t b, uint16_t c)
+{
+    if (a > b) { uint16_t t = a; a = b; b = t; }
+    if (b > c) b = c;
+    return (a > b) ? a : b;
+}
+
+ISR(ADC_vect)
+{
+    uint16_t v = ADC;
+
+    if (adc_count > SAMPLE_BURST) {
+        // settling of divider and band-gap reference
+        adc_count--;
+        return;
+    }
+
+    adc_window[0] = adc_window[1];
+    adc_window[1] = adc_window[2];
+    adc_window[2] = v;
+    if (adc_window_len < 3) adc_window_len++;
+    if (adc_window_len == 3) {
+        uint16_t m = median3(adc_window[0], adc_window[1], adc_window[2]);
+        adc_filtered += m - (adc_filtered >> IIR_SHIFT);
+    }
+
+    if (--adc_count == 0) {
+        ADCSRA &= ~((1<<ADEN) | (1<<ADATE) | (1<<ADIE));
+        // ADC disable voltate divider(PF4)
+        PORTF &= ~(1<<4);
+    }
+}
+
+void battery_task(void)
+{
+    static uint16_t last = 0;
+    if (adc_count || timer_elapsed(last) < BATTERY_SAMPLE_INTERVAL) return;
+    last = timer_read();
+
+    // low voltage state of last burst
+    uint16_t v = battery_voltage();
+    if (v < BATTERY_VOLTAGE_LOW_LIMIT) {
+        low = true;
+    } else if (v > BATTERY_VOLTAGE_LOW_RECOVERY) {
+        low = false;
+    }
+
+    // ADC enable voltate divider(PF4)
+    DDRF  |=  (1<<4);
+    PORTF |=  (1<<4);
+
+    adc_window_len = 0;
+    adc_count = SAMPLE_BURST + SAMPLE_DISCARD;
+    ADCSRA |= (1<<ADEN) | (1<<ADATE) | (1<<ADIF) | (1<<ADIE);
 }
 
 // Indicator for battery
@@ -72,9 +160,12 @@ bool battery_charging(void)
     _delay_ms(1);
     bool charging = PINF&(1<<5) ? false : true;
 
-    // restore last register status
+    // restore last register status; PF4 is cleared in ADC interrupt
+    uint8_t sreg = SREG;
+    cli();
     DDRF  = (DDRF&~(1<<5))  | (ddrf_prev&(1<<5));
     PORTF = (PORTF&~(1<<5)) | (portf_prev&(1<<5));
+    SREG = sreg;
 
     // TODO: With MCP73831 this can not get stable status when charging.
     // LED is powered from PSEL line(USB or Lipo)
@@ -83,10 +174,10 @@ bool battery_charging(void)
     return charging;
 }
 
-// Returns voltage in mV
-uint16_t battery_voltage(void)
+// Blocking conversion to seed filter
+static uint16_t adc_read(void)
 {
-    // ADC disable voltate divider(PF4)
+    // ADC enable voltate divider(PF4)
     DDRF  |=  (1<<4);
     PORTF |=  (1<<4);
 
@@ -104,18 +195,18 @@ uint16_t battery_voltage(void)
     DDRF  |=  (1<<4);
     PORTF &= ~(1<<4);
 
-    return (bat - BATTERY_ADC_OFFSET) * BATTERY_ADC_RESOLUTION;
+    return bat;
 }
 
-static bool low_voltage(void) {
-    static bool low = false;
-    uint16_t v = battery_voltage();
-    if (v < BATTERY_VOLTAGE_LOW_LIMIT) {
-        low = true;
-    } else if (v > BATTERY_VOLTAGE_LOW_RECOVERY) {
-        low = false;
-    }
-    return low;
+// Returns voltage in mV
+uint16_t battery_voltage(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t bat = adc_filtered;
+    SREG = sreg;
+    bat = (bat + (1<<(IIR_SHIFT-1))) >> IIR_SHIFT;
+    return (bat - BATTERY_ADC_OFFSET) * BATTERY_ADC_RESOLUTION;
 }
 
 battery_status_t battery_status(void)
@@ -125,6 +216,6 @@ battery_status_t battery_status(void)
         return battery_charging() ? CHARGING : FULL_CHARGED;
     } else {
         /* not powered */
-        return low_voltage() ? LOW_VOLTAGE : DISCHARGING;
+        return low ? LOW_VOLTAGE : DISCHARGING;
     }
 }
@@ -21,6 +21,8 @@ typedef enum {
 
 /* Battery API */
 void battery_init(void);
+/* starts background sampling periodically */
+void battery_task(void);
 void battery_led(battery_led_t val);
 bool battery_charging(void);
 uint16_t battery_voltage(void);
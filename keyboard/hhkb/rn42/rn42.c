@@ -1,9 +1,11 @@
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include "host.h"
 #include "host_driver.h"
 #include "serial.h"
 #include "rn42.h"
 #include "print.h"
+#include "debug.h"
 #include "timer.h"
 #include "wait.h"
 
@@ -24,6 +26,265 @@ host_driver_t rn42_driver = {
 };
 
 
+/*
+ * TX queue
+ *
+ * Bytes to RN-42 are queued in ring buffer and sent by USART Data Register
+ * Empty interrupt. Transmission pauses while RTS of RN-42 is high and is
+ * resumed by rn42_tx_task().
+ *
+ * Keyboard and consumer reports carry state of keys and the latest one
+ * supersedes older. While previous report of the type still waits in buffer
+ * it is overwritten in place instead of queueing new one. Report which
+ * doesn't fit in buffer is held in pending slot of its type until buffer has
+ * room, mouse report in the slot is replaced by newer one.
+ */
+#ifndef RN42_TX_BUFFER_SIZE
+#define RN42_TX_BUFFER_SIZE 64      // power of 2, 128 at most
+#endif
+#define TX_MASK     (RN42_TX_BUFFER_SIZE - 1)
+#define TX_USED()   ((uint8_t)(tx_head - tx_tail) & TX_MASK)
+#define TX_SPACE()  (TX_MASK - TX_USED())
+
+// timeout(ms) of rn42_putc() while buffer is full
+#define TX_PUTC_TIMEOUT 100
+
+enum { TX_KEYBOARD, TX_MOUSE, TX_CONSUMER, TX_REPORT_TYPES };
+#define TX_COALESCE     ((1<<TX_KEYBOARD) | (1<<TX_CONSUMER))
+#define TX_REPORT_MAX   11
+
+static uint8_t tx_buf[RN42_TX_BUFFER_SIZE];
+static volatile uint8_t tx_head = 0;
+static volatile uint8_t tx_tail = 0;
+
+// reports whose first byte is not sent yet and their position in buffer
+static volatile uint8_t tx_queued = 0;
+static uint8_t tx_pos[TX_REPORT_TYPES];
+
+// reports waiting for room in buffer
+static uint8_t tx_pending = 0;
+static uint8_t tx_pending_len[TX_REPORT_TYPES];
+static uint8_t tx_pending_data[TX_REPORT_TYPES][TX_REPORT_MAX];
+
+static uint16_t tx_coalesced = 0;
+static uint16_t tx_replaced = 0;
+
+static void tx_kick(void)
+{
+    if (tx_head != tx_tail && !rn42_rts()) {
+        SERIAL_UART_TXD_INT_ON();
+    }
+}
+
+ISR(SERIAL_UART_TXD_VECT)
+{
+    if (tx_head == tx_tail || rn42_rts()) {
+        // empty or RN-42 is not ready; tx_kick() restarts
+        SERIAL_UART_TXD_INT_OFF();
+        return;
+    }
+    if (tx_queued) {
+        for (uint8_t i = 0; i < TX_REPORT_TYPES; i++) {
+            if ((tx_queued & (1<<i)) && tx_pos[i] == tx_tail) {
+                tx_queued &= ~(1<<i);
+            }
+        }
+    }
+    SERIAL_UART_DATA = tx_buf[tx_tail];
+    tx_tail = (tx_tail + 1) & TX_MASK;
+}
+
+static bool tx_put(const uint8_t *data, uint8_t len)
+{
+    bool ret = false;
+    uint8_t sreg = SREG;
+    cli();
+    if (TX_SPACE() >= len) {
+        uint8_t head = tx_head;
+        while (len--) {
+            tx_buf[head] = *data++;
+            head = (head + 1) & TX_MASK;
+        }
+        tx_head = head;
+        ret = true;
+    }
+    SREG = sreg;
+    return ret;
+}
+
+static bool tx_put_report(uint8_t type, const uint8_t *data, uint8_t len)
+{
+    bool ret = true;
+    uint8_t sreg = SREG;
+    cli();
+    if (tx_queued & (1<<type)) {
+        // not started yet: replace with the latest
+        uint8_t pos = tx_pos[type];
+        for (uint8_t i = 0; i < len; i++) {
+            tx_buf[pos] = data[i];
+            pos = (pos + 1) & TX_MASK;
+        }
+        tx_coalesced++;
+    } else if (TX_SPACE() >= len) {
+        if (TX_COALESCE & (1<<type)) {
+            tx_pos[type] = tx_head;
+            tx_queued |= (1<<type);
+        }
+        uint8_t head = tx_head;
+        for (uint8_t i = 0; i < len; i++) {
+            tx_buf[head] = data[i];
+            head = (head + 1) & TX_MASK;
+        }
+        tx_head = head;
+    } else {
+        ret = false;
+    }
+    SREG = sreg;
+    return ret;
+}
+
+static void tx_send_report(uint8_t type, const uint8_t *data, uint8_t len)
+{
+    // report held in pending slot goes first
+    if (!(tx_pending & (1<<type)) && tx_put_report(type, data, len)) {
+        tx_kick();
+        return;
+    }
+
+    if (tx_pending & (1<<type)) {
+        if (TX_COALESCE & (1<<type)) tx_coalesced++;
+        else                         tx_replaced++;
+    }
+    for (uint8_t i = 0; i < len; i++) {
+        tx_pending_data[type][i] = data[i];
+    }
+    tx_pending_len[type] = len;
+    tx_pending |= (1<<type);
+    tx_kick();
+}
+
+void rn42_tx_task(void)
+{
+    if (tx_pending) {
+        for (uint8_t i = 0; i < TX_REPORT_TYPES; i++) {
+            if ((tx_pending & (1<<i)) &&
+                    tx_put_report(i, tx_pending_data[i], tx_pending_len[i])) {
+                tx_pending &= ~(1<<i);
+            }
+        }
+    }
+    tx_kick();
+}
+
+void rn42_tx_flush(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    SERIAL_UART_TXD_INT_OFF();
+    tx_head = tx_tail = 0;
+    tx_queued = 0;
+    tx_pending = 0;
+    SREG = sreg;
+}
+
+void rn42_tx_stats_print(void)
+{
+    xprintf("tx used:%u pending:%02X coalesced:%u replaced:%u\n",
+            TX_USED(), tx_pending, tx_coalesced, tx_replaced);
+}
+
+
+/*
+ * Link state
+ *
+ * Reports are not queued while RN-42 has no link to host, only the latest
+ * keyboard, consumer and mouse button state is kept. On reconnection the
+ * state is queued as resync reports ahead of live reports so that host
+ * doesn't keep keys pressed before the link dropped.
+ */
+static bool link_up = false;
+static uint8_t link_changed = 0;
+static uint8_t link_len[TX_REPORT_TYPES];
+static uint8_t link_state[TX_REPORT_TYPES][TX_REPORT_MAX];
+
+static bool link_resyncing = false;
+static uint16_t link_time = 0;
+static uint16_t link_reconnects = 0;
+static uint16_t link_resync_last = 0;
+static uint16_t link_resync_max = 0;
+
+static void link_send_report(uint8_t type, const uint8_t *data, uint8_t len)
+{
+    for (uint8_t i = 0; i < len; i++) {
+        link_state[type][i] = data[i];
+    }
+    link_len[type] = len;
+    if (type == TX_MOUSE) {
+        // buttons only: movement is not state
+        link_state[type][4] = link_state[type][5] = link_state[type][6] = 0;
+    }
+
+    if (link_up) {
+        tx_send_report(type, data, len);
+    } else {
+        link_changed |= (1<<type);
+    }
+}
+
+static bool link_state_active(uint8_t type)
+{
+    for (uint8_t i = 3; i < link_len[type]; i++) {
+        if (link_state[type][i]) return true;
+    }
+    return false;
+}
+
+static void link_resync(void)
+{
+    for (uint8_t i = 0; i < TX_REPORT_TYPES; i++) {
+        // keyboard always, others when they are pressed or released meanwhile
+        if (i == TX_KEYBOARD || (link_changed & (1<<i)) || link_state_active(i)) {
+            if (link_len[i]) tx_send_report(i, link_state[i], link_len[i]);
+        }
+    }
+    link_changed = 0;
+}
+
+void rn42_link_task(void)
+{
+    bool linked = !rn42_rts() && rn42_linked();
+
+    if (linked && !link_up) {
+        link_up = true;
+        link_time = timer_read();
+        link_resyncing = true;
+        link_reconnects++;
+        link_resync();
+        dprintf("rn42: link up\n");
+    } else if (!linked && link_up) {
+        link_up = false;
+        link_resyncing = false;
+        dprintf("rn42: link down\n");
+    }
+
+    // resync reports are out when buffer gets empty
+    if (link_resyncing && !tx_pending && TX_USED() == 0) {
+        link_resyncing = false;
+        link_resync_last = timer_elapsed(link_time);
+        if (link_resync_last > link_resync_max) {
+            link_resync_max = link_resync_last;
+        }
+        dprintf("rn42: resync %ums\n", link_resync_last);
+    }
+}
+
+void rn42_link_stats_print(void)
+{
+    xprintf("link reconnects:%u resync:%ums max:%ums\n",
+            link_reconnects, link_resync_last, link_resync_max);
+}
+
+
 void rn42_init(void)
 {
     // JTAG disable for PORT F. write JTD bit twice within four cycles.
@@ -53,32 +314,20 @@ int16_t rn42_getc(void)
     return serial_recv2();
 }
 
-const char *rn42_gets(uint16_t timeout)
+void rn42_putc(uint8_t c)
 {
-    static char s[24];
     uint16_t t = timer_read();
-    uint8_t i = 0;
-    int16_t c;
-    while (i < 23 && timer_elapsed(t) < timeout) {
-        if ((c = rn42_getc()) != -1) {
-            if ((char)c == '\r') continue;
-            if ((char)c == '\n') break;
-            s[i++] = c;
-        }
+    while (!tx_put(&c, 1)) {
+        tx_kick();
+        if (timer_elapsed(t) > TX_PUTC_TIMEOUT) return;
     }
-    s[i] = '\0';
-    return s;
-}
-
-void rn42_putc(uint8_t c)
-{
-    serial_send(c);
+    tx_kick();
 }
 
 void rn42_puts(char *s)
 {
     while (*s)
-	serial_send(*s++);
+	rn42_putc(*s++);
 }
 
 bool rn42_autoconnecting(void)
@@ -142,25 +391,6 @@ void rn42_send_str(const char *str)
         rn42_putc(c);
 }
 
-const char *rn42_send_command(const char *cmd)
-{
-    static const char *s;
-    rn42_send_str(cmd);
-    wait_ms(500);
-    s = rn42_gets(100);
-    xprintf("%s\r\n", s);
-    rn42_print_response();
-    return s;
-}
-
-void rn42_print_response(void)
-{
-    int16_t c;
-    while ((c = rn42_getc()) != -1) {
-        xprintf("%c", c);
-    }
-}
-
 
 static void send_keyboard(report_keyboard_t *report)
 {
@@ -171,17 +401,20 @@ static void send_keyboard(report_keyboard_t *report)
     PORTD &= ~(1<<5);   // low
 */
 
-    serial_send(0xFD);  // Raw report mode
-    serial_send(9);     // length
-    serial_send(1);     // descriptor type
-    serial_send(report->mods);
-    serial_send(0x00);
-    serial_send(report->keys[0]);
-    serial_send(report->keys[1]);
-    serial_send(report->keys[2]);
-    serial_send(report->keys[3]);
-    serial_send(report->keys[4]);
-    serial_send(report->keys[5]);
+    uint8_t r[] = {
+        0xFD,           // Raw report mode
+        9,              // length
+        1,              // descriptor type
+        report->mods,
+        0x00,
+        report->keys[0],
+        report->keys[1],
+        report->keys[2],
+        report->keys[3],
+        report->keys[4],
+        report->keys[5]
+    };
+    link_send_report(TX_KEYBOARD, r, sizeof(r));
 }
 
 static void send_mouse(report_mouse_t *report)
@@ -193,13 +426,16 @@ static void send_mouse(report_mouse_t *report)
     PORTD &= ~(1<<5);   // low
 */
 
-    serial_send(0xFD);  // Raw report mode
-    serial_send(5);     // length
-    serial_send(2);     // descriptor type
-    serial_send(report->buttons);
-    serial_send(report->x);
-    serial_send(report->y);
-    serial_send(report->v);
+    uint8_t r[] = {
+        0xFD,           // Raw report mode
+        5,              // length
+        2,              // descriptor type
+        report->buttons,
+        mouse_clamp8(report->x),
+        mouse_clamp8(report->y),
+        report->v
+    };
+    link_send_report(TX_MOUSE, r, sizeof(r));
 }
 
 static void send_system(uint16_t data)
@@ -235,11 +471,14 @@ static uint16_t usage2bits(uint16_t usage)
 static void send_consumer(uint16_t data)
 {
     uint16_t bits = usage2bits(data);
-    serial_send(0xFD);  // Raw report mode
-    serial_send(3);     // length
-    serial_send(3);     // descriptor type
-    serial_send(bits&0xFF);
-    serial_send((bits>>8)&0xFF);
+    uint8_t r[] = {
+        0xFD,           // Raw report mode
+        3,              // length
+        3,              // descriptor type
+        bits&0xFF,
+        (bits>>8)&0xFF
+    };
+    link_send_report(TX_CONSUMER, r, sizeof(r));
 }
 
 
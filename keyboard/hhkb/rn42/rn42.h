@@ -9,7 +9,6 @@ host_driver_t rn42_config_driver;
 
 void rn42_init(void);
 int16_t rn42_getc(void);
-const char *rn42_gets(uint16_t timeout);
 void rn42_putc(uint8_t c);
 void rn42_puts(char *s);
 bool rn42_autoconnecting(void);
@@ -21,10 +20,17 @@ void rn42_cts_lo(void);
 bool rn42_linked(void);
 void rn42_set_leds(uint8_t l);
 
-const char *rn42_send_command(const char *cmd);
+/* TX queue: restarts transmission and queues held reports */
+void rn42_tx_task(void);
+/* discards queued data and held reports */
+void rn42_tx_flush(void);
+void rn42_tx_stats_print(void);
+
+/* link state: resyncs host with the latest state on reconnection */
+void rn42_link_task(void);
+void rn42_link_stats_print(void);
+
 void rn42_send_str(const char *str);
-void rn42_print_response(void);
 #define SEND_STR(str)       rn42_send_str(PSTR(str))
-#define SEND_COMMAND(cmd)   rn42_send_command(PSTR(cmd))
 
 #endif
@@ -0,0 +1,184 @@
+#include <stdint.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include "rn42.h"
+#include "rn42_cmd.h"
+#include "debug.h"
+#include "timer.h"
+
+
+#ifndef RN42_CMD_QUEUE_SIZE
+#define RN42_CMD_QUEUE_SIZE 16      // power of 2
+#endif
+#define CMD_MASK    (RN42_CMD_QUEUE_SIZE - 1)
+
+// RN-42 needs 1 sec without data before and after "$$$"
+#define CMD_GUARD_TIME      1100
+// give up when link is not dropped for "$$$"
+#define CMD_LINK_TIMEOUT    3000
+
+typedef struct {
+    const char *cmd;
+    const char *expect;     // PROGMEM
+    uint16_t timeout;
+    rn42_cmd_cb_t cb;
+    uint8_t flags;
+} rn42_cmd_t;
+
+static rn42_cmd_t queue[RN42_CMD_QUEUE_SIZE];
+static uint8_t head = 0;
+static uint8_t tail = 0;
+
+static enum { CMD_IDLE, CMD_GUARD, CMD_SEND, CMD_WAIT } state = CMD_IDLE;
+static uint16_t cmd_time;       // start of command
+static uint16_t wait_time;      // start of current wait
+
+static char line[24];
+static uint8_t line_len = 0;
+
+
+bool rn42_cmd_queue(const char *cmd, const char *expect, uint16_t timeout,
+                    rn42_cmd_cb_t cb, uint8_t flags)
+{
+    if (((head + 1) & CMD_MASK) == tail) {
+        dprintf("rn42_cmd: queue full\n");
+        return false;
+    }
+
+    rn42_cmd_t *c;
+    if (flags & RN42_CMD_FIRST) {
+        // right after current command
+        if (state == CMD_IDLE) {
+            tail = (tail - 1) & CMD_MASK;
+            c = &queue[tail];
+        } else {
+            uint8_t next = (tail + 1) & CMD_MASK;
+            for (uint8_t i = head; i != next; i = (i - 1) & CMD_MASK) {
+                queue[i] = queue[(i - 1) & CMD_MASK];
+            }
+            c = &queue[next];
+            head = (head + 1) & CMD_MASK;
+        }
+    } else {
+        c = &queue[head];
+        head = (head + 1) & CMD_MASK;
+    }
+    c->cmd = cmd;
+    c->expect = expect;
+    c->timeout = timeout;
+    c->cb = cb;
+    c->flags = flags;
+    return true;
+}
+
+void rn42_cmd_clear(void)
+{
+    head = tail = 0;
+    state = CMD_IDLE;
+}
+
+bool rn42_cmd_busy(void)
+{
+    return head != tail;
+}
+
+static uint8_t cmd_char(const rn42_cmd_t *c, uint8_t i)
+{
+    return (c->flags & RN42_CMD_RAM) ? c->cmd[i] : pgm_read_byte(c->cmd + i);
+}
+
+static void cmd_send(const rn42_cmd_t *c)
+{
+    uint8_t ch;
+    for (uint8_t i = 0; (ch = cmd_char(c, i)); i++) {
+        rn42_putc(ch);
+    }
+}
+
+// local echo: line is same as command without CR/LF
+static bool cmd_echo(const rn42_cmd_t *c)
+{
+    uint8_t i;
+    for (i = 0; i < line_len; i++) {
+        if (line[i] != cmd_char(c, i)) return false;
+    }
+    uint8_t ch = cmd_char(c, i);
+    return (ch == '\0' || ch == '\r' || ch == '\n');
+}
+
+static void cmd_done(const char *resp)
+{
+    rn42_cmd_cb_t cb = queue[tail].cb;
+    tail = (tail + 1) & CMD_MASK;
+    state = CMD_IDLE;
+    if (cb) cb(resp);
+}
+
+static void cmd_line(void)
+{
+    const rn42_cmd_t *c = &queue[tail];
+    uint8_t len = strlen_P(c->expect);
+
+    if (len) {
+        if (strncmp_P(line, c->expect, len) == 0) {
+            cmd_done(line);
+        } else if (strncmp_P(line, PSTR("ERR"), 3) == 0 || strcmp_P(line, PSTR("?")) == 0) {
+            dprintf("rn42_cmd: %s\n", line);
+            cmd_done(NULL);
+        }
+    } else if (!cmd_echo(c)) {
+        cmd_done(line);
+    }
+}
+
+void rn42_cmd_recv(uint8_t c)
+{
+    if (state != CMD_WAIT) return;
+
+    if (c == '\r') return;
+    if (c == '\n') {
+        line[line_len] = '\0';
+        if (line_len) cmd_line();
+        line_len = 0;
+        return;
+    }
+    if (line_len < sizeof(line) - 1) {
+        line[line_len++] = c;
+    }
+}
+
+void rn42_cmd_task(void)
+{
+    if (head == tail) return;
+
+    const rn42_cmd_t *c = &queue[tail];
+    switch (state) {
+        case CMD_IDLE:
+            cmd_time = wait_time = timer_read();
+            state = (c->flags & RN42_CMD_ENTER) ? CMD_GUARD : CMD_SEND;
+            break;
+        case CMD_GUARD:
+            if (rn42_linked()) {
+                wait_time = timer_read();
+                if (timer_elapsed(cmd_time) > CMD_LINK_TIMEOUT) {
+                    dprintf("rn42_cmd: link not dropped\n");
+                    cmd_done(NULL);
+                }
+            } else if (timer_elapsed(wait_time) > CMD_GUARD_TIME) {
+                state = CMD_SEND;
+            }
+            break;
+        case CMD_SEND:
+            line_len = 0;
+            cmd_send(c);
+            wait_time = timer_read();
+            state = CMD_WAIT;
+            break;
+        case CMD_WAIT:
+            if (timer_elapsed(wait_time) > c->timeout) {
+                dprintf("rn42_cmd: timeout\n");
+                cmd_done(NULL);
+            }
+            break;
+    }
+}
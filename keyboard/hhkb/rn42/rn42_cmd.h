@@ -0,0 +1,40 @@
+#ifndef RN42_CMD_H
+#define RN42_CMD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/pgmspace.h>
+
+/*
+ * Non-blocking command queue for RN-42 command mode
+ *
+ * Commands are sent one by one from rn42_cmd_task() and the first response
+ * line which starts with 'expect' completes the command. Empty 'expect'
+ * takes any line except local echo of the command. Callback gets the line,
+ * or NULL on timeout or when RN-42 answers with "ERR" or "?".
+ */
+typedef void (*rn42_cmd_cb_t)(const char *resp);
+
+/* flags */
+#define RN42_CMD_RAM    0x01    // cmd is in RAM(default: PROGMEM)
+#define RN42_CMD_FIRST  0x02    // queue in front of other commands
+#define RN42_CMD_ENTER  0x04    // "$$$": wait for link down and guard time
+
+#ifndef RN42_CMD_TIMEOUT
+#define RN42_CMD_TIMEOUT    600     // ms
+#endif
+
+bool rn42_cmd_queue(const char *cmd, const char *expect, uint16_t timeout,
+                    rn42_cmd_cb_t cb, uint8_t flags);
+/* discards queued commands without callback */
+void rn42_cmd_clear(void);
+bool rn42_cmd_busy(void);
+
+/* feeds characters from RN-42 */
+void rn42_cmd_recv(uint8_t c);
+void rn42_cmd_task(void);
+
+#define RN42_COMMAND(cmd, expect, cb) \
+    rn42_cmd_queue(PSTR(cmd), PSTR(expect), RN42_CMD_TIMEOUT, cb, 0)
+
+#endif
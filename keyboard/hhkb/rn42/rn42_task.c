@@ -9,6 +9,7 @@
 #include "action_util.h"
 #include "lufa.h"
 #include "rn42_task.h"
+#include "rn42_cmd.h"
 #include "print.h"
 #include "debug.h"
 #include "timer.h"
@@ -49,6 +50,7 @@ void rn42_task(void)
                 else {
                     if (0x0 <= c && c <= 0x7f) xprintf("%c", c);
                     else xprintf(" %02X", c);
+                    rn42_cmd_recv(c);
                 }
                 break;
             case LED_FE:
@@ -69,17 +71,25 @@ void rn42_task(void)
         }
     }
 
+    rn42_cmd_task();
+    battery_task();
+
     /* Bluetooth mode when ready */
-    if (!config_mode && !force_usb) {
+    if (!config_mode && !force_usb && !rn42_cmd_busy()) {
         if (!rn42_rts() && host_get_driver() != &rn42_driver) {
             clear_keyboard();
             host_set_driver(&rn42_driver);
         } else if (rn42_rts() && host_get_driver() != &lufa_driver) {
             clear_keyboard();
             host_set_driver(&lufa_driver);
+            // RN-42 is off: don't send stale reports after power on
+            rn42_tx_flush();
         }
     }
 
+    rn42_link_task();
+    rn42_tx_task();
+
 
     static uint16_t prev_timer = 0;
     uint16_t e = timer_elapsed(prev_timer);
@@ -125,46 +135,69 @@ void rn42_task(void)
  ******************************************************************************/
 static host_driver_t *prev_driver = &rn42_driver;
 
+/*
+ * Commands are queued to rn42_cmd and sent from rn42_task() so that main loop
+ * is not blocked while waiting for responses of RN-42.
+ */
+static void command_mode_left(const char *resp)
+{
+    print("Config mode exited\n");
+    rn42_autoconnect();
+    clear_keyboard();
+    host_set_driver(prev_driver);
+}
+
+static void command_mode_entered(const char *resp)
+{
+    if (!resp) {
+        // not in command mode: drop following commands not to send them as data
+        print("RN-42: no response to $$$\n");
+        rn42_cmd_clear();
+        config_mode = false;
+        command_state = ONESHOT;
+        command_mode_left(NULL);
+        return;
+    }
+    print("Config mode entered\n");
+}
+
+static void echo_checked(const char *resp)
+{
+    // local echo on for config mode console
+    if (!resp) rn42_cmd_queue(PSTR("+\r\n"), PSTR("Echo"), RN42_CMD_TIMEOUT, NULL, RN42_CMD_FIRST);
+}
+
 static void enter_command_mode(void)
 {
     prev_driver = host_get_driver();
     clear_keyboard();
     host_set_driver(&rn42_config_driver);   // null driver; not to send a key to host
     rn42_disconnect();
-    while (rn42_linked()) ;
 
     print("Entering config mode ...\n");
-    wait_ms(1100);          // need 1 sec
-    SEND_COMMAND("$$$");
-    wait_ms(600);           // need 1 sec
-    rn42_print_response();
-    const char *s = SEND_COMMAND("v\r\n");
-    if (strncmp("v", s, 1) != 0) SEND_COMMAND("+\r\n"); // local echo on
+    rn42_cmd_queue(PSTR("$$$"), PSTR("CMD"), 1000, command_mode_entered, RN42_CMD_ENTER);
+    rn42_cmd_queue(PSTR("v\r\n"), PSTR("v"), RN42_CMD_TIMEOUT, echo_checked, 0);
 }
 
 static void exit_command_mode(void)
 {
     print("Exiting config mode ...\n");
-    SEND_COMMAND("---\r\n");    // exit
-
-    rn42_autoconnect();
-    clear_keyboard();
-    host_set_driver(prev_driver);
+    RN42_COMMAND("---\r\n", "END", command_mode_left);
 }
 
 static void init_rn42(void)
 {
     // RN-42 configure
     if (!config_mode) enter_command_mode();
-    SEND_COMMAND("SF,1\r\n");  // factory defaults
-    SEND_COMMAND("S-,TmkBT\r\n");
-    SEND_COMMAND("SS,Keyboard/Mouse\r\n");
-    SEND_COMMAND("SM,4\r\n");  // auto connect(DTR)
-    SEND_COMMAND("SW,8000\r\n");   // Sniff disable
-    SEND_COMMAND("S~,6\r\n");   // HID profile
-    SEND_COMMAND("SH,003C\r\n");   // combo device, out-report, 4-reconnect
-    SEND_COMMAND("SY,FFF4\r\n");   // transmit power -12
-    SEND_COMMAND("R,1\r\n");
+    RN42_COMMAND("SF,1\r\n", "AOK", NULL);  // factory defaults
+    RN42_COMMAND("S-,TmkBT\r\n", "AOK", NULL);
+    RN42_COMMAND("SS,Keyboard/Mouse\r\n", "AOK", NULL);
+    RN42_COMMAND("SM,4\r\n", "AOK", NULL);  // auto connect(DTR)
+    RN42_COMMAND("SW,8000\r\n", "AOK", NULL);   // Sniff disable
+    RN42_COMMAND("S~,6\r\n", "AOK", NULL);   // HID profile
+    RN42_COMMAND("SH,003C\r\n", "AOK", NULL);   // combo device, out-report, 4-reconnect
+    RN42_COMMAND("SY,FFF4\r\n", "AOK", NULL);   // transmit power -12
+    RN42_COMMAND("R,1\r\n", "Reboot", NULL);
     if (!config_mode) exit_command_mode();
 }
 
@@ -176,36 +209,44 @@ static void init_rn42(void)
 #define RN42_LINK1  (uint8_t *)140
 #define RN42_LINK2  (uint8_t *)152
 #define RN42_LINK3  (uint8_t *)164
-static void store_link(uint8_t *eeaddr)
+static uint8_t *link_eeaddr;
+
+static void link_stored(const char *s)
 {
-    enter_command_mode();
-    SEND_STR("GR\r\n"); // remote address
-    const char *s = rn42_gets(500);
-    if (strcmp("GR", s) == 0) s = rn42_gets(500);   // ignore local echo
+    if (!s) return;
     xprintf("%s(%d)\r\n", s, strlen(s));
     if (strlen(s) == 12) {
         for (int i = 0; i < 12; i++) {
-            eeprom_write_byte(eeaddr+i, *(s+i));
+            eeprom_write_byte(link_eeaddr+i, *(s+i));
             dprintf("%c ", *(s+i));
         }
         dprint("\r\n");
     }
+}
+
+static void store_link(uint8_t *eeaddr)
+{
+    link_eeaddr = eeaddr;
+    enter_command_mode();
+    RN42_COMMAND("GR\r\n", "", link_stored); // remote address
     exit_command_mode();
 }
 
 static void restore_link(const uint8_t *eeaddr)
 {
-    enter_command_mode();
-    SEND_COMMAND("SR,Z\r\n");   // remove remote address
-    SEND_STR("SR,");            // set remote address from EEPROM
+    // set remote address from EEPROM
+    static char sr[] = "SR,????????????\r\n";
     for (int i = 0; i < 12; i++) {
         uint8_t c = eeprom_read_byte(eeaddr+i);
-        rn42_putc(c);
+        sr[3+i] = c;
         dprintf("%c ", c);
     }
     dprintf("\r\n");
-    SEND_COMMAND("\r\n");
-    SEND_COMMAND("R,1\r\n");    // reboot
+
+    enter_command_mode();
+    RN42_COMMAND("SR,Z\r\n", "AOK", NULL);   // remove remote address
+    rn42_cmd_queue(sr, PSTR("AOK"), RN42_CMD_TIMEOUT, NULL, RN42_CMD_RAM);
+    RN42_COMMAND("R,1\r\n", "Reboot", NULL);    // reboot
     exit_command_mode();
 }
 
@@ -224,8 +265,8 @@ static const char *get_link(uint8_t * eeaddr)
 static void pairing(void)
 {
     enter_command_mode();
-    SEND_COMMAND("SR,Z\r\n");   // remove remote address
-    SEND_COMMAND("R,1\r\n");    // reboot
+    RN42_COMMAND("SR,Z\r\n", "AOK", NULL);   // remove remote address
+    RN42_COMMAND("R,1\r\n", "Reboot", NULL);    // reboot
     exit_command_mode();
 }
 
@@ -254,6 +295,7 @@ bool command_extra(uint8_t code)
                 return false;   // to display default command help
             }
         case KC_P:
+            if (rn42_cmd_busy()) { print("busy\n"); return true; }
             pairing();
             return true;
 #if 0
@@ -291,6 +333,9 @@ bool command_extra(uint8_t code)
             xprintf("rn42: %s\n", rn42_rts() ? "OFF" : (rn42_linked() ? "CONN" : "ON"));
             xprintf("rn42_autoconnecting(): %X\n", rn42_autoconnecting());
             xprintf("config_mode: %X\n", config_mode);
+            xprintf("command busy: %X\n", rn42_cmd_busy());
+            rn42_tx_stats_print();
+            rn42_link_stats_print();
             xprintf("USB State: %s\n",
                     (USB_DeviceState == DEVICE_STATE_Unattached) ? "Unattached" :
                     (USB_DeviceState == DEVICE_STATE_Powered) ? "Powered" :
@@ -345,6 +390,7 @@ bool command_extra(uint8_t code)
             return true;
         case KC_DELETE:
             /* RN-42 Command mode */
+            if (rn42_cmd_busy()) { print("busy\n"); return true; }
             if (rn42_autoconnecting()) {
                 enter_command_mode();
 
@@ -358,6 +404,7 @@ bool command_extra(uint8_t code)
             }
             return true;
         case KC_SCROLLLOCK:
+            if (rn42_cmd_busy()) { print("busy\n"); return true; }
             init_rn42();
             return true;
         default:
@@ -68,3 +68,9 @@ matrix_row_t matrix_get_row(uint8_t row)
 {
     return row_debounced;
 }
+
+/* key is wired to PB0 directly and needs no row selection */
+bool matrix_wakeup_select(void)
+{
+    return true;
+}
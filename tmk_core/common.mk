@@ -49,6 +49,10 @@ endif
 
 ifeq (yes,$(strip $(CONSOLE_ENABLE)))
     OPT_DEFS += -DCONSOLE_ENABLE
+    ifeq (yes,$(strip $(BINLOG_ENABLE)))
+        SRC += $(COMMON_DIR)/binlog.c
+        OPT_DEFS += -DBINLOG_ENABLE
+    endif
 else
     OPT_DEFS += -DNO_PRINT
     OPT_DEFS += -DNO_DEBUG
@@ -63,6 +67,11 @@ ifeq (yes,$(strip $(NKRO_ENABLE)))
     OPT_DEFS += -DNKRO_ENABLE
 endif
 
+ifeq (yes,$(strip $(RAW_ENABLE)))
+    SRC += $(COMMON_DIR)/raw_hid.c
+    OPT_DEFS += -DRAW_ENABLE
+endif
+
 ifeq (yes,$(strip $(USB_6KRO_ENABLE)))
     OPT_DEFS += -DUSB_6KRO_ENABLE
 endif
@@ -77,6 +86,11 @@ ifeq (yes,$(strip $(SLEEP_LED_ENABLE)))
     OPT_DEFS += -DNO_SUSPEND_POWER_DOWN
 endif
 
+ifeq (yes,$(strip $(TOPRE_ENABLE)))
+    SRC += $(COMMON_DIR)/avr/topre.c
+    OPT_DEFS += -DTOPRE_ENABLE
+endif
+
 ifeq (yes,$(strip $(BACKLIGHT_ENABLE)))
     SRC += $(COMMON_DIR)/backlight.c
     OPT_DEFS += -DBACKLIGHT_ENABLE
@@ -92,6 +106,12 @@ ifeq (yes,$(strip $(KEYMAP_SECTION_ENABLE)))
     else
 	EXTRALDFLAGS = $(error no ldscript for keymap section)
     endif
+
+    # runtime update of keymap section through raw hid
+    ifeq (yes,$(strip $(RAW_ENABLE)))
+	SRC += $(COMMON_DIR)/avr/keymap_flash.c
+	OPT_DEFS += -DKEYMAP_FLASH_ENABLE
+    endif
 endif
 
 # Version string
@@ -0,0 +1,126 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+#include "keymap_flash.h"
+
+
+/* start of keymap region defined in ldscript */
+extern const uint8_t __keymap_start[];
+
+
+/*
+ * LUFA bootloader API
+ *
+ * DFU and CDC bootloaders of LUFA have jump table of page programming
+ * routines at the end of flash with magic signature in its last word.
+ * See LUFA/Bootloaders/DFU/BootloaderAPI.h.
+ */
+#define BOOTLOADER_API_TABLE_SIZE           32
+#define BOOTLOADER_API_TABLE_START          ((FLASHEND + 1UL) - BOOTLOADER_API_TABLE_SIZE)
+#define BOOTLOADER_API_CALL(index)          (void *)((BOOTLOADER_API_TABLE_START + (index * 2)) / 2)
+#define BOOTLOADER_MAGIC_SIGNATURE_START    (BOOTLOADER_API_TABLE_START + (BOOTLOADER_API_TABLE_SIZE - 2))
+#define BOOTLOADER_MAGIC_SIGNATURE          0xDCFB
+
+static void (* const bootloader_erase_page)(uint32_t addr) = BOOTLOADER_API_CALL(0);
+static void (* const bootloader_write_page)(uint32_t addr) = BOOTLOADER_API_CALL(1);
+static void (* const bootloader_fill_word)(uint32_t addr, uint16_t word) = BOOTLOADER_API_CALL(2);
+
+#if (FLASHEND > 0xFFFF)
+#   define read_flash_word(addr)    pgm_read_word_far(addr)
+#else
+#   define read_flash_word(addr)    pgm_read_word(addr)
+#endif
+
+
+__attribute__ ((weak))
+bool keymap_flash_helper_available(void)
+{
+    return read_flash_word(BOOTLOADER_MAGIC_SIGNATURE_START) == BOOTLOADER_MAGIC_SIGNATURE;
+}
+
+/* called with interrupts disabled */
+__attribute__ ((weak))
+void keymap_flash_helper_program(uint16_t addr, const uint8_t *data)
+{
+    bootloader_erase_page(addr);
+    for (uint16_t i = 0; i < KEYMAP_FLASH_PAGE_SIZE; i += 2) {
+        bootloader_fill_word(addr + i, data[i] | (data[i + 1] << 8));
+    }
+    bootloader_write_page(addr);
+}
+
+
+uint16_t keymap_flash_start(void)
+{
+    return (uint16_t)(uintptr_t)__keymap_start;
+}
+
+static uint16_t crc_update(uint16_t crc, uint8_t data)
+{
+    crc ^= (uint16_t)data << 8;
+    for (uint8_t i = 0; i < 8; i++) {
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+    return crc;
+}
+
+uint16_t keymap_flash_crc(const uint8_t *data, uint16_t len)
+{
+    uint16_t crc = 0xFFFF;
+    while (len--) {
+        crc = crc_update(crc, *data++);
+    }
+    return crc;
+}
+
+uint16_t keymap_flash_page_crc(uint8_t page)
+{
+    const uint8_t *p = __keymap_start + page * KEYMAP_FLASH_PAGE_SIZE;
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < KEYMAP_FLASH_PAGE_SIZE; i++) {
+        crc = crc_update(crc, pgm_read_byte(p++));
+    }
+    return crc;
+}
+
+bool keymap_flash_write_page(uint8_t page, const uint8_t *data)
+{
+    const uint8_t *p = __keymap_start + page * KEYMAP_FLASH_PAGE_SIZE;
+
+    if (page >= KEYMAP_FLASH_PAGES) return false;
+
+    // unchanged page
+    if (memcmp_P(data, p, KEYMAP_FLASH_PAGE_SIZE) == 0) return true;
+
+    if (!keymap_flash_helper_available()) return false;
+
+    // SPM can't be used while EEPROM is being written
+    eeprom_busy_wait();
+
+    // vectors in application section can't be read during erase and write
+    uint8_t sreg = SREG;
+    cli();
+    keymap_flash_helper_program((uint16_t)(uintptr_t)p, data);
+    SREG = sreg;
+
+    return memcmp_P(data, p, KEYMAP_FLASH_PAGE_SIZE) == 0;
+}
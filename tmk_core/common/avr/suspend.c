@@ -8,11 +8,36 @@
 #include "suspend_avr.h"
 #include "suspend.h"
 #include "timer.h"
+#include "debug.h"
 #ifdef PROTOCOL_LUFA
 #include "lufa.h"
 #endif
 
 
+/* Wakeup by pin change
+ * Columns on PCINT pins given with SUSPEND_WAKEUP_PCMSK0/1 wake MCU from
+ * power down when matrix_wakeup_select() selects all rows. The matrix is
+ * scanned only after pin change, with watchdog polling for a few cycles
+ * so that debounce can settle. Boards whose matrix_wakeup_select() returns
+ * false keep on watchdog polling.
+ */
+#if defined(SUSPEND_WAKEUP_PCMSK0) || defined(SUSPEND_WAKEUP_PCMSK1)
+#   define SUSPEND_WAKEUP_PCINT
+#   ifndef SUSPEND_WAKEUP_PCMSK0
+#       define SUSPEND_WAKEUP_PCMSK0    0
+#   endif
+#   ifndef SUSPEND_WAKEUP_PCMSK1
+#       define SUSPEND_WAKEUP_PCMSK1    0
+#   endif
+#   define SUSPEND_WAKEUP_PCIE  ((SUSPEND_WAKEUP_PCMSK0 ? _BV(PCIE0) : 0) | \
+                                 (SUSPEND_WAKEUP_PCMSK1 ? _BV(PCIE1) : 0))
+/* watchdog polling cycles after pin change */
+#   ifndef SUSPEND_WAKEUP_POLL
+#       define SUSPEND_WAKEUP_POLL  4
+#   endif
+#endif
+
+
 #define wdt_intr_enable(value)   \
 __asm__ __volatile__ (  \
     "in __tmp_reg__,__SREG__" "\n\t"    \
@@ -44,10 +69,72 @@ __asm__ __volatile__ (  \
  *          WDTO_8S
  */
 static uint8_t wdt_timeout = 0;
+
+/* time of wakeup event for latency report */
+static volatile uint32_t wakeup_time = 0;
+static volatile bool wakeup_event = false;
+
+#ifdef SUSPEND_WAKEUP_PCINT
+static bool pcint_armed = false;
+static volatile bool pcint_fired = false;
+static uint8_t pcint_poll = 0;
+
+static bool pcint_arm(void)
+{
+    if (pcint_armed) return true;
+    if (!matrix_wakeup_select()) return false;
+
+    // no key was found since last pin change
+    wakeup_event = false;
+    pcint_fired = false;
+#if SUSPEND_WAKEUP_PCMSK0
+    PCMSK0 = SUSPEND_WAKEUP_PCMSK0;
+#endif
+#if SUSPEND_WAKEUP_PCMSK1
+    PCMSK1 = SUSPEND_WAKEUP_PCMSK1;
+#endif
+    PCIFR = SUSPEND_WAKEUP_PCIE;
+    PCICR |= SUSPEND_WAKEUP_PCIE;
+    pcint_armed = true;
+    return true;
+}
+
+static void pcint_disarm(void)
+{
+    if (!pcint_armed) return;
+    PCICR &= ~SUSPEND_WAKEUP_PCIE;
+    matrix_wakeup_unselect();
+    pcint_armed = false;
+}
+#endif
+
 static void power_down(uint8_t wdto)
 {
 #ifdef PROTOCOL_LUFA
     if (USB_DeviceState == DEVICE_STATE_Configured) return;
+#endif
+#ifdef SUSPEND_WAKEUP_PCINT
+    if (pcint_fired) {
+        pcint_fired = false;
+        pcint_disarm();
+        pcint_poll = SUSPEND_WAKEUP_POLL;
+    }
+    if (pcint_poll) {
+        pcint_poll--;
+    } else if (pcint_arm()) {
+        // sleep without watchdog until pin change or USB resume
+        // timer doesn't count in the meantime
+        set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+        cli();
+        if (!pcint_fired) {
+            sleep_enable();
+            sei();
+            sleep_cpu();    // executed before pending interrupt after sei
+            sleep_disable();
+        }
+        sei();
+        return;
+    }
 #endif
     wdt_timeout = wdto;
 
@@ -113,11 +200,29 @@ void suspend_power_down(void)
 
 bool suspend_wakeup_condition(void)
 {
+#ifdef SUSPEND_WAKEUP_PCINT
+    // confirm pin change with scan; it may be release of key held on suspend
+    if (pcint_armed) {
+        if (!pcint_fired) return false;
+        pcint_disarm();
+    }
+#endif
     matrix_power_up();
     matrix_scan();
     matrix_power_down();
     for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
-        if (matrix_get_row(r)) return true;
+        if (matrix_get_row(r)) {
+            // watchdog polling detects key some ms after it is pressed
+            if (!wakeup_event) {
+                wakeup_time = timer_read32();
+                wakeup_event = true;
+            }
+#ifdef SUSPEND_WAKEUP_PCINT
+            // keep polling until host resumes
+            pcint_poll = SUSPEND_WAKEUP_POLL;
+#endif
+            return true;
+        }
     }
     return false;
 }
@@ -125,6 +230,10 @@ bool suspend_wakeup_condition(void)
 // run immediately after wakeup
 void suspend_wakeup_init(void)
 {
+#ifdef SUSPEND_WAKEUP_PCINT
+    pcint_disarm();
+    pcint_poll = 0;
+#endif
     // clear keyboard state
     matrix_clear();
     clear_keyboard();
@@ -133,6 +242,36 @@ void suspend_wakeup_init(void)
 #endif
 }
 
+void suspend_report_sent(void)
+{
+    if (!wakeup_event) return;
+    wakeup_event = false;
+    dprintf("wakeup: %lums\n", timer_elapsed32(wakeup_time));
+}
+
+#ifdef SUSPEND_WAKEUP_PCINT
+static void pcint_wakeup(void)
+{
+    // once per suspend
+    PCICR &= ~SUSPEND_WAKEUP_PCIE;
+    pcint_fired = true;
+    wakeup_time = timer_count;
+    wakeup_event = true;
+}
+#if SUSPEND_WAKEUP_PCMSK0
+ISR(PCINT0_vect)
+{
+    pcint_wakeup();
+}
+#endif
+#if SUSPEND_WAKEUP_PCMSK1
+ISR(PCINT1_vect)
+{
+    pcint_wakeup();
+}
+#endif
+#endif
+
 #ifndef NO_SUSPEND_POWER_DOWN
 /* watchdog timeout */
 ISR(WDT_vect)
@@ -0,0 +1,157 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <util/delay.h>
+#include "print.h"
+#include "debug.h"
+#include "util.h"
+#include "timer.h"
+#include "matrix.h"
+#include "topre.h"
+
+
+#define TOPRE_TIMING_MAGIC      0x7C
+// KEY_STATE is read in 20us window after KEY_ENABLE
+#define TOPRE_SETTLE_MAX        15
+#define TOPRE_CALIB_SAMPLES     32
+#define TOPRE_CALIB_TIMEOUT     200
+
+uint8_t topre_settle_us = TOPRE_SETTLE_DEFAULT;
+uint8_t topre_recovery_us = TOPRE_RECOVERY_DEFAULT;
+
+// scan time statistics
+static uint16_t scan_count = 0;
+static uint16_t scan_rate = 0;
+static uint16_t scan_time_max = 0;
+static uint16_t scan_stat_time = 0;
+
+
+void topre_timing_init(void)
+{
+    if (eeprom_read_byte(TOPRE_TIMING_EEPROM) != TOPRE_TIMING_MAGIC) return;
+
+    uint8_t settle = eeprom_read_byte(TOPRE_TIMING_EEPROM + 1);
+    uint8_t recovery = eeprom_read_byte(TOPRE_TIMING_EEPROM + 2);
+    if (settle > TOPRE_SETTLE_MAX || recovery > TOPRE_RECOVERY_DEFAULT) return;
+
+    topre_settle_us = settle;
+    topre_recovery_us = recovery;
+}
+
+/* Returns elapsed time in us of loop count or TIMER_RAW whichever is larger */
+static inline uint8_t elapsed_us(uint8_t count, uint8_t raw)
+{
+    uint8_t diff = TIMER_DIFF_RAW(TIMER_RAW, raw);
+    uint16_t t = diff * (1000000/TIMER_RAW_FREQ);
+    return (t > count) ? (t > 255 ? 255 : t) : count;
+}
+
+static bool calibrate(uint8_t row, uint8_t col)
+{
+    uint8_t settle_max = 0;
+    uint8_t recovery_max = 0;
+    uint8_t samples = 0;
+
+    for (uint8_t i = 0; i < TOPRE_CALIB_SAMPLES; i++) {
+        uint8_t sreg = SREG;
+        cli();
+
+        topre_key_select(row, col);
+
+        uint8_t raw = TIMER_RAW;
+        uint8_t count = 0;
+        topre_key_enable();
+        while (topre_key_state() && count < TOPRE_CALIB_TIMEOUT) { _delay_us(1); count++; }
+        uint8_t settle = elapsed_us(count, raw);
+        bool on = (count < TOPRE_CALIB_TIMEOUT);
+
+        topre_key_unable();
+
+        raw = TIMER_RAW;
+        count = 0;
+        while (!topre_key_state() && count < TOPRE_CALIB_TIMEOUT) { _delay_us(1); count++; }
+        uint8_t recovery = elapsed_us(count, raw);
+        bool idle = (count < TOPRE_CALIB_TIMEOUT);
+
+        SREG = sreg;
+
+        // key released or stuck
+        if (!on || !idle) continue;
+        if (settle > settle_max) settle_max = settle;
+        if (recovery > recovery_max) recovery_max = recovery;
+        samples++;
+
+        _delay_us(TOPRE_RECOVERY_DEFAULT);
+    }
+
+    xprintf("calibrate %d:%d samples:%d settle:%dus recovery:%dus\n",
+            row, col, samples, settle_max, recovery_max);
+    if (samples < TOPRE_CALIB_SAMPLES / 2) {
+        return false;
+    }
+
+    // margin of 50% plus 1us
+    uint16_t settle = settle_max + settle_max/2 + 1;
+    uint16_t recovery = recovery_max + recovery_max/2 + 1;
+    topre_settle_us = (settle > TOPRE_SETTLE_MAX) ? TOPRE_SETTLE_MAX : settle;
+    topre_recovery_us = (recovery > TOPRE_RECOVERY_DEFAULT) ? TOPRE_RECOVERY_DEFAULT : recovery;
+
+    eeprom_update_byte(TOPRE_TIMING_EEPROM, TOPRE_TIMING_MAGIC);
+    eeprom_update_byte(TOPRE_TIMING_EEPROM + 1, topre_settle_us);
+    eeprom_update_byte(TOPRE_TIMING_EEPROM + 2, topre_recovery_us);
+    return true;
+}
+
+bool topre_calibrate(void)
+{
+    // keys of Magic+T combination are held while command runs
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        matrix_row_t r = matrix_get_row(row);
+        if (!r) continue;
+
+        bool ok = calibrate(row, biton32(r));
+        if (ok) {
+            xprintf("calibrate: settle:%dus recovery:%dus\n", topre_settle_us, topre_recovery_us);
+        } else {
+            print("calibrate: failed\n");
+        }
+        return ok;
+    }
+    print("calibrate: no key\n");
+    return false;
+}
+
+void topre_scan_stat(uint16_t start)
+{
+    uint16_t t = timer_elapsed(start);
+    if (t > scan_time_max) scan_time_max = t;
+    scan_count++;
+
+    if (timer_elapsed(scan_stat_time) >= 1000) {
+        scan_rate = scan_count;
+        scan_count = 0;
+        scan_stat_time = timer_read();
+        if (debug_matrix) {
+            xprintf("scan: %u/s max:%ums settle:%dus recovery:%dus\n",
+                    scan_rate, scan_time_max, topre_settle_us, topre_recovery_us);
+        }
+    }
+}
@@ -0,0 +1,167 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include "timer.h"
+#include "binlog.h"
+
+#if defined(__AVR__)
+#   include "avr/xprintf.h"
+#   define binlog_putc(c)   xputc(c)
+#else
+#   include "sendchar.h"
+#   define binlog_putc(c)   sendchar(c)
+#endif
+
+/* room for a varint of 32bit value */
+#define VARINT_MAX  5
+/* SOF, COBS code byte, record and delimiter */
+#define FRAME_SIZE  (BINLOG_RECORD_SIZE + 3)
+
+
+__attribute__((weak))
+bool binlog_write(const uint8_t *frame, uint8_t len)
+{
+    for (uint8_t i = 0; i < len; i++) {
+        binlog_putc(frame[i]);
+    }
+    return true;
+}
+
+
+static uint8_t *put_varint(uint8_t *p, uint32_t v)
+{
+    while (v > 0x7F) {
+        *p++ = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+/* Copies string with terminating zero; truncated at end of buffer */
+static uint8_t *put_str(uint8_t *p, uint8_t *end, const char *s, bool flash)
+{
+    char c;
+    while (p < end - 1 && (c = (flash ? pgm_read_byte(s) : *s))) {
+        *p++ = c;
+        s++;
+    }
+    *p++ = 0;
+    return p;
+}
+
+static uint8_t crc8(const uint8_t *p, uint8_t len)
+{
+    uint8_t crc = 0;
+    while (len--) {
+        crc ^= *p++;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+/* COBS encoding: no zero appears in frame except for the delimiter */
+static void put_frame(const uint8_t *buf, uint8_t len)
+{
+    uint8_t frame[FRAME_SIZE];
+    uint8_t n = 0;
+    uint8_t i = 0;
+
+    frame[n++] = BINLOG_SOF;
+    while (i <= len) {
+        uint8_t j = i;
+        while (j < len && buf[j]) j++;
+        frame[n++] = j - i + 1;
+        for (; i < j; i++) frame[n++] = buf[i];
+        i++;
+    }
+    frame[n++] = 0;
+    binlog_write(frame, n);
+}
+
+void __binlog(const char *fmt, ...)
+{
+    uint8_t buf[BINLOG_RECORD_SIZE];
+    // last byte is for CRC
+    uint8_t *end = buf + sizeof(buf) - 1;
+    uint8_t *p = buf;
+    const char *f = fmt;
+    va_list ap;
+    char c;
+
+    p = put_varint(p, (uintptr_t)fmt);
+    uint16_t t = timer_read();
+    *p++ = t;
+    *p++ = t >> 8;
+
+    va_start(ap, fmt);
+    while ((c = pgm_read_byte(f++))) {
+        if (c != '%') continue;
+
+        // flags and width
+        c = pgm_read_byte(f++);
+        while (c == '0' || c == '-') c = pgm_read_byte(f++);
+        while (c >= '0' && c <= '9') c = pgm_read_byte(f++);
+
+        bool l = false;
+        if (c == 'l' || c == 'L') {
+            l = true;
+            c = pgm_read_byte(f++);
+        }
+        if (c == '%') continue;
+
+        // no more room; decoder shows rest of arguments as missing
+        if (end - p < VARINT_MAX) break;
+
+        switch (c) {
+            case 'd': {
+                int32_t v = l ? va_arg(ap, long) : va_arg(ap, int);
+                p = put_varint(p, ((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'b':
+            case 'o':
+                p = put_varint(p, l ? va_arg(ap, unsigned long) : va_arg(ap, unsigned int));
+                break;
+            case 'c':
+                *p++ = va_arg(ap, int);
+                break;
+            case 's':
+                p = put_str(p, end, va_arg(ap, const char *), false);
+                break;
+            case 'S':
+                p = put_str(p, end, va_arg(ap, const char *), true);
+                break;
+            default:
+                // unknown conversion or end of format; size of argument is not known
+                goto END;
+        }
+    }
+END:
+    va_end(ap);
+
+    *p = crc8(buf, p - buf);
+    p++;
+    put_frame(buf, p - buf);
+}
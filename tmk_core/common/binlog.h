@@ -0,0 +1,79 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "progmem.h"
+
+
+/*
+ * Binary log
+ *
+ * Sends address of format string, timestamp and raw arguments instead of
+ * formatted text. Format strings stay in flash of firmware and its ELF file
+ * works as dictionary for the decoder, tmk_core/tool/binlog/binlog_decode.py.
+ *
+ * Record on console:
+ *   0x01, COBS encoded record, 0x00
+ * Record before encoding:
+ *   format address(varint), timestamp ms(uint16 LE), arguments, CRC-8
+ * CRC-8(polynomial 0x07) covers all bytes before it so that decoder can
+ * reject record damaged by dropped chars. Whole frame is queued to console
+ * at once with binlog_write(), or dropped when it doesn't fit.
+ * Arguments:
+ *   %d             zigzag varint
+ *   %u %x %X %b %o varint
+ *   %c             byte
+ *   %s %S          chars and terminating zero
+ *
+ * Text of print() and others can be mixed in the same console.
+ */
+#define BINLOG_SOF      0x01
+
+#ifndef BINLOG_RECORD_SIZE
+#define BINLOG_RECORD_SIZE  48
+#endif
+#if (BINLOG_RECORD_SIZE > 253)
+#   error "BINLOG_RECORD_SIZE must not exceed 253"
+#endif
+
+#if defined(__AVR__)
+#   define BINLOG_STR(s)    PSTR(s)
+#else
+#   define BINLOG_STR(s)    (s)
+#endif
+
+#define binlog(fmt, ...)    __binlog(BINLOG_STR(fmt), ##__VA_ARGS__)
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void __binlog(const char *fmt, ...);
+/* Queues encoded frame to console, all or nothing. Default one puts chars
+ * one by one; protocol with console buffer overrides it. */
+bool binlog_write(const uint8_t *frame, uint8_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,6 +2,7 @@
 #include "hal.h"
 
 #include "eeconfig.h"
+#include "debug.h"
 
 /*************************************/
 /*          Hardware backend         */
@@ -305,7 +306,8 @@ void do_flash_cmd(volatile uint8_t *fstat)
    e:	4770      	bx	lr
 */
 
-#elif defined(KL2x) /* chip selection */
+#elif defined(KL2x) || defined(STM32F0XX) || defined(STM32F1XX) /* chip selection */
+#if defined(KL2x)
 /* Teensy LC (emulated) */
 
 #define SYMVAL(sym) (uint32_t)(((uint8_t *)&(sym)) - ((uint8_t *)0))
@@ -448,6 +450,269 @@ void do_flash_cmd(volatile uint8_t *fstat)
 */
 
 
+#else /* KL2x */
+/* STM32F0/F1 (emulated, journaled)
+ *
+ * Flash region between __eeprom_workarea_start__ and __eeprom_workarea_end__
+ * of linker script(or EEPROM_FLASH_START/END in config.h) is split in two
+ * banks of whole pages. Active bank has a header and append-only log of
+ * 32-bit records, the other bank is kept erased for compaction.
+ *
+ *   header: [generation] [EEPROM_FLASH_MAGIC]
+ *   record: [data << 8 | offset] [~(data << 8 | offset)]
+ *
+ * Record is valid only when the two halfwords match, so write cut by power
+ * loss leaves previous value. Compaction copies RAM cache into erased bank
+ * and writes its header last; when both banks are valid newer generation
+ * wins. Erase of old bank and early compaction are done in eeprom_task() so
+ * that eeprom_write_byte() seldom waits for erase(20-40ms per page).
+ *
+ * Note that flash programming on STM32F1 requires HSI to be on.
+ */
+
+#define SYMVAL(sym) (uint32_t)(((uint8_t *)&(sym)) - ((uint8_t *)0))
+
+#ifndef EEPROM_FLASH_START
+extern uint32_t __eeprom_workarea_start__;
+extern uint32_t __eeprom_workarea_end__;
+#define EEPROM_FLASH_START SYMVAL(__eeprom_workarea_start__)
+#define EEPROM_FLASH_END   SYMVAL(__eeprom_workarea_end__)
+#endif
+
+#ifndef EEPROM_FLASH_PAGE_SIZE
+#if defined(STM32F072xB) || defined(STM32F078xx) || defined(STM32F091xC) || \
+    defined(STM32F103xE) || defined(STM32F103xG)
+#define EEPROM_FLASH_PAGE_SIZE 2048
+#else
+#define EEPROM_FLASH_PAGE_SIZE 1024
+#endif
+#endif
+
+#ifndef EEPROM_SIZE
+#define EEPROM_SIZE 128
+#endif
+#if EEPROM_SIZE > 256
+#error EEPROM_SIZE is limited to 256 by record format
+#endif
+
+// Free records left in active bank under which eeprom_task() compacts it.
+#ifndef EEPROM_FLASH_COMPACT_THRESHOLD
+#define EEPROM_FLASH_COMPACT_THRESHOLD (EEPROM_SIZE / 4)
+#endif
+
+#define EEPROM_FLASH_MAGIC 0xEE5A
+#define EEPROM_FLASH_KEY1  0x45670123
+#define EEPROM_FLASH_KEY2  0xCDEF89AB
+
+#define BANK_SIZE  ((EEPROM_FLASH_END - EEPROM_FLASH_START) / 2)
+#define BANK_SLOTS (BANK_SIZE / 4)
+#define BANK_PAGES (BANK_SIZE / EEPROM_FLASH_PAGE_SIZE)
+
+#ifndef FLASH_SR_WRPRTERR
+#define FLASH_SR_WRPRTERR FLASH_SR_WRPERR
+#endif
+
+static uint8_t cache[EEPROM_SIZE];
+static const volatile uint16_t *bank = 0;
+static const volatile uint16_t *spare = 0;
+static uint32_t next_slot = 0;
+static uint32_t spare_pages = 0;
+static uint16_t generation = 0;
+
+static bool flash_wait(void)
+{
+	uint32_t sr;
+
+	while (FLASH->SR & FLASH_SR_BSY) ;
+	sr = FLASH->SR;
+	FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR;
+	return !(sr & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR));
+}
+
+static void flash_unlock(void)
+{
+	if (FLASH->CR & FLASH_CR_LOCK) {
+		FLASH->KEYR = EEPROM_FLASH_KEY1;
+		FLASH->KEYR = EEPROM_FLASH_KEY2;
+	}
+}
+
+static bool flash_program(const volatile uint16_t *addr, uint16_t data)
+{
+	bool ok;
+
+	flash_unlock();
+	FLASH->CR |= FLASH_CR_PG;
+	*(volatile uint16_t *)addr = data;
+	ok = flash_wait();
+	FLASH->CR &= ~FLASH_CR_PG;
+	FLASH->CR |= FLASH_CR_LOCK;
+	return ok && *addr == data;
+}
+
+static void flash_erase(const volatile uint16_t *page)
+{
+	flash_unlock();
+	FLASH->CR |= FLASH_CR_PER;
+	FLASH->AR = (uint32_t)(uintptr_t)page;
+	FLASH->CR |= FLASH_CR_STRT;
+	flash_wait();
+	FLASH->CR &= ~FLASH_CR_PER;
+	FLASH->CR |= FLASH_CR_LOCK;
+}
+
+static bool is_blank(const volatile uint16_t *p, uint32_t len)
+{
+	while (len--) {
+		if (*p++ != 0xFFFF) return false;
+	}
+	return true;
+}
+
+static bool bank_valid(const volatile uint16_t *b)
+{
+	return b[1] == EEPROM_FLASH_MAGIC;
+}
+
+// Erases one page of spare bank which is not blank yet.
+// Returns true when there is nothing left to erase.
+static bool spare_erase_step(void)
+{
+	while (spare_pages) {
+		const volatile uint16_t *page = spare + --spare_pages * (EEPROM_FLASH_PAGE_SIZE / 2);
+		if (!is_blank(page, EEPROM_FLASH_PAGE_SIZE / 2)) {
+			flash_erase(page);
+			return false;
+		}
+	}
+	return true;
+}
+
+static uint32_t live_records(void)
+{
+	uint32_t i, n = 0;
+
+	for (i = 0; i < EEPROM_SIZE; i++) {
+		if (cache[i] != 0xFF) n++;
+	}
+	return n;
+}
+
+// Writes content of cache into spare bank and switches to it.
+static bool compact(void)
+{
+	const volatile uint16_t *p = spare;
+	uint32_t i, slot = 1;
+	uint16_t rec;
+
+	while (!spare_erase_step()) ;
+	for (i = 0; i < EEPROM_SIZE; i++) {
+		if (cache[i] == 0xFF) continue;
+		rec = (cache[i] << 8) | i;
+		if (!flash_program(&p[slot * 2], rec) ||
+		    !flash_program(&p[slot * 2 + 1], ~rec)) goto fail;
+		slot++;
+	}
+	// header is the commit point
+	if (!flash_program(&p[0], generation + 1) ||
+	    !flash_program(&p[1], EEPROM_FLASH_MAGIC)) goto fail;
+
+	spare = bank;
+	bank = p;
+	next_slot = slot;
+	generation++;
+	spare_pages = BANK_PAGES;
+	dprintf("eeprom: compact gen:%u records:%u\n", generation, slot - 1);
+	return true;
+fail:
+	spare_pages = BANK_PAGES;
+	dprintf("eeprom: compact failed\n");
+	return false;
+}
+
+void eeprom_initialize(void)
+{
+	const volatile uint16_t *b0 = (const volatile uint16_t *)EEPROM_FLASH_START;
+	const volatile uint16_t *b1 = b0 + BANK_SIZE / 2;
+	uint32_t i, slot;
+	uint16_t rec, chk;
+
+	for (i = 0; i < EEPROM_SIZE; i++) {
+		cache[i] = 0xFF;
+	}
+	if (bank_valid(b1) && (!bank_valid(b0) || (int16_t)(b1[0] - b0[0]) > 0)) {
+		bank = b1;
+		spare = b0;
+	} else {
+		bank = b0;
+		spare = b1;
+	}
+	// stale bank or leftover of interrupted compaction
+	spare_pages = BANK_PAGES;
+
+	if (!bank_valid(bank)) {
+		// blank or broken: format by compacting empty cache
+		generation = 0;
+		next_slot = BANK_SLOTS;
+		compact();
+		return;
+	}
+	generation = bank[0];
+	next_slot = 1;
+	for (slot = 1; slot < BANK_SLOTS; slot++) {
+		rec = bank[slot * 2];
+		chk = bank[slot * 2 + 1];
+		if (rec == 0xFFFF && chk == 0xFFFF) continue;
+		next_slot = slot + 1;
+		if (chk == (uint16_t)~rec && (rec & 255) < EEPROM_SIZE) {
+			cache[rec & 255] = rec >> 8;
+		}
+	}
+}
+
+uint8_t eeprom_read_byte(const uint8_t *addr)
+{
+	uint32_t offset = (uint32_t)(uintptr_t)addr;
+
+	if (!bank) eeprom_initialize();
+	if (offset >= EEPROM_SIZE) return 0xFF;
+	return cache[offset];
+}
+
+void eeprom_write_byte(uint8_t *addr, uint8_t data)
+{
+	uint32_t offset = (uint32_t)(uintptr_t)addr;
+	const volatile uint16_t *p;
+	uint16_t rec;
+
+	if (offset >= EEPROM_SIZE) return;
+	if (!bank) eeprom_initialize();
+	if (cache[offset] == data) return;
+
+	cache[offset] = data;
+	if (next_slot < BANK_SLOTS) {
+		// slot is consumed even if programming fails
+		p = &bank[next_slot++ * 2];
+		rec = (data << 8) | offset;
+		if (flash_program(p, rec) && flash_program(p + 1, ~rec)) return;
+	}
+	// bank is full or broken: new bank gets value from cache
+	compact();
+}
+
+// Called from main loop: erases a page of stale bank at a time and compacts
+// active bank before it runs out of room.
+void eeprom_task(void)
+{
+	if (!bank) return;
+	if (!spare_erase_step()) return;
+	if (BANK_SLOTS - next_slot < EEPROM_FLASH_COMPACT_THRESHOLD &&
+	    next_slot - (live_records() + 1) >= EEPROM_FLASH_COMPACT_THRESHOLD) {
+		compact();
+	}
+}
+#endif /* KL2x */
+
 uint16_t eeprom_read_word(const uint16_t *addr)
 {
 	const uint8_t *p = (const uint8_t *)addr;
@@ -504,6 +769,9 @@ void eeprom_write_block(const void *buf, void *addr, uint32_t len)
 #error EEPROM support not implemented for your chip
 #endif /* chip selection */
 
+/* for raw_hid.c: EEPROM_SIZE depends on chip and config.h */
+const uint16_t eeprom_size = EEPROM_SIZE;
+
 
 /*****************/
 /* TMK functions */
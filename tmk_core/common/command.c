@@ -38,6 +38,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "mousekey.h"
 #endif
 
+#ifdef TOPRE_ENABLE
+#include "topre.h"
+#endif
+
 #ifdef PROTOCOL_PJRC
 #   include "usb_keyboard.h"
 #   ifdef EXTRAKEY_ENABLE
@@ -49,6 +53,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #   include "usbdrv.h"
 #endif
 
+#if defined(PROTOCOL_CHIBIOS) && defined(REPORT_THREAD)
+#   include "usb_main.h"
+#endif
+
 
 static bool command_common(uint8_t code);
 static void command_common_help(void);
@@ -140,6 +148,10 @@ static void command_common_help(void)
 #ifdef SLEEP_LED_ENABLE
           "z:	sleep LED test\n"
 #endif
+
+#ifdef TOPRE_ENABLE
+          "t:	Topre scan calibration\n"
+#endif
     );
 }
 
@@ -200,6 +212,12 @@ static bool command_common(uint8_t code)
             sleep_led_test = !sleep_led_test;
             break;
 #endif
+#ifdef TOPRE_ENABLE
+        case KC_T:
+            // measure scan timing with T held down
+            topre_calibrate();
+            break;
+#endif
 #ifdef BOOTMAGIC_ENABLE
         case KC_E:
             print("eeconfig:\n");
@@ -339,6 +357,9 @@ static bool command_common(uint8_t code)
             print_val_hex8(keyboard_nkro);
 #endif
             print_val_hex32(timer_read32());
+#ifdef MOUSE_ENABLE
+            print_val_hex32(host_mouse_merged);
+#endif
 
 #ifdef PROTOCOL_PJRC
             print_val_hex8(UDCON);
@@ -352,6 +373,12 @@ static bool command_common(uint8_t code)
 #   if USB_COUNT_SOF
             print_val_hex8(usbSofCount);
 #   endif
+#endif
+#ifdef REPORT_SOF_SYNC
+            report_sof_stats_print();
+#endif
+#if defined(PROTOCOL_CHIBIOS) && defined(REPORT_THREAD)
+            thread_stats_print();
 #endif
             break;
 #ifdef NKRO_ENABLE
@@ -440,6 +467,10 @@ static void mousekey_param_print(void)
     print("4: time_to_max: "); pdec(mk_time_to_max); print("\n");
     print("5: wheel_max_speed: "); pdec(mk_wheel_max_speed); print("\n");
     print("6: wheel_time_to_max: "); pdec(mk_wheel_time_to_max); print("\n");
+#ifdef MOUSEKEY_SMOOTH
+    print("7: curve: "); xprintf("%d", mk_curve); print("\n");
+    print("8: inertia(*10ms): "); pdec(mk_inertia); print("\n");
+#endif
 }
 
 //#define PRINT_SET_VAL(v)  print(#v " = "); print_dec(v); print("\n");
@@ -489,6 +520,22 @@ static void mousekey_param_inc(uint8_t param, uint8_t inc)
                 mk_wheel_time_to_max = UINT8_MAX;
             PRINT_SET_VAL(mk_wheel_time_to_max);
             break;
+#ifdef MOUSEKEY_SMOOTH
+        case 7:
+            if (mk_curve + inc < INT8_MAX)
+                mk_curve += inc;
+            else
+                mk_curve = INT8_MAX;
+            PRINT_SET_VAL(mk_curve);
+            break;
+        case 8:
+            if (mk_inertia + inc < UINT8_MAX)
+                mk_inertia += inc;
+            else
+                mk_inertia = UINT8_MAX;
+            PRINT_SET_VAL(mk_inertia);
+            break;
+#endif
     }
 }
 
@@ -537,6 +584,22 @@ static void mousekey_param_dec(uint8_t param, uint8_t dec)
                 mk_wheel_time_to_max = 0;
             PRINT_SET_VAL(mk_wheel_time_to_max);
             break;
+#ifdef MOUSEKEY_SMOOTH
+        case 7:
+            if (mk_curve - dec > -INT8_MAX)
+                mk_curve -= dec;
+            else
+                mk_curve = -INT8_MAX;
+            PRINT_SET_VAL(mk_curve);
+            break;
+        case 8:
+            if (mk_inertia > dec)
+                mk_inertia -= dec;
+            else
+                mk_inertia = 0;
+            PRINT_SET_VAL(mk_inertia);
+            break;
+#endif
     }
 }
 
@@ -550,6 +613,10 @@ static void mousekey_console_help(void)
           "4:	time_to_max\n"
           "5:	wheel_max_speed\n"
           "6:	wheel_time_to_max\n"
+#ifdef MOUSEKEY_SMOOTH
+          "7:	curve\n"
+          "8:	inertia(*10ms)\n"
+#endif
           "\n"
           "p:	print values\n"
           "d:	set defaults\n"
@@ -589,6 +656,10 @@ static bool mousekey_console(uint8_t code)
         case KC_4:
         case KC_5:
         case KC_6:
+#ifdef MOUSEKEY_SMOOTH
+        case KC_7:
+        case KC_8:
+#endif
             mousekey_param = numkey2num(code);
             break;
         case KC_UP:
@@ -610,6 +681,10 @@ static bool mousekey_console(uint8_t code)
             mk_time_to_max = MOUSEKEY_TIME_TO_MAX;
             mk_wheel_max_speed = MOUSEKEY_WHEEL_MAX_SPEED;
             mk_wheel_time_to_max = MOUSEKEY_WHEEL_TIME_TO_MAX;
+#ifdef MOUSEKEY_SMOOTH
+            mk_curve = MOUSEKEY_CURVE;
+            mk_inertia = MOUSEKEY_INERTIA/10;
+#endif
             print("set default\n");
             break;
         default:
@@ -60,8 +60,14 @@ extern debug_config_t debug_config;
 
 #define dprint(s)                   do { if (debug_enable) print(s); } while (0)
 #define dprintln(s)                 do { if (debug_enable) println(s); } while (0)
+#ifdef BINLOG_ENABLE
+#include "binlog.h"
+/* format on host: see binlog.h */
+#define dprintf(fmt, ...)           do { if (debug_enable) binlog(fmt, ##__VA_ARGS__); } while (0)
+#else
 #define dprintf(fmt, ...)           do { if (debug_enable) xprintf(fmt, ##__VA_ARGS__); } while (0)
-#define dmsg(s)                     dprintf("%s at %s: %S\n", __FILE__, __LINE__, PSTR(s))
+#endif
+#define dmsg(s)                     dprintf("%s at %d: %S\n", __FILE__, __LINE__, PSTR(s))
 
 /* Deprecated. DO NOT USE these anymore, use dprintf instead. */
 #define debug(s)                    do { if (debug_enable) print(s); } while (0)
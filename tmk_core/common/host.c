@@ -16,6 +16,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <stdint.h>
+#include <stddef.h>
 //#include <avr/interrupt.h>
 #include "keycode.h"
 #include "host.h"
@@ -31,6 +32,35 @@ static host_driver_t *driver;
 static uint16_t last_system_report = 0;
 static uint16_t last_consumer_report = 0;
 
+#ifdef MOUSE_ENABLE
+/*
+ * Mouse report aggregation
+ *
+ * While mouse_ready() of driver returns false reports are held here and
+ * movement of new report is summed into the newest pending report with the
+ * same buttons; reports with button change are never merged. Pending reports
+ * are sent by host_mouse_task() once the endpoint gets free. Drivers without
+ * mouse_ready() get every report at once.
+ *
+ * Nothing is sent to busy driver when the queue is full and no button change
+ * is merged away. Instead a movement-only report is merged back into the
+ * report before it, which has the same buttons, and movement out of range is
+ * dropped. When every queued report changes buttons a report with another
+ * button change is not taken: host_mouse_send() returns false and caller
+ * sends it again later.
+ */
+#ifndef HOST_MOUSE_QUEUE_SIZE
+#define HOST_MOUSE_QUEUE_SIZE   4
+#endif
+
+static report_mouse_t mouse_queue[HOST_MOUSE_QUEUE_SIZE];
+static uint8_t mouse_head = 0;
+static uint8_t mouse_count = 0;
+uint32_t host_mouse_merged = 0;
+
+#define MOUSE_QUEUE(i)  mouse_queue[(mouse_head + (i)) % HOST_MOUSE_QUEUE_SIZE]
+#endif
+
 
 void host_set_driver(host_driver_t *d)
 {
@@ -62,10 +92,93 @@ void host_keyboard_send(report_keyboard_t *report)
     }
 }
 
-void host_mouse_send(report_mouse_t *report)
+#ifdef MOUSE_ENABLE
+#define IN_RANGE(v, max)    (-(max) <= (v) && (v) <= (max))
+#define CLAMP(v, max)       ((v) < -(max) ? -(max) : (v) > (max) ? (max) : (v))
+
+/* Adds movement of src to dst; out of range sum fails unless saturated */
+static bool mouse_add(report_mouse_t *dst, const report_mouse_t *src, bool saturate)
 {
-    if (!driver) return;
+    // report is packed: members are not accessed via pointer
+    int32_t x = (int32_t)dst->x + src->x;
+    int32_t y = (int32_t)dst->y + src->y;
+    int16_t v = dst->v + src->v;
+    int16_t h = dst->h + src->h;
+    if (!saturate &&
+        (!IN_RANGE(x, MOUSE_XY_MAX) || !IN_RANGE(y, MOUSE_XY_MAX) ||
+         !IN_RANGE(v, MOUSE_WHEEL_MAX) || !IN_RANGE(h, MOUSE_WHEEL_MAX))) return false;
+    dst->x = CLAMP(x, MOUSE_XY_MAX);
+    dst->y = CLAMP(y, MOUSE_XY_MAX);
+    dst->v = CLAMP(v, MOUSE_WHEEL_MAX);
+    dst->h = CLAMP(h, MOUSE_WHEEL_MAX);
+    return true;
+}
+
+/* Merges movement into pending report with same buttons */
+static bool mouse_merge(report_mouse_t *last, const report_mouse_t *report)
+{
+    if (last->buttons != report->buttons) return false;
+    return mouse_add(last, report, false);
+}
+
+/* Frees a slot of full queue by merging a movement-only report back into
+ * the one before it; head can't be merged as report before it is sent */
+static bool mouse_make_room(void)
+{
+    for (uint8_t i = 1; i < mouse_count; i++) {
+        if (MOUSE_QUEUE(i).buttons == MOUSE_QUEUE(i - 1).buttons) {
+            mouse_add(&MOUSE_QUEUE(i - 1), &MOUSE_QUEUE(i), true);
+            for (; i + 1 < mouse_count; i++) {
+                MOUSE_QUEUE(i) = MOUSE_QUEUE(i + 1);
+            }
+            mouse_count--;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void mouse_pop(void)
+{
+    (*driver->send_mouse)(&mouse_queue[mouse_head]);
+    mouse_head = (mouse_head + 1) % HOST_MOUSE_QUEUE_SIZE;
+    mouse_count--;
+}
+#endif
+
+/* false when report is not taken; caller should send it again later */
+bool host_mouse_send(report_mouse_t *report)
+{
+    if (!driver) return true;
+#ifdef MOUSE_ENABLE
+    report_mouse_t *last = mouse_count ? &MOUSE_QUEUE(mouse_count - 1) : NULL;
+    if (last && mouse_merge(last, report)) {
+        host_mouse_merged++;
+    } else if (mouse_count == HOST_MOUSE_QUEUE_SIZE && !mouse_make_room()) {
+        // keep button change for later; same buttons lose movement only
+        if (last->buttons != report->buttons) return false;
+        mouse_add(last, report, true);
+        host_mouse_merged++;
+    } else {
+        if (mouse_count == HOST_MOUSE_QUEUE_SIZE) host_mouse_merged++;
+        MOUSE_QUEUE(mouse_count) = *report;
+        mouse_count++;
+    }
+    host_mouse_task();
+#else
     (*driver->send_mouse)(report);
+#endif
+    return true;
+}
+
+void host_mouse_task(void)
+{
+#ifdef MOUSE_ENABLE
+    if (!driver) return;
+    while (mouse_count && (!driver->mouse_ready || (*driver->mouse_ready)())) {
+        mouse_pop();
+    }
+#endif
 }
 
 void host_system_send(uint16_t report)
@@ -103,3 +216,31 @@ uint16_t host_last_consumer_report(void)
 {
     return last_consumer_report;
 }
+
+#ifdef REPORT_SOF_SYNC
+/* full speed frame */
+#define SOF_FRAME_US    1000
+
+report_sof_stats_t report_sof_stats = { .min = 0xFFFF };
+
+/* may be called from SOF interrupt */
+void report_sof_stats_add(uint16_t latency_us)
+{
+    report_sof_stats.count++;
+    report_sof_stats.sum += latency_us;
+    if (latency_us < report_sof_stats.min) report_sof_stats.min = latency_us;
+    if (latency_us > report_sof_stats.max) report_sof_stats.max = latency_us;
+    if (latency_us > SOF_FRAME_US) report_sof_stats.late++;
+}
+
+void report_sof_stats_print(void)
+{
+    report_sof_stats_t s = report_sof_stats;
+    if (!s.count) {
+        xprintf("sof: no report\n");
+        return;
+    }
+    xprintf("sof: reports:%lu latency(us) min:%u avg:%lu max:%u jitter:%u late:%u\n",
+            s.count, s.min, s.sum / s.count, s.max, s.max - s.min, s.late);
+}
+#endif
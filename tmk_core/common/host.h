@@ -35,6 +35,16 @@ extern bool keyboard_nkro;
 extern uint8_t keyboard_idle;
 extern uint8_t keyboard_protocol;
 
+#ifdef MOUSE_EXT_REPORT
+/* 0: boot protocol with 8-bit report, 1: report protocol */
+extern uint8_t mouse_protocol;
+#endif
+
+#ifdef MOUSE_ENABLE
+/* number of mouse reports merged into pending one */
+extern uint32_t host_mouse_merged;
+#endif
+
 
 /* host driver */
 void host_set_driver(host_driver_t *driver);
@@ -43,13 +53,35 @@ host_driver_t *host_get_driver(void);
 /* host driver interface */
 uint8_t host_keyboard_leds(void);
 void host_keyboard_send(report_keyboard_t *report);
-void host_mouse_send(report_mouse_t *report);
+bool host_mouse_send(report_mouse_t *report);
 void host_system_send(uint16_t data);
 void host_consumer_send(uint16_t data);
 
+/* sends mouse reports held while endpoint is busy */
+void host_mouse_task(void);
+
 uint16_t host_last_system_report(void);
 uint16_t host_last_consumer_report(void);
 
+#ifdef REPORT_SOF_SYNC
+/* Latency of reports committed to endpoint in SOF handler(REPORT_SOF_SYNC)
+ * Time from send_*() of host driver to commit in microseconds. Jitter is
+ * max - min; late is number of reports which missed the first SOF. */
+typedef struct {
+    uint32_t count;
+    uint32_t sum;
+    uint16_t min;
+    uint16_t max;
+    uint16_t late;
+} report_sof_stats_t;
+
+extern report_sof_stats_t report_sof_stats;
+
+/* called by protocol when a report is committed */
+void report_sof_stats_add(uint16_t latency_us);
+void report_sof_stats_print(void);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
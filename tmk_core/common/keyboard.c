@@ -43,6 +43,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifdef ADB_MOUSE_ENABLE
 #include "adb.h"
 #endif
+#ifdef RAW_ENABLE
+#include "raw_hid.h"
+#endif
 
 
 #ifdef MATRIX_HAS_GHOST
@@ -135,6 +138,9 @@ void keyboard_task(void)
                     };
                     action_exec(e);
                     hook_matrix_change(e);
+#ifdef RAW_ENABLE
+                    raw_hid_trace(e);
+#endif
                     // record a processed key
                     matrix_prev[r] ^= ((matrix_row_t)1<<c);
 
@@ -169,6 +175,8 @@ MATRIX_LOOP_END:
         adb_mouse_task();
 #endif
 
+    host_mouse_task();
+
     // update LED
     if (led_status != host_keyboard_leds()) {
         led_status = host_keyboard_leds();
@@ -177,7 +185,35 @@ MATRIX_LOOP_END:
     }
 }
 
+#ifdef LED_UPDATE_DEFERRED
+/* LED state waiting for led_update() */
+static uint8_t led_pending = 0;
+static bool led_is_pending = false;
+static uint8_t led_applied = 0xFF;
+#endif
+
 void keyboard_set_leds(uint8_t leds)
 {
+#ifdef LED_UPDATE_DEFERRED
+    led_pending = leds;
+    led_is_pending = true;
+#else
     led_set(leds);
+#endif
 }
+
+#ifdef LED_UPDATE_DEFERRED
+/*
+ * Converter calls this between frames from keyboard when bus is idle, so
+ * that LED transaction doesn't delay key data. Changes made meanwhile are
+ * sent at once and toggling back to the applied state costs nothing.
+ */
+void led_update(void)
+{
+    if (!led_is_pending) return;
+    led_is_pending = false;
+    if (led_pending == led_applied) return;
+    led_applied = led_pending;
+    led_set(led_pending);
+}
+#endif
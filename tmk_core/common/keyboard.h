@@ -66,6 +66,8 @@ void keyboard_init(void);
 void keyboard_task(void);
 /* it runs when host LED status is updated */
 void keyboard_set_leds(uint8_t leds);
+/* calls led_set() with pending LED status(LED_UPDATE_DEFERRED) */
+void led_update(void);
 
 #ifdef __cplusplus
 }
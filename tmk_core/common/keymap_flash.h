@@ -0,0 +1,58 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef KEYMAP_FLASH_H
+#define KEYMAP_FLASH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+
+
+/*
+ * Runtime update of keymap section(KEYMAP_SECTION_ENABLE)
+ *
+ * Flash pages of keymap region are rewritten at runtime without bootloader
+ * mode. Application section of AVR can't execute SPM itself, so page
+ * programming is done by routines in boot section; LUFA bootloader API table
+ * at the end of flash is used by default. Boards with other bootloader can
+ * provide their own keymap_flash_helper_*() placed in boot section.
+ */
+/* size of keymap region in ldscript_keymap_avr*.x */
+#ifndef KEYMAP_FLASH_SIZE
+#define KEYMAP_FLASH_SIZE       0x800
+#endif
+
+#define KEYMAP_FLASH_PAGE_SIZE  SPM_PAGESIZE
+#define KEYMAP_FLASH_PAGES      (KEYMAP_FLASH_SIZE / KEYMAP_FLASH_PAGE_SIZE)
+
+
+/* address of keymap region */
+uint16_t keymap_flash_start(void);
+
+/* CRC-16/CCITT(poly 0x1021, init 0xFFFF) of bytes in flash or RAM */
+uint16_t keymap_flash_page_crc(uint8_t page);
+uint16_t keymap_flash_crc(const uint8_t *data, uint16_t len);
+
+/* Programs the page unless it has the data already and verifies it.
+ * Interrupts are disabled during erase and write(about 8ms). */
+bool keymap_flash_write_page(uint8_t page, const uint8_t *data);
+
+/* boot section helper: weak, LUFA bootloader API by default */
+bool keymap_flash_helper_available(void);
+void keymap_flash_helper_program(uint16_t addr, const uint8_t *data);
+
+#endif
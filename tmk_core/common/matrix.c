@@ -93,3 +93,5 @@ bool matrix_has_ghost_in_row(uint8_t row)
 
 __attribute__ ((weak)) void matrix_power_up(void) {}
 __attribute__ ((weak)) void matrix_power_down(void) {}
+__attribute__ ((weak)) bool matrix_wakeup_select(void) { return false; }
+__attribute__ ((weak)) void matrix_wakeup_unselect(void) {}
@@ -51,7 +51,9 @@ uint8_t matrix_cols(void);
 void matrix_setup(void);
 /* intialize matrix for scaning. */
 void matrix_init(void);
-/* scan all key states on matrix */
+/* scan all key states on matrix
+ * Slow matrix may scan only some rows per call; matrix_get_row() returns
+ * state of the last completed scan of the row. */
 uint8_t matrix_scan(void);
 /* whether modified from previous scan. used after matrix_scan. */
 bool matrix_is_modified(void) __attribute__ ((deprecated));
@@ -71,6 +73,11 @@ bool matrix_has_ghost_in_row(uint8_t row);
 /* power control */
 void matrix_power_up(void);
 void matrix_power_down(void);
+/* suspend wakeup by pin change(SUSPEND_WAKEUP_PCMSK0/1)
+ * Selects all rows so that any key pressed changes its column pin, or
+ * returns false when the matrix can't do that. */
+bool matrix_wakeup_select(void);
+void matrix_wakeup_unselect(void);
 
 #ifdef __cplusplus
 }
@@ -26,8 +26,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 
 static report_mouse_t mouse_report = {};
+#ifndef MOUSEKEY_SMOOTH
 static uint8_t mousekey_repeat =  0;
+#endif
 static uint8_t mousekey_accel = 0;
+/* report not taken by host.c, sent again by mousekey_task() */
+static bool mousekey_resend = false;
 
 static void mousekey_debug(void);
 
@@ -46,17 +50,234 @@ uint8_t mk_interval = MOUSEKEY_INTERVAL;
 uint8_t mk_max_speed = MOUSEKEY_MAX_SPEED;
 /* number of events (count) accelerating to steady speed (0-255) */
 uint8_t mk_time_to_max = MOUSEKEY_TIME_TO_MAX;
-/* ramp used to reach maximum pointer speed (NOT SUPPORTED) */
-//int8_t mk_curve = 0;
 /* wheel params */
 uint8_t mk_wheel_max_speed = MOUSEKEY_WHEEL_MAX_SPEED;
 uint8_t mk_wheel_time_to_max = MOUSEKEY_WHEEL_TIME_TO_MAX;
+#ifdef MOUSEKEY_SMOOTH
+/* ramp used to reach maximum pointer speed: 0 linear, 127 ease-in, -127 ease-out */
+int8_t mk_curve = MOUSEKEY_CURVE;
+/* time(*10ms) to stop from maximum speed after keys are released; 0 stops at once */
+uint8_t mk_inertia = MOUSEKEY_INERTIA/10;
+#endif
 
 
 static uint16_t last_timer = 0;
 
 
-static uint8_t move_unit(void)
+#ifdef MOUSEKEY_SMOOTH
+/*
+ * Frame-timed motion(MOUSEKEY_SMOOTH)
+ *
+ * Speed of each axis is integrated every millisecond in fixed point(1/256
+ * unit) and fraction of movement is carried over to next report, so that
+ * cursor moves by small steps at any speed instead of delta per interval.
+ * Speed ramps up from delta per interval to delta * max_speed per interval
+ * in time_to_max intervals after mk_delay, shaped by mk_curve. Diagonal
+ * movement is scaled by 1/sqrt(2).
+ */
+enum { MK_X, MK_Y, MK_V, MK_H, MK_AXES };
+
+/* speed limit: 127 units per ms in 1/256 unit */
+#define SPEED_MAX   (127 * 256)
+/* longer gap of task call is not integrated */
+#define DT_MAX      50
+
+static int8_t mk_dir[MK_AXES];      // -1, 0 or 1 by keys
+static int16_t mk_speed[MK_AXES];   // 1/256 unit per ms
+static int16_t mk_frac[MK_AXES];    // movement not reported yet
+static uint16_t move_held = 0;      // time(ms) direction keys are held
+static uint16_t wheel_held = 0;
+
+/* x: 0-256 */
+static uint16_t ramp_curve(uint16_t x)
+{
+    uint16_t q = ((uint32_t)x * x) >> 8;
+    if (mk_curve >= 0) {
+        return x - (((uint32_t)(x - q) * mk_curve) >> 7);
+    } else {
+        return x + (((uint32_t)(x - q) * -mk_curve) >> 7);
+    }
+}
+
+/* speed of delta * n per interval */
+static int16_t interval_speed(uint8_t delta, uint8_t n)
+{
+    int32_t speed = ((int32_t)delta * n * 256) / (mk_interval ? mk_interval : 1);
+    return (speed > SPEED_MAX ? SPEED_MAX : speed);
+}
+
+static int16_t ramp_speed(uint8_t delta, uint8_t max_speed, uint8_t time_to_max, uint16_t held)
+{
+    int16_t max = interval_speed(delta, max_speed);
+    int16_t start = interval_speed(delta, 1);
+
+    if (mousekey_accel & (1<<0)) return max/4;
+    if (mousekey_accel & (1<<1)) return max/2;
+    if (mousekey_accel & (1<<2)) return max;
+
+    if (held < mk_delay*10) return 0;
+    uint16_t t = held - mk_delay*10;
+    uint32_t ramp = (uint32_t)time_to_max * mk_interval;
+    uint16_t x = (t >= ramp ? 256 : ((uint32_t)t << 8) / ramp);
+    if (start > max) start = max;
+    return start + (((int32_t)(max - start) * ramp_curve(x)) >> 8);
+}
+
+/* changes speed toward target; slows down by inertia */
+static void speed_update(uint8_t i, int16_t target, int16_t max, uint16_t dt)
+{
+    int16_t speed = mk_speed[i];
+    if (!mk_inertia ||
+            (speed >= 0 && target >= speed) || (speed <= 0 && target <= speed)) {
+        mk_speed[i] = target;
+        return;
+    }
+    int32_t step = ((int32_t)max * dt) / (mk_inertia * 10);
+    if (step == 0) step = 1;
+    if (speed > target) {
+        mk_speed[i] = (speed - step > target ? speed - step : target);
+    } else {
+        mk_speed[i] = (speed + step < target ? speed + step : target);
+    }
+}
+
+/* integrates speed and returns movement in units */
+static int16_t frac_take(uint8_t i, uint16_t dt, int16_t max)
+{
+    int32_t f = mk_frac[i] + (int32_t)mk_speed[i] * dt;
+    int32_t unit = f / 256;
+    if (unit > max) unit = max;
+    if (unit < -max) unit = -max;
+    f -= (int32_t)unit * 256;
+    // drop movement beyond report range
+    mk_frac[i] = (f > 255 ? 255 : (f < -255 ? -255 : f));
+    if (!mk_speed[i] && !mk_dir[i]) mk_frac[i] = 0;
+    return unit;
+}
+
+void mousekey_task(void)
+{
+    if (mousekey_resend) {
+        mousekey_send();
+        if (mousekey_resend) return;
+    }
+
+    uint16_t dt = timer_elapsed(last_timer);
+    if (dt == 0) return;
+    last_timer = timer_read();
+    if (dt > DT_MAX) dt = DT_MAX;
+
+    bool moving = false;
+    for (uint8_t i = 0; i < MK_AXES; i++) {
+        if (mk_dir[i] || mk_speed[i]) moving = true;
+    }
+    if (!moving) return;
+
+    if (mk_dir[MK_X] || mk_dir[MK_Y]) {
+        move_held = (move_held + dt < move_held ? UINT16_MAX : move_held + dt);
+    } else {
+        move_held = 0;
+    }
+    if (mk_dir[MK_V] || mk_dir[MK_H]) {
+        wheel_held = (wheel_held + dt < wheel_held ? UINT16_MAX : wheel_held + dt);
+    } else {
+        wheel_held = 0;
+    }
+
+    int16_t move = ramp_speed(MOUSEKEY_MOVE_DELTA, mk_max_speed, mk_time_to_max, move_held);
+    int16_t wheel = ramp_speed(MOUSEKEY_WHEEL_DELTA, mk_wheel_max_speed, mk_wheel_time_to_max, wheel_held);
+    /* diagonal move [1/sqrt(2) = 181/256] */
+    if (mk_dir[MK_X] && mk_dir[MK_Y]) {
+        move = ((int32_t)move * 181) >> 8;
+    }
+
+    int16_t move_max = interval_speed(MOUSEKEY_MOVE_DELTA, mk_max_speed);
+    int16_t wheel_max = interval_speed(MOUSEKEY_WHEEL_DELTA, mk_wheel_max_speed);
+    speed_update(MK_X, mk_dir[MK_X] * move, move_max, dt);
+    speed_update(MK_Y, mk_dir[MK_Y] * move, move_max, dt);
+    speed_update(MK_V, mk_dir[MK_V] * wheel, wheel_max, dt);
+    speed_update(MK_H, mk_dir[MK_H] * wheel, wheel_max, dt);
+
+    mouse_report.x = frac_take(MK_X, dt, MOUSEKEY_MOVE_MAX);
+    mouse_report.y = frac_take(MK_Y, dt, MOUSEKEY_MOVE_MAX);
+    mouse_report.v = frac_take(MK_V, dt, MOUSEKEY_WHEEL_MAX);
+    mouse_report.h = frac_take(MK_H, dt, MOUSEKEY_WHEEL_MAX);
+
+    if (mouse_report.x || mouse_report.y || mouse_report.v || mouse_report.h) {
+        mousekey_send();
+    }
+}
+
+/* direction key moves by delta at once and starts motion after mk_delay */
+void mousekey_on(uint8_t code)
+{
+    if      (code == KC_MS_UP)       { mk_dir[MK_Y] = -1; mouse_report.y = -MOUSEKEY_MOVE_DELTA; }
+    else if (code == KC_MS_DOWN)     { mk_dir[MK_Y] =  1; mouse_report.y =  MOUSEKEY_MOVE_DELTA; }
+    else if (code == KC_MS_LEFT)     { mk_dir[MK_X] = -1; mouse_report.x = -MOUSEKEY_MOVE_DELTA; }
+    else if (code == KC_MS_RIGHT)    { mk_dir[MK_X] =  1; mouse_report.x =  MOUSEKEY_MOVE_DELTA; }
+    else if (code == KC_MS_WH_UP)    { mk_dir[MK_V] =  1; mouse_report.v =  MOUSEKEY_WHEEL_DELTA; }
+    else if (code == KC_MS_WH_DOWN)  { mk_dir[MK_V] = -1; mouse_report.v = -MOUSEKEY_WHEEL_DELTA; }
+    else if (code == KC_MS_WH_LEFT)  { mk_dir[MK_H] = -1; mouse_report.h = -MOUSEKEY_WHEEL_DELTA; }
+    else if (code == KC_MS_WH_RIGHT) { mk_dir[MK_H] =  1; mouse_report.h =  MOUSEKEY_WHEEL_DELTA; }
+    else if (code == KC_MS_BTN1)     mouse_report.buttons |= MOUSE_BTN1;
+    else if (code == KC_MS_BTN2)     mouse_report.buttons |= MOUSE_BTN2;
+    else if (code == KC_MS_BTN3)     mouse_report.buttons |= MOUSE_BTN3;
+    else if (code == KC_MS_BTN4)     mouse_report.buttons |= MOUSE_BTN4;
+    else if (code == KC_MS_BTN5)     mouse_report.buttons |= MOUSE_BTN5;
+    else if (code == KC_MS_ACCEL0)   mousekey_accel |= (1<<0);
+    else if (code == KC_MS_ACCEL1)   mousekey_accel |= (1<<1);
+    else if (code == KC_MS_ACCEL2)   mousekey_accel |= (1<<2);
+}
+
+void mousekey_off(uint8_t code)
+{
+    if      (code == KC_MS_UP       && mk_dir[MK_Y] < 0) mk_dir[MK_Y] = 0;
+    else if (code == KC_MS_DOWN     && mk_dir[MK_Y] > 0) mk_dir[MK_Y] = 0;
+    else if (code == KC_MS_LEFT     && mk_dir[MK_X] < 0) mk_dir[MK_X] = 0;
+    else if (code == KC_MS_RIGHT    && mk_dir[MK_X] > 0) mk_dir[MK_X] = 0;
+    else if (code == KC_MS_WH_UP    && mk_dir[MK_V] > 0) mk_dir[MK_V] = 0;
+    else if (code == KC_MS_WH_DOWN  && mk_dir[MK_V] < 0) mk_dir[MK_V] = 0;
+    else if (code == KC_MS_WH_LEFT  && mk_dir[MK_H] < 0) mk_dir[MK_H] = 0;
+    else if (code == KC_MS_WH_RIGHT && mk_dir[MK_H] > 0) mk_dir[MK_H] = 0;
+    else if (code == KC_MS_BTN1) mouse_report.buttons &= ~MOUSE_BTN1;
+    else if (code == KC_MS_BTN2) mouse_report.buttons &= ~MOUSE_BTN2;
+    else if (code == KC_MS_BTN3) mouse_report.buttons &= ~MOUSE_BTN3;
+    else if (code == KC_MS_BTN4) mouse_report.buttons &= ~MOUSE_BTN4;
+    else if (code == KC_MS_BTN5) mouse_report.buttons &= ~MOUSE_BTN5;
+    else if (code == KC_MS_ACCEL0) mousekey_accel &= ~(1<<0);
+    else if (code == KC_MS_ACCEL1) mousekey_accel &= ~(1<<1);
+    else if (code == KC_MS_ACCEL2) mousekey_accel &= ~(1<<2);
+}
+
+void mousekey_send(void)
+{
+    mousekey_debug();
+    mousekey_resend = !host_mouse_send(&mouse_report);
+    if (mousekey_resend) return;
+    // movement is sent only once
+    mouse_report.x = 0;
+    mouse_report.y = 0;
+    mouse_report.v = 0;
+    mouse_report.h = 0;
+}
+
+void mousekey_clear(void)
+{
+    mouse_report = (report_mouse_t){};
+    mousekey_accel = 0;
+    for (uint8_t i = 0; i < MK_AXES; i++) {
+        mk_dir[i] = 0;
+        mk_speed[i] = 0;
+        mk_frac[i] = 0;
+    }
+    move_held = 0;
+    wheel_held = 0;
+}
+
+#else
+
+
+static int16_t move_unit(void)
 {
     uint16_t unit;
     if (mousekey_accel & (1<<0)) {
@@ -75,7 +296,7 @@ static uint8_t move_unit(void)
     return (unit > MOUSEKEY_MOVE_MAX ? MOUSEKEY_MOVE_MAX : (unit == 0 ? 1 : unit));
 }
 
-static uint8_t wheel_unit(void)
+static int16_t wheel_unit(void)
 {
     uint16_t unit;
     if (mousekey_accel & (1<<0)) {
@@ -96,6 +317,11 @@ static uint8_t wheel_unit(void)
 
 void mousekey_task(void)
 {
+    if (mousekey_resend) {
+        mousekey_send();
+        if (mousekey_resend) return;
+    }
+
     if (timer_elapsed(last_timer) < (mousekey_repeat ? mk_interval : mk_delay*10))
         return;
 
@@ -171,7 +397,7 @@ void mousekey_off(uint8_t code)
 void mousekey_send(void)
 {
     mousekey_debug();
-    host_mouse_send(&mouse_report);
+    mousekey_resend = !host_mouse_send(&mouse_report);
     last_timer = timer_read();
 }
 
@@ -182,15 +408,26 @@ void mousekey_clear(void)
     mousekey_accel = 0;
 }
 
+#endif
+
 static void mousekey_debug(void)
 {
     if (!debug_mouse) return;
+#ifdef MOUSEKEY_SMOOTH
+    print("mousekey [btn|x y v h](time/acl): [");
+#else
     print("mousekey [btn|x y v h](rep/acl): [");
+#endif
     phex(mouse_report.buttons); print("|");
     print_decs(mouse_report.x); print(" ");
     print_decs(mouse_report.y); print(" ");
     print_decs(mouse_report.v); print(" ");
     print_decs(mouse_report.h); print("](");
+#ifdef MOUSEKEY_SMOOTH
+    // for tool/mousekey/mousekey_plot.py
+    print_dec(timer_read()); print("/");
+#else
     print_dec(mousekey_repeat); print("/");
+#endif
     print_dec(mousekey_accel); print(")\n");
 }
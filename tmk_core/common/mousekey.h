@@ -22,9 +22,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "host.h"
 
 
-/* max value on report descriptor */
-#define MOUSEKEY_MOVE_MAX       127
-#define MOUSEKEY_WHEEL_MAX      127
+/* max value on report descriptor: 32767 for move with MOUSE_EXT_REPORT */
+#define MOUSEKEY_MOVE_MAX       MOUSE_XY_MAX
+#define MOUSEKEY_WHEEL_MAX      MOUSE_WHEEL_MAX
 
 #ifndef MOUSEKEY_MOVE_DELTA
 #define MOUSEKEY_MOVE_DELTA     5
@@ -50,6 +50,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef MOUSEKEY_WHEEL_TIME_TO_MAX
 #define MOUSEKEY_WHEEL_TIME_TO_MAX 40
 #endif
+/* MOUSEKEY_SMOOTH: frame-timed motion with fraction carried over */
+#ifndef MOUSEKEY_CURVE
+#define MOUSEKEY_CURVE 0
+#endif
+#ifndef MOUSEKEY_INERTIA
+#define MOUSEKEY_INERTIA 0
+#endif
 
 
 #ifdef __cplusplus
@@ -62,6 +69,10 @@ extern uint8_t mk_max_speed;
 extern uint8_t mk_time_to_max;
 extern uint8_t mk_wheel_max_speed;
 extern uint8_t mk_wheel_time_to_max;
+#ifdef MOUSEKEY_SMOOTH
+extern int8_t mk_curve;
+extern uint8_t mk_inertia;
+#endif
 
 
 void mousekey_task(void);
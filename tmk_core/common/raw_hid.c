@@ -0,0 +1,246 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <string.h>
+#include "raw_hid.h"
+#include "matrix.h"
+#include "timer.h"
+#include "debug.h"
+#ifdef KEYMAP_FLASH_ENABLE
+#include "action.h"
+#include "keymap_flash.h"
+#endif
+
+#ifdef __AVR__
+#   include <avr/eeprom.h>
+#else
+/* chibios/eeconfig.c */
+uint8_t eeprom_read_byte(const uint8_t *addr);
+void eeprom_write_byte(uint8_t *addr, uint8_t value);
+extern const uint16_t eeprom_size;
+#   define eeprom_update_byte   eeprom_write_byte
+#endif
+
+
+/* size of EEPROM accessible from host */
+#ifndef RAW_EEPROM_SIZE
+#   ifdef __AVR__
+#       define RAW_EEPROM_SIZE      (E2END + 1)
+#   else
+#       define RAW_EEPROM_SIZE      eeprom_size
+#   endif
+#endif
+
+/* number of key events buffered for trace */
+#ifndef RAW_TRACE_SIZE
+#define RAW_TRACE_SIZE      16
+#endif
+
+#define TRACE_PER_REPORT    (RAW_DATA_SIZE / RAW_TRACE_EVENT_SIZE)
+
+
+/* request waiting for process */
+static uint8_t rx_buf[RAW_EPSIZE];
+static volatile bool rx_ready = false;
+
+/* report waiting for endpoint */
+static uint8_t tx_buf[RAW_EPSIZE];
+static bool tx_pending = false;
+
+static bool trace_enable = false;
+static uint8_t trace_buf[RAW_TRACE_SIZE][RAW_TRACE_EVENT_SIZE];
+static uint8_t trace_head = 0;
+static uint8_t trace_count = 0;
+static uint8_t trace_seq = 0;
+
+#ifdef KEYMAP_FLASH_ENABLE
+static uint8_t page_buf[KEYMAP_FLASH_PAGE_SIZE];
+#endif
+
+static uint32_t key_events = 0;
+static uint16_t trace_dropped = 0;
+static uint16_t rx_dropped = 0;
+
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    put16(&p[0], v & 0xFFFF);
+    put16(&p[2], v >> 16);
+}
+
+#ifdef KEYMAP_FLASH_ENABLE
+static uint8_t keymap_request(uint8_t *data)
+{
+    uint16_t offset = rx_buf[2] | (rx_buf[3] << 8);
+    uint8_t len = rx_buf[4];
+    uint8_t page = rx_buf[2];
+    uint8_t count = rx_buf[3];
+
+    switch (rx_buf[0]) {
+        case RAW_CMD_KEYMAP_INFO:
+            put16(&data[0], keymap_flash_start());
+            put16(&data[2], KEYMAP_FLASH_SIZE);
+            put16(&data[4], KEYMAP_FLASH_PAGE_SIZE);
+            data[6] = keymap_flash_helper_available();
+            return RAW_OK;
+        case RAW_CMD_KEYMAP_CRC:
+            if (count > RAW_DATA_SIZE / 2 || (uint16_t)page + count > KEYMAP_FLASH_PAGES)
+                return RAW_ERR_ARGUMENT;
+            for (uint8_t i = 0; i < count; i++) {
+                put16(&data[i * 2], keymap_flash_page_crc(page + i));
+            }
+            return RAW_OK;
+        case RAW_CMD_KEYMAP_DATA:
+            if (len > RAW_EPSIZE - 5 || offset + len > KEYMAP_FLASH_PAGE_SIZE)
+                return RAW_ERR_ARGUMENT;
+            memcpy(&page_buf[offset], &rx_buf[5], len);
+            return RAW_OK;
+        case RAW_CMD_KEYMAP_WRITE:
+            if (page >= KEYMAP_FLASH_PAGES)
+                return RAW_ERR_ARGUMENT;
+            if (keymap_flash_crc(page_buf, KEYMAP_FLASH_PAGE_SIZE) != (rx_buf[3] | (rx_buf[4] << 8)))
+                return RAW_ERR_VERIFY;
+            if (!keymap_flash_helper_available())
+                return RAW_ERR_UNAVAILABLE;
+            // release keys registered with old keymap
+            clear_keyboard();
+            if (!keymap_flash_write_page(page, page_buf))
+                return RAW_ERR_VERIFY;
+            dprintf("raw: keymap page %u\n", page);
+            return RAW_OK;
+    }
+    return RAW_ERR_COMMAND;
+}
+#endif
+
+static uint8_t process_request(uint8_t *data)
+{
+    uint16_t addr = rx_buf[2] | (rx_buf[3] << 8);
+    uint8_t len = rx_buf[4];
+
+    switch (rx_buf[0]) {
+        case RAW_CMD_VERSION:
+            data[0] = RAW_PROTOCOL_VERSION;
+            data[1] = MATRIX_ROWS;
+            data[2] = MATRIX_COLS;
+            put16(&data[3], RAW_EEPROM_SIZE);
+            return RAW_OK;
+        case RAW_CMD_COUNTERS:
+            put32(&data[0], timer_read32());
+            put32(&data[4], key_events);
+            put16(&data[8], trace_dropped);
+            put16(&data[10], rx_dropped);
+            return RAW_OK;
+        case RAW_CMD_EEPROM_READ:
+            if (len > RAW_DATA_SIZE || (uint32_t)addr + len > RAW_EEPROM_SIZE)
+                return RAW_ERR_ARGUMENT;
+            for (uint8_t i = 0; i < len; i++) {
+                data[i] = eeprom_read_byte((uint8_t *)(uintptr_t)(addr + i));
+            }
+            return RAW_OK;
+        case RAW_CMD_EEPROM_WRITE:
+            if (len > RAW_EPSIZE - 5 || (uint32_t)addr + len > RAW_EEPROM_SIZE)
+                return RAW_ERR_ARGUMENT;
+            for (uint8_t i = 0; i < len; i++) {
+                eeprom_update_byte((uint8_t *)(uintptr_t)(addr + i), rx_buf[5 + i]);
+            }
+            dprintf("raw: eeprom write %u:%u\n", addr, len);
+            return RAW_OK;
+        case RAW_CMD_TRACE:
+            trace_enable = rx_buf[2];
+            trace_count = 0;
+            return RAW_OK;
+    }
+#ifdef KEYMAP_FLASH_ENABLE
+    return keymap_request(data);
+#else
+    return RAW_ERR_COMMAND;
+#endif
+}
+
+/* packs buffered key events into a report */
+static void trace_report(void)
+{
+    uint8_t n = (trace_count < TRACE_PER_REPORT ? trace_count : TRACE_PER_REPORT);
+
+    tx_buf[0] = RAW_CMD_TRACE_DATA;
+    tx_buf[1] = trace_seq++;
+    tx_buf[2] = n;
+    for (uint8_t i = 0; i < n; i++) {
+        memcpy(&tx_buf[3 + i * RAW_TRACE_EVENT_SIZE], trace_buf[trace_head], RAW_TRACE_EVENT_SIZE);
+        trace_head = (trace_head + 1) % RAW_TRACE_SIZE;
+    }
+    trace_count -= n;
+}
+
+void raw_hid_receive(const uint8_t *data, uint8_t length)
+{
+    // host should wait for response before next request
+    if (rx_ready) {
+        rx_dropped++;
+        return;
+    }
+    if (length > RAW_EPSIZE) length = RAW_EPSIZE;
+    memcpy(rx_buf, data, length);
+    memset(&rx_buf[length], 0, RAW_EPSIZE - length);
+    rx_ready = true;
+}
+
+void raw_hid_task(void)
+{
+    if (!tx_pending && rx_ready) {
+        memset(tx_buf, 0, sizeof(tx_buf));
+        tx_buf[0] = rx_buf[0];
+        tx_buf[1] = rx_buf[1];
+        tx_buf[2] = process_request(&tx_buf[3]);
+        rx_ready = false;
+        tx_pending = true;
+    }
+
+    // trace events go out as soon as endpoint is free
+    if (!tx_pending && trace_count) {
+        memset(tx_buf, 0, sizeof(tx_buf));
+        trace_report();
+        tx_pending = true;
+    }
+
+    if (tx_pending && raw_hid_send(tx_buf)) {
+        tx_pending = false;
+    }
+}
+
+void raw_hid_trace(keyevent_t event)
+{
+    key_events++;
+    if (!trace_enable) return;
+
+    if (trace_count >= RAW_TRACE_SIZE) {
+        trace_dropped++;
+        return;
+    }
+    uint8_t *e = trace_buf[(trace_head + trace_count) % RAW_TRACE_SIZE];
+    put16(&e[0], event.time);
+    e[2] = event.key.row;
+    e[3] = event.key.col | (event.pressed ? 0x80 : 0);
+    trace_count++;
+}
@@ -0,0 +1,83 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef RAW_HID_H
+#define RAW_HID_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "keyboard.h"
+
+
+/*
+ * Raw HID channel
+ *
+ * Vendor-defined HID interface(usage page 0xFF60) with 64-byte reports.
+ * Host sends a request in Output report and device answers with Input report.
+ * While trace is enabled device also sends trace reports on its own.
+ *
+ * Request:  [0] command  [1] sequence  [2..63] arguments
+ * Response: [0] command  [1] sequence  [2] status  [3..63] data
+ *
+ * Multi-byte values are little endian. See tool/raw_hid/raw_hid.py for host side.
+ */
+#define RAW_EPSIZE              64
+#define RAW_DATA_SIZE           (RAW_EPSIZE - 3)
+
+#define RAW_PROTOCOL_VERSION    1
+
+/* commands */
+#define RAW_CMD_VERSION         0x01    /* data: version, rows, cols, eeprom size(16) */
+#define RAW_CMD_COUNTERS        0x02    /* data: uptime ms(32), key events(32),
+                                                 trace dropped(16), request dropped(16) */
+#define RAW_CMD_EEPROM_READ     0x03    /* args: addr(16), len          data: bytes */
+#define RAW_CMD_EEPROM_WRITE    0x04    /* args: addr(16), len, bytes */
+#define RAW_CMD_TRACE           0x05    /* args: 1 to start, 0 to stop */
+
+/* keymap section update(KEYMAP_FLASH_ENABLE)
+ * Page is filled in RAM buffer with KEYMAP_DATA and programmed with KEYMAP_WRITE. */
+#define RAW_CMD_KEYMAP_INFO     0x10    /* data: start(16), size(16), page size(16), writable */
+#define RAW_CMD_KEYMAP_CRC      0x11    /* args: page, count(<=30)      data: CRC-16 of pages */
+#define RAW_CMD_KEYMAP_DATA     0x12    /* args: offset(16), len, bytes */
+#define RAW_CMD_KEYMAP_WRITE    0x13    /* args: page, CRC-16 of buffer */
+
+/* sent by device while trace is enabled; sequence counts up for each report
+ * status: number of events
+ * data:   events of time(16), row, col | (pressed << 7) */
+#define RAW_CMD_TRACE_DATA      0x85
+#define RAW_TRACE_EVENT_SIZE    4
+
+/* status */
+#define RAW_OK                  0x00
+#define RAW_ERR_COMMAND         0x01
+#define RAW_ERR_ARGUMENT        0x02
+#define RAW_ERR_VERIFY          0x03
+#define RAW_ERR_UNAVAILABLE     0x04
+
+
+/* called by protocol when Output report is received; may be called from ISR */
+void raw_hid_receive(const uint8_t *data, uint8_t length);
+
+/* called in main loop to process request and send reports */
+void raw_hid_task(void);
+
+/* called with every key event */
+void raw_hid_trace(keyevent_t event);
+
+/* implemented by protocol: sends RAW_EPSIZE bytes, returns false when endpoint is busy */
+bool raw_hid_send(const uint8_t *data);
+
+#endif
@@ -142,14 +142,59 @@ typedef struct {
 } __attribute__ ((packed)) report_keyboard_t;
 */
 
+/* mouse report
+ *
+ * With MOUSE_EXT_REPORT X and Y are 16-bit(-32767 to 32767) on LUFA and ChibiOS,
+ * otherwise 8-bit(-127 to 127). Wheels are 8-bit always.
+ *
+ * byte |0       |1       |2       |3       |4       |5       |6
+ * -----+--------+--------+--------+--------+--------+--------+--------
+ * 8bit |buttons |X       |Y       |V       |H
+ * 16bit|buttons |X(LSB)  |X(MSB)  |Y(LSB)  |Y(MSB)  |V       |H
+ */
+#ifdef MOUSE_EXT_REPORT
+#define MOUSE_XY_MAX    32767
+#else
+#define MOUSE_XY_MAX    127
+#endif
+#define MOUSE_WHEEL_MAX 127
+
 typedef struct {
     uint8_t buttons;
+#ifdef MOUSE_EXT_REPORT
+    int16_t x;
+    int16_t y;
+#else
     int8_t x;
     int8_t y;
+#endif
     int8_t v;
     int8_t h;
 } __attribute__ ((packed)) report_mouse_t;
 
+/* movement for 8-bit report: boot protocol and Bluetooth modules */
+static inline int8_t mouse_clamp8(int16_t v) { return (v > 127 ? 127 : (v < -127 ? -127 : v)); }
+
+#ifdef MOUSE_EXT_REPORT
+/* 8-bit report sent in boot protocol, which host reads without descriptor */
+typedef struct {
+    uint8_t buttons;
+    int8_t x;
+    int8_t y;
+    int8_t v;
+    int8_t h;
+} __attribute__ ((packed)) report_mouse_boot_t;
+
+static inline void report_mouse_boot(report_mouse_boot_t *boot, const report_mouse_t *report)
+{
+    boot->buttons = report->buttons;
+    boot->x = mouse_clamp8(report->x);
+    boot->y = mouse_clamp8(report->y);
+    boot->v = report->v;
+    boot->h = report->h;
+}
+#endif
+
 
 /* keycode to system usage */
 #define KEYCODE2SYSTEM(key) \
@@ -9,5 +9,8 @@ void suspend_idle(uint8_t timeout);
 void suspend_power_down(void);
 bool suspend_wakeup_condition(void);
 void suspend_wakeup_init(void);
+/* called by protocol when keyboard report is sent;
+ * prints latency from wakeup event to the first report after resume */
+void suspend_report_sent(void);
 
 #endif
@@ -29,7 +29,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define TIMER_DIFF_8(a, b)      TIMER_DIFF(a, b, UINT8_MAX)
 #define TIMER_DIFF_16(a, b)     TIMER_DIFF(a, b, UINT16_MAX)
 #define TIMER_DIFF_32(a, b)     TIMER_DIFF(a, b, UINT32_MAX)
+#ifdef TIMER_RAW_TOP
+/* TIMER_RAW wraps to 0 after TIMER_RAW_TOP */
+#define TIMER_DIFF_RAW(a, b)    TIMER_DIFF(a, b, TIMER_RAW_TOP + 1)
+#else
 #define TIMER_DIFF_RAW(a, b)    TIMER_DIFF_8(a, b)
+#endif
 
 
 #ifdef __cplusplus
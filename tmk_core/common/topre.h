@@ -0,0 +1,77 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TOPRE_H
+#define TOPRE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <util/delay_basic.h>
+
+/*
+ * Scan timing of Topre capacitive switch controller(HHKB, FC660C)
+ *
+ * settle:   wait after KEY_ENABLE before reading KEY_STATE
+ * recovery: wait after KEY_UNABLE until KEY_STATE returns to idle
+ *
+ * Magic+T calibrates the waits on the board: KEY_STATE of a held key is
+ * sampled to measure how long it takes to output and release its state and
+ * the results with margin are stored in EEPROM. Without valid EEPROM values
+ * the defaults are used. Keyboard provides topre_key_* to drive the key.
+ */
+#ifndef TOPRE_SETTLE_DEFAULT
+#define TOPRE_SETTLE_DEFAULT    5
+#endif
+#ifndef TOPRE_RECOVERY_DEFAULT
+#define TOPRE_RECOVERY_DEFAULT  75
+#endif
+#ifndef TOPRE_TIMING_EEPROM
+#define TOPRE_TIMING_EEPROM     (uint8_t *)32
+#endif
+
+extern uint8_t topre_settle_us;
+extern uint8_t topre_recovery_us;
+
+/* loads calibrated waits from EEPROM */
+void topre_timing_init(void);
+/* calibrates with a key held down; returns false when no key is held or it fails */
+bool topre_calibrate(void);
+/* counts scan from 'start'(timer_read) and prints rate with debug matrix */
+void topre_scan_stat(uint16_t start);
+
+/* keyboard: selects key and turns on hysteresis, ready for enable */
+void topre_key_select(uint8_t row, uint8_t col);
+void topre_key_enable(void);
+/* keyboard: turns off hysteresis and disables */
+void topre_key_unable(void);
+/* keyboard: KEY_STATE, false while the key is on */
+bool topre_key_state(void);
+
+
+/*
+ * Busy-waits 'us' in 4-cycle loop of _delay_loop_2. Unlike loop of _delay_us(1)
+ * it is off by a few cycles only, spent on computing the count.
+ */
+#if (F_CPU < 4000000)
+#   error "topre_delay_us() needs F_CPU of 4MHz or more."
+#endif
+static inline void topre_delay_us(uint8_t us)
+{
+    uint16_t n = (uint16_t)us * (F_CPU / 4000000);
+    if (n > 1) _delay_loop_2(n - 1);
+}
+
+#endif
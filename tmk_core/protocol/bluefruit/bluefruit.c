@@ -116,8 +116,8 @@ static void send_mouse(report_mouse_t *report)
     bluefruit_serial_send(0x00);
     bluefruit_serial_send(0x03);
     bluefruit_serial_send(report->buttons);
-    bluefruit_serial_send(report->x);
-    bluefruit_serial_send(report->y);
+    bluefruit_serial_send(mouse_clamp8(report->x));
+    bluefruit_serial_send(mouse_clamp8(report->y));
     bluefruit_serial_send(report->v); // should try sending the wheel v here
     bluefruit_serial_send(report->h); // should try sending the wheel h here
     bluefruit_serial_send(0x00);
@@ -31,11 +31,15 @@
 #include "led.h"
 #include "sendchar.h"
 #include "debug.h"
+#include "timer.h"
 #ifdef SLEEP_LED_ENABLE
 #include "sleep_led.h"
 #endif
 #include "suspend.h"
 #include "hook.h"
+#ifdef RAW_ENABLE
+#include "raw_hid.h"
+#endif
 
 
 /* -------------------------
@@ -49,6 +53,10 @@ void send_keyboard(report_keyboard_t *report);
 void send_mouse(report_mouse_t *report);
 void send_system(uint16_t data);
 void send_consumer(uint16_t data);
+bool mouse_ready(void);
+bool keyboard_ready(void);
+bool extra_ready(void);
+void eeprom_task(void);
 
 /* host struct */
 host_driver_t chibios_driver = {
@@ -56,9 +64,216 @@ host_driver_t chibios_driver = {
   send_keyboard,
   send_mouse,
   send_system,
-  send_consumer
+  send_consumer,
+  mouse_ready
+};
+
+#ifdef REPORT_THREAD
+/* -------------------------
+ *   Scan and report threads
+ * -------------------------
+ *
+ * With REPORT_THREAD matrix scan and actions run in scan thread and host
+ * driver of TMK only posts reports into a mailbox, then report thread sends
+ * them with chibios_driver above. Report thread waits while report queue
+ * of endpoint is full, so that no report in mailbox is overwritten, while
+ * scan thread goes on.
+ */
+#ifndef SCAN_THREAD_STACK_SIZE
+#define SCAN_THREAD_STACK_SIZE      1024
+#endif
+#ifndef REPORT_THREAD_STACK_SIZE
+#define REPORT_THREAD_STACK_SIZE    256
+#endif
+/* number of reports posted and not sent yet */
+#ifndef REPORT_MAILBOX_SIZE
+#define REPORT_MAILBOX_SIZE         16
+#endif
+
+enum {
+  REPORT_KEYBOARD,
+  REPORT_MOUSE,
+  REPORT_SYSTEM,
+  REPORT_CONSUMER,
 };
 
+typedef struct {
+  uint8_t type;
+  union {
+    report_keyboard_t keyboard;
+    report_mouse_t mouse;
+    uint16_t usage;
+  };
+} report_msg_t;
+
+static report_msg_t report_msg_buf[REPORT_MAILBOX_SIZE];
+static MEMORYPOOL_DECL(report_pool, sizeof(report_msg_t), NULL);
+static msg_t report_mb_buf[REPORT_MAILBOX_SIZE];
+static MAILBOX_DECL(report_mb, report_mb_buf, REPORT_MAILBOX_SIZE);
+
+/* mouse reports in mailbox; each counter is written by one thread only */
+static volatile uint8_t mouse_posted = 0;
+static volatile uint8_t mouse_sent = 0;
+
+static THD_WORKING_AREA(waScanThread, SCAN_THREAD_STACK_SIZE);
+static THD_WORKING_AREA(waReportThread, REPORT_THREAD_STACK_SIZE);
+
+typedef struct {
+  uint32_t loops;
+  uint32_t time_sum;    // ticks
+  systime_t time_max;
+} thread_stats_t;
+
+static thread_stats_t scan_stats;
+static thread_stats_t report_stats;
+/* reports dropped when mailbox is full */
+static uint32_t report_dropped = 0;
+
+static void thread_stats_add(thread_stats_t *stats, systime_t start) {
+  systime_t time = chVTTimeElapsedSinceX(start);
+  stats->loops++;
+  stats->time_sum += time;
+  if(time > stats->time_max) stats->time_max = time;
+}
+
+/* returns empty message, or NULL when mailbox is full */
+static report_msg_t *report_alloc(uint8_t type) {
+  report_msg_t *msg = (report_msg_t *)chPoolAlloc(&report_pool);
+  if(msg == NULL) {
+    report_dropped++;
+    return NULL;
+  }
+  msg->type = type;
+  return msg;
+}
+
+static void report_post(report_msg_t *msg) {
+  /* never blocks: a slot of pool is a slot of mailbox */
+  if(chMBPost(&report_mb, (msg_t)msg, TIME_IMMEDIATE) != MSG_OK) {
+    chPoolFree(&report_pool, msg);
+    report_dropped++;
+  }
+}
+
+static void post_keyboard(report_keyboard_t *report) {
+  report_msg_t *msg = report_alloc(REPORT_KEYBOARD);
+  if(msg == NULL) return;
+  msg->keyboard = *report;
+  report_post(msg);
+}
+
+static void post_mouse(report_mouse_t *report) {
+  report_msg_t *msg = report_alloc(REPORT_MOUSE);
+  if(msg == NULL) return;
+  msg->mouse = *report;
+  mouse_posted++;
+  report_post(msg);
+}
+
+static void post_system(uint16_t data) {
+  report_msg_t *msg = report_alloc(REPORT_SYSTEM);
+  if(msg == NULL) return;
+  msg->usage = data;
+  report_post(msg);
+}
+
+static void post_consumer(uint16_t data) {
+  report_msg_t *msg = report_alloc(REPORT_CONSUMER);
+  if(msg == NULL) return;
+  msg->usage = data;
+  report_post(msg);
+}
+
+/* host.c merges mouse reports while one is in mailbox */
+static bool post_mouse_ready(void) {
+  return mouse_posted == mouse_sent;
+}
+
+/* host driver of scan thread */
+static host_driver_t mailbox_driver = {
+  keyboard_leds,
+  post_keyboard,
+  post_mouse,
+  post_system,
+  post_consumer,
+  post_mouse_ready
+};
+
+/* send_* overwrite newest report when queue of endpoint is full; waits for
+ * room */
+static void wait_ready(bool (*ready)(void)) {
+  while(!ready()) {
+    chThdSleepMilliseconds(1);
+  }
+}
+
+static THD_FUNCTION(reportThread, arg) {
+  (void)arg;
+  chRegSetThreadName("report");
+
+  while(true) {
+    msg_t m;
+    if(chMBFetch(&report_mb, &m, TIME_INFINITE) != MSG_OK) continue;
+    report_msg_t *msg = (report_msg_t *)m;
+    systime_t start = chVTGetSystemTimeX();
+
+    switch(msg->type) {
+    case REPORT_KEYBOARD:
+      wait_ready(keyboard_ready);
+      send_keyboard(&msg->keyboard);
+      break;
+    case REPORT_MOUSE:
+      wait_ready(mouse_ready);
+      send_mouse(&msg->mouse);
+      mouse_sent++;
+      break;
+    case REPORT_SYSTEM:
+      wait_ready(extra_ready);
+      send_system(msg->usage);
+      break;
+    case REPORT_CONSUMER:
+      wait_ready(extra_ready);
+      send_consumer(msg->usage);
+      break;
+    }
+    chPoolFree(&report_pool, msg);
+    thread_stats_add(&report_stats, start);
+  }
+}
+
+/* bytes of stack never used, needs CH_DBG_FILL_THREADS */
+static size_t stack_unused(void *wa, size_t size) {
+  uint8_t *start = (uint8_t *)wa + sizeof(thread_t);
+  uint8_t *p = start;
+  while(p < (uint8_t *)wa + size && *p == CH_DBG_STACK_FILL_VALUE) {
+    p++;
+  }
+  return p - start;
+}
+
+static void thread_stats_print_one(const char *name, thread_stats_t *stats, void *wa, size_t size) {
+  xprintf("%s: loops:%lu avg:%luus max:%luus", name, stats->loops,
+          (unsigned long)(stats->loops ? ST2US(stats->time_sum / stats->loops) : 0),
+          (unsigned long)ST2US(stats->time_max));
+#if CH_DBG_FILL_THREADS
+  xprintf(" stack:%u/%u", (unsigned)(size - sizeof(thread_t) - stack_unused(wa, size)),
+          (unsigned)(size - sizeof(thread_t)));
+#else
+  (void)wa;
+  (void)size;
+#endif
+  xprintf("\n");
+}
+
+/* Loop time of threads and stack high-water mark(bytes used at most)
+ * Resolution of time is system tick. */
+void thread_stats_print(void) {
+  thread_stats_print_one("scan", &scan_stats, waScanThread, sizeof(waScanThread));
+  thread_stats_print_one("report", &report_stats, waReportThread, sizeof(waReportThread));
+  xprintf("report dropped: %lu\n", report_dropped);
+}
+#endif /* REPORT_THREAD */
+
 /* Default hooks definitions. */
 __attribute__((weak))
 void hook_early_init(void) {}
@@ -76,6 +291,10 @@ void hook_usb_suspend_loop(void) {
   }
 }
 
+/* Background work of emulated EEPROM(chibios/eeconfig.c) */
+__attribute__((weak))
+void eeprom_task(void) {}
+
 /* TESTING
  * Amber LED blinker thread, times are in milliseconds.
  */
@@ -97,6 +316,75 @@ void hook_usb_suspend_loop(void) {
 // }
 
 
+static uint16_t init_time;
+static bool configured = false;
+
+/* keyboard business: USB state, matrix scan and actions */
+static void keyboard_loop(void) {
+  if(!configured && USB_DRIVER.state == USB_ACTIVE) {
+    /* Do need to wait here!
+     * Otherwise the next print might start a transfer on console EP
+     * before the USB is completely ready, which sometimes causes
+     * HardFaults.
+     */
+    chThdSleepMilliseconds(50);
+    configured = true;
+
+    print("USB configured.\n");
+    xprintf("boot: keyboard init %ums, USB configured %ums\n", init_time, timer_read());
+    print("Keyboard start.\n");
+
+    /* keys pressed during enumeration */
+    send_keyboard_report();
+#ifdef MOUSEKEY_ENABLE
+    mousekey_send();
+#endif /* MOUSEKEY_ENABLE */
+  }
+
+  if(USB_DRIVER.state == USB_SUSPENDED) {
+    print("[s]");
+    while(USB_DRIVER.state == USB_SUSPENDED) {
+      hook_usb_suspend_loop();
+    }
+    /* Woken up */
+    // variables have been already cleared
+    send_keyboard_report();
+#ifdef MOUSEKEY_ENABLE
+    mousekey_send();
+#endif /* MOUSEKEY_ENABLE */
+  }
+
+#ifdef REPORT_SOF_SYNC
+  /* scan right after SOF so that report is committed at next SOF */
+  if(USB_DRIVER.state == USB_ACTIVE) {
+    wait_sof();
+  }
+#endif /* REPORT_SOF_SYNC */
+  keyboard_task();
+#ifdef RAW_ENABLE
+  raw_hid_task();
+#endif
+  eeprom_task();
+}
+
+#ifdef REPORT_THREAD
+static THD_FUNCTION(scanThread, arg) {
+  (void)arg;
+  chRegSetThreadName("scan");
+
+  while(true) {
+    systime_t start = chVTGetSystemTimeX();
+    keyboard_loop();
+    thread_stats_add(&scan_stats, start);
+    /* let report thread and lower ones run; wait_sof() blocks while USB is active */
+#ifdef REPORT_SOF_SYNC
+    if(USB_DRIVER.state != USB_ACTIVE)
+#endif /* REPORT_SOF_SYNC */
+    chThdSleepMilliseconds(1);
+  }
+}
+#endif /* REPORT_THREAD */
+
 
 /* Main thread
  */
@@ -116,47 +404,36 @@ int main(void) {
   /* init printf */
   init_printf(NULL,sendchar_pf);
 
-  /* Wait until the USB is active */
-  while(USB_DRIVER.state != USB_ACTIVE)
-    chThdSleepMilliseconds(50);
-
-  /* Do need to wait here!
-   * Otherwise the next print might start a transfer on console EP
-   * before the USB is completely ready, which sometimes causes
-   * HardFaults.
-   */
-  chThdSleepMilliseconds(50);
-
-  print("USB configured.\n");
-
-  /* init TMK modules */
+  /* init TMK modules while host enumerates device
+   * Reports and prints are dropped until USB is active, current state of
+   * keys is sent when it gets active. */
   keyboard_init();
+#ifdef REPORT_THREAD
+  chPoolLoadArray(&report_pool, report_msg_buf, REPORT_MAILBOX_SIZE);
+  chThdCreateStatic(waReportThread, sizeof(waReportThread), NORMALPRIO, reportThread, NULL);
+  host_set_driver(&mailbox_driver);
+#else /* REPORT_THREAD */
   host_set_driver(&chibios_driver);
+#endif /* REPORT_THREAD */
 
 #ifdef SLEEP_LED_ENABLE
   sleep_led_init();
 #endif
 
-  print("Keyboard start.\n");
-
   hook_late_init();
 
+  init_time = timer_read();
+
+#ifdef REPORT_THREAD
+  chThdCreateStatic(waScanThread, sizeof(waScanThread), NORMALPRIO + 1, scanThread, NULL);
+  /* main thread has nothing to do */
+  while(true) {
+    chThdSleepMilliseconds(1000);
+  }
+#else /* REPORT_THREAD */
   /* Main loop */
   while(true) {
-
-    if(USB_DRIVER.state == USB_SUSPENDED) {
-      print("[s]");
-      while(USB_DRIVER.state == USB_SUSPENDED) {
-        hook_usb_suspend_loop();
-      }
-      /* Woken up */
-      // variables have been already cleared
-      send_keyboard_report();
-#ifdef MOUSEKEY_ENABLE
-      mousekey_send();
-#endif /* MOUSEKEY_ENABLE */
-    }
-
-    keyboard_task();
+    keyboard_loop();
   }
+#endif /* REPORT_THREAD */
 }
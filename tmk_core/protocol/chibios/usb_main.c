@@ -28,6 +28,11 @@
 #include "led.h"
 #endif
 #include "hook.h"
+#include "report_queue.h"
+#ifdef RAW_ENABLE
+#include <string.h>
+#include "raw_hid.h"
+#endif
 
 /* TMK hooks */
 __attribute__((weak))
@@ -63,6 +68,10 @@ extern bool keyboard_nkro;
 #endif /* NKRO_ENABLE */
 
 report_keyboard_t keyboard_report_sent = {{0}};
+#ifdef MOUSE_EXT_REPORT
+/* 0: boot protocol(8-bit X/Y), 1: report protocol(16-bit X/Y) */
+uint8_t mouse_protocol __attribute__((aligned(2))) = 1;
+#endif /* MOUSE_EXT_REPORT */
 #ifdef MOUSE_ENABLE
 report_mouse_t mouse_report_blank = {0};
 #endif /* MOUSE_ENABLE */
@@ -70,6 +79,49 @@ report_mouse_t mouse_report_blank = {0};
 uint8_t extra_report_blank[3] = {0};
 #endif /* EXTRAKEY_ENABLE */
 
+/* Report queue of IN endpoint
+ * One report is in flight and up to REPORT_QUEUE_SIZE reports wait in queue,
+ * so that a quick press and release between polls reach host both. send_*
+ * functions never block; when the queue is full the newest report is
+ * overwritten so that latest state always wins. Head of the queue is
+ * started by IN callback, or by SOF callback with REPORT_SOF_SYNC. */
+typedef union {
+  report_keyboard_t keyboard;
+#ifdef MOUSE_ENABLE
+  report_mouse_t mouse;
+#ifdef MOUSE_EXT_REPORT
+  report_mouse_boot_t mouse_boot;
+#endif /* MOUSE_EXT_REPORT */
+#endif /* MOUSE_ENABLE */
+#ifdef EXTRAKEY_ENABLE
+  report_extra_t extra;
+#endif /* EXTRAKEY_ENABLE */
+} report_buf_t;
+
+typedef struct {
+  report_buf_t tx;          /* report in flight */
+  report_buf_t buf[REPORT_QUEUE_SIZE];
+  uint8_t size[REPORT_QUEUE_SIZE];
+  report_queue_t queue;     /* time is system tick when queued */
+} report_fifo_t;
+
+static report_fifo_t kbd_reports;
+#ifdef NKRO_ENABLE
+static report_fifo_t nkro_reports;
+#endif /* NKRO_ENABLE */
+#ifdef MOUSE_ENABLE
+static report_fifo_t mouse_reports;
+#endif /* MOUSE_ENABLE */
+#ifdef EXTRAKEY_ENABLE
+static report_fifo_t extra_reports;
+#endif /* EXTRAKEY_ENABLE */
+
+#ifdef REPORT_SOF_SYNC
+/* Pending reports are committed to endpoints in SOF callback. Main loop
+ * waits for SOF with wait_sof() to scan once per frame right after SOF. */
+static binary_semaphore_t sof_sem;
+#endif /* REPORT_SOF_SYNC */
+
 #ifdef CONSOLE_ENABLE
 /* The emission buffers queue */
 output_buffers_queue_t console_buf_queue;
@@ -80,6 +132,14 @@ void console_queue_onotify(io_buffers_queue_t *bqp);
 static void console_flush_cb(void *arg);
 #endif /* CONSOLE_ENABLE */
 
+#ifdef RAW_ENABLE
+/* IN buffers: one in flight, one pending */
+static uint8_t raw_in_buf[2][RAW_EPSIZE];
+static uint8_t raw_in_tx;
+static volatile bool raw_in_pending;
+static uint8_t raw_out_buf[RAW_EPSIZE];
+#endif /* RAW_ENABLE */
+
 /* ---------------------------------------------------------
  *            Descriptors and USB driver objects
  * ---------------------------------------------------------
@@ -237,10 +297,17 @@ static const uint8_t mouse_hid_report_desc_data[] = {
   0x05, 0x01,                      //     USAGE_PAGE (Generic Desktop)
   0x09, 0x30,                      //     USAGE (X)
   0x09, 0x31,                      //     USAGE (Y)
+#ifdef MOUSE_EXT_REPORT
+  0x16, 0x01, 0x80,                //     LOGICAL_MINIMUM (-32767)
+  0x26, 0xff, 0x7f,                //     LOGICAL_MAXIMUM (32767)
+  0x75, 0x10,                      //     REPORT_SIZE (16)
+  0x95, 0x02,                      //     REPORT_COUNT (2)
+#else
   0x15, 0x81,                      //     LOGICAL_MINIMUM (-127)
   0x25, 0x7f,                      //     LOGICAL_MAXIMUM (127)
   0x75, 0x08,                      //     REPORT_SIZE (8)
   0x95, 0x02,                      //     REPORT_COUNT (2)
+#endif
   0x81, 0x06,                      //     INPUT (Data,Var,Rel)
                                    // ----------------------------  Vertical wheel
   0x09, 0x38,                      //     USAGE (Wheel)
@@ -327,6 +394,32 @@ static const USBDescriptor extra_hid_report_descriptor = {
 };
 #endif /* EXTRAKEY_ENABLE */
 
+#ifdef RAW_ENABLE
+static const uint8_t raw_hid_report_desc_data[] = {
+  0x06, 0x60, 0xFF, // Usage Page 0xFF60 (vendor defined)
+  0x09, 0x61,       // Usage 0x61
+  0xA1, 0x01,       // Collection (Application)
+  0x09, 0x62,       //   usage
+  0x15, 0x00,       //   logical minimum = 0
+  0x26, 0xFF, 0x00, //   logical maximum = 255
+  0x95, RAW_EPSIZE, //   report count
+  0x75, 0x08,       //   report size = 8 bits
+  0x81, 0x02,       //   Input (Data, Variable, Absolute)
+  0x09, 0x63,       //   usage
+  0x15, 0x00,       //   logical minimum = 0
+  0x26, 0xFF, 0x00, //   logical maximum = 255
+  0x95, RAW_EPSIZE, //   report count
+  0x75, 0x08,       //   report size = 8 bits
+  0x91, 0x02,       //   Output (Data, Variable, Absolute)
+  0xC0              // end collection
+};
+/* wrapper */
+static const USBDescriptor raw_hid_report_descriptor = {
+  sizeof raw_hid_report_desc_data,
+  raw_hid_report_desc_data
+};
+#endif /* RAW_ENABLE */
+
 
 /*
  * Configuration Descriptor tree for a HID device
@@ -368,8 +461,18 @@ static const USBDescriptor extra_hid_report_descriptor = {
 #   define NKRO_HID_DESC_NUM            (EXTRA_HID_DESC_NUM + 0)
 #endif /* NKRO_ENABLE */
 
-#define NUM_INTERFACES                  (NKRO_HID_DESC_NUM + 1)
-#define CONFIG1_DESC_SIZE               (9 + (9 + 9 + 7) * NUM_INTERFACES)
+/* raw hid has OUT endpoint in addition; place it last not to shift offsets */
+#ifdef RAW_ENABLE
+#   define RAW_HID_DESC_NUM             (NKRO_HID_DESC_NUM + 1)
+#   define RAW_HID_DESC_OFFSET          (9 + (9 + 9 + 7) * RAW_HID_DESC_NUM + 9)
+#   define RAW_OUT_DESC_SIZE            7
+#else /* RAW_ENABLE */
+#   define RAW_HID_DESC_NUM             (NKRO_HID_DESC_NUM + 0)
+#   define RAW_OUT_DESC_SIZE            0
+#endif /* RAW_ENABLE */
+
+#define NUM_INTERFACES                  (RAW_HID_DESC_NUM + 1)
+#define CONFIG1_DESC_SIZE               (9 + (9 + 9 + 7) * NUM_INTERFACES + RAW_OUT_DESC_SIZE)
 
 static const uint8_t hid_configuration_descriptor_data[] = {
   /* Configuration Descriptor (9 bytes) USB spec 9.6.3, page 264-266, Table 9-10 */
@@ -402,7 +505,7 @@ static const uint8_t hid_configuration_descriptor_data[] = {
   USB_DESC_ENDPOINT(KBD_ENDPOINT | 0x80,  // bEndpointAddress
                     0x03,      // bmAttributes (Interrupt)
                     KBD_EPSIZE,// wMaxPacketSize
-                    10),       // bInterval
+                    USB_POLLING_INTERVAL_MS),   // bInterval
 
   #ifdef MOUSE_ENABLE
   /* Interface Descriptor (9 bytes) USB spec 9.6.5, page 267-269, Table 9-12 */
@@ -484,7 +587,7 @@ static const uint8_t hid_configuration_descriptor_data[] = {
   USB_DESC_ENDPOINT(EXTRA_ENDPOINT | 0x80,  // bEndpointAddress
                     0x03,      // bmAttributes (Interrupt)
                     EXTRA_EPSIZE, // wMaxPacketSize
-                    10),       // bInterval
+                    USB_POLLING_INTERVAL_MS),   // bInterval
   #endif /* EXTRAKEY_ENABLE */
 
   #ifdef NKRO_ENABLE
@@ -512,6 +615,38 @@ static const uint8_t hid_configuration_descriptor_data[] = {
                     NKRO_EPSIZE, // wMaxPacketSize
                     1),       // bInterval
   #endif /* NKRO_ENABLE */
+
+  #ifdef RAW_ENABLE
+  /* Interface Descriptor (9 bytes) USB spec 9.6.5, page 267-269, Table 9-12 */
+  USB_DESC_INTERFACE(RAW_INTERFACE, // bInterfaceNumber
+                     0,        // bAlternateSetting
+                     2,        // bNumEndpoints
+                     0x03,     // bInterfaceClass: HID
+                     0x00,     // bInterfaceSubClass: None
+                     0x00,     // bInterfaceProtocol: None
+                     0),       // iInterface
+
+  /* HID descriptor (9 bytes) HID 1.11 spec, section 6.2.1 */
+  USB_DESC_BYTE(9),            // bLength
+  USB_DESC_BYTE(0x21),         // bDescriptorType (HID class)
+  USB_DESC_BCD(0x0111),        // bcdHID: HID version 1.11
+  USB_DESC_BYTE(0),            // bCountryCode
+  USB_DESC_BYTE(1),            // bNumDescriptors
+  USB_DESC_BYTE(0x22),         // bDescriptorType (report desc)
+  USB_DESC_WORD(sizeof(raw_hid_report_desc_data)), // wDescriptorLength
+
+  /* Endpoint Descriptor (7 bytes) USB spec 9.6.6, page 269-271, Table 9-13 */
+  USB_DESC_ENDPOINT(RAW_ENDPOINT | 0x80,  // bEndpointAddress
+                    0x03,      // bmAttributes (Interrupt)
+                    RAW_EPSIZE, // wMaxPacketSize
+                    1),        // bInterval
+
+  /* Endpoint Descriptor (7 bytes) USB spec 9.6.6, page 269-271, Table 9-13 */
+  USB_DESC_ENDPOINT(RAW_ENDPOINT,  // bEndpointAddress
+                    0x03,      // bmAttributes (Interrupt)
+                    RAW_EPSIZE, // wMaxPacketSize
+                    1),        // bInterval
+  #endif /* RAW_ENABLE */
 };
 
 /* Configuration Descriptor wrapper */
@@ -550,6 +685,12 @@ static const USBDescriptor nkro_hid_descriptor = {
   &hid_configuration_descriptor_data[NKRO_HID_DESC_OFFSET]
 };
 #endif /* NKRO_ENABLE */
+#ifdef RAW_ENABLE
+static const USBDescriptor raw_hid_descriptor = {
+  HID_DESCRIPTOR_SIZE,
+  &hid_configuration_descriptor_data[RAW_HID_DESC_OFFSET]
+};
+#endif /* RAW_ENABLE */
 
 
 /* U.S. English language identifier */
@@ -656,6 +797,10 @@ static const USBDescriptor *usb_get_descriptor_cb(USBDriver *usbp, uint8_t dtype
     case NKRO_INTERFACE:
       return &nkro_hid_descriptor;
 #endif /* NKRO_ENABLE */
+#ifdef RAW_ENABLE
+    case RAW_INTERFACE:
+      return &raw_hid_descriptor;
+#endif /* RAW_ENABLE */
     }
 
   case USB_DESCRIPTOR_HID_REPORT:       /* HID Report Descriptor */
@@ -679,6 +824,10 @@ static const USBDescriptor *usb_get_descriptor_cb(USBDriver *usbp, uint8_t dtype
     case NKRO_INTERFACE:
       return &nkro_hid_report_descriptor;
 #endif /* NKRO_ENABLE */
+#ifdef RAW_ENABLE
+    case RAW_INTERFACE:
+      return &raw_hid_report_descriptor;
+#endif /* RAW_ENABLE */
     }
   }
   return NULL;
@@ -776,17 +925,60 @@ static const USBEndpointConfig nkro_ep_config = {
 };
 #endif /* NKRO_ENABLE */
 
+#ifdef RAW_ENABLE
+/* raw hid endpoint state structures */
+static USBInEndpointState raw_ep_in_state;
+static USBOutEndpointState raw_ep_out_state;
+
+/* raw hid endpoint initialization structure (IN and OUT) */
+static const USBEndpointConfig raw_ep_config = {
+  USB_EP_MODE_TYPE_INTR,        /* Interrupt EP */
+  NULL,                         /* SETUP packet notification callback */
+  raw_in_cb,                    /* IN notification callback */
+  raw_out_cb,                   /* OUT notification callback */
+  RAW_EPSIZE,                   /* IN maximum packet size */
+  RAW_EPSIZE,                   /* OUT maximum packet size */
+  &raw_ep_in_state,             /* IN Endpoint state */
+  &raw_ep_out_state,            /* OUT endpoint state */
+  2,                            /* IN multiplier */
+  NULL                          /* SETUP buffer (not a SETUP endpoint) */
+};
+#endif /* RAW_ENABLE */
+
 /* ---------------------------------------------------------
  *                  USB driver functions
  * ---------------------------------------------------------
  */
 
+/* Drops queued reports of IN endpoints; host doesn't take them while
+ * suspended, and *_ready() must not wait for them after wakeup.
+ * called in locked state */
+static void report_clear_i(void) {
+  kbd_reports.queue.count = 0;
+#ifdef NKRO_ENABLE
+  nkro_reports.queue.count = 0;
+#endif /* NKRO_ENABLE */
+#ifdef MOUSE_ENABLE
+  mouse_reports.queue.count = 0;
+#endif /* MOUSE_ENABLE */
+#ifdef EXTRAKEY_ENABLE
+  extra_reports.queue.count = 0;
+#endif /* EXTRAKEY_ENABLE */
+#ifdef RAW_ENABLE
+  raw_in_pending = false;
+#endif /* RAW_ENABLE */
+}
+
 /* Handles the USB driver global events
  * TODO: maybe disable some things when connection is lost? */
 static void usb_event_cb(USBDriver *usbp, usbevent_t event) {
   switch(event) {
   case USB_EVENT_RESET:
     //TODO: from ISR! print("[R]");
+#ifdef MOUSE_EXT_REPORT
+    /* HID device returns to report protocol on bus reset */
+    mouse_protocol = 1;
+#endif /* MOUSE_EXT_REPORT */
     return;
 
   case USB_EVENT_ADDRESS:
@@ -794,6 +986,10 @@ static void usb_event_cb(USBDriver *usbp, usbevent_t event) {
 
   case USB_EVENT_CONFIGURED:
     osalSysLockFromISR();
+    report_clear_i();
+#ifdef MOUSE_EXT_REPORT
+    mouse_protocol = 1;
+#endif /* MOUSE_EXT_REPORT */
     /* Enable the endpoints specified into the configuration. */
     usbInitEndpointI(usbp, KBD_ENDPOINT, &kbd_ep_config);
 #ifdef MOUSE_ENABLE
@@ -809,16 +1005,26 @@ static void usb_event_cb(USBDriver *usbp, usbevent_t event) {
 #ifdef NKRO_ENABLE
     usbInitEndpointI(usbp, NKRO_ENDPOINT, &nkro_ep_config);
 #endif /* NKRO_ENABLE */
+#ifdef RAW_ENABLE
+    usbInitEndpointI(usbp, RAW_ENDPOINT, &raw_ep_config);
+    usbStartReceiveI(usbp, RAW_ENDPOINT, raw_out_buf, RAW_EPSIZE);
+#endif /* RAW_ENABLE */
     osalSysUnlockFromISR();
     return;
 
   case USB_EVENT_SUSPEND:
     //TODO: from ISR! print("[S]");
+    osalSysLockFromISR();
+    report_clear_i();
+    osalSysUnlockFromISR();
     hook_usb_suspend_entry();
     return;
 
   case USB_EVENT_WAKEUP:
     //TODO: from ISR! print("[W]");
+    osalSysLockFromISR();
+    report_clear_i();
+    osalSysUnlockFromISR();
     suspend_wakeup_init();
     hook_usb_wakeup();
     return;
@@ -927,6 +1133,12 @@ static bool usb_request_hook_cb(USBDriver *usbp) {
           usbSetupTransfer(usbp, &keyboard_protocol, 1, NULL);
           return TRUE;
         }
+#if defined(MOUSE_ENABLE) && defined(MOUSE_EXT_REPORT)
+        if((usbp->setup[4] == MOUSE_INTERFACE) && (usbp->setup[5] == 0)) {   /* wIndex */
+          usbSetupTransfer(usbp, &mouse_protocol, 1, NULL);
+          return TRUE;
+        }
+#endif /* MOUSE_ENABLE && MOUSE_EXT_REPORT */
         break;
 
       case HID_GET_IDLE:
@@ -967,6 +1179,11 @@ static bool usb_request_hook_cb(USBDriver *usbp) {
             osalSysUnlockFromISR();
           }
         }
+#if defined(MOUSE_ENABLE) && defined(MOUSE_EXT_REPORT)
+        if((usbp->setup[4] == MOUSE_INTERFACE) && (usbp->setup[5] == 0)) {   /* wIndex */
+          mouse_protocol = ((usbp->setup[2]) != 0x00);   /* LSB(wValue) */
+        }
+#endif /* MOUSE_ENABLE && MOUSE_EXT_REPORT */
         usbSetupTransfer(usbp, NULL, 0, NULL);
         return TRUE;
         break;
@@ -1032,6 +1249,9 @@ void init_usb_driver(USBDriver *usbp) {
   usbConnectBus(usbp);
 
   chVTObjectInit(&keyboard_idle_timer);
+#ifdef REPORT_SOF_SYNC
+  chBSemObjectInit(&sof_sem, true);
+#endif /* REPORT_SOF_SYNC */
 #ifdef CONSOLE_ENABLE
   obqObjectInit(&console_buf_queue, true, console_queue_buffer, CONSOLE_EPSIZE, CONSOLE_QUEUE_CAPACITY, console_queue_onotify, (void*)usbp);
   chVTObjectInit(&console_flush_timer);
@@ -1064,29 +1284,95 @@ void send_remote_wakeup(USBDriver *usbp) {
  * ---------------------------------------------------------
  */
 
-/* keyboard IN callback hander (a kbd report has made it IN) */
-void kbd_in_cb(USBDriver *usbp, usbep_t ep) {
-  /* STUB */
+/* starts transmit of head of the queue if endpoint is free
+ * called in locked state */
+static void report_start_i(USBDriver *usbp, usbep_t ep, report_fifo_t *r) {
+  if(!r->queue.count || usbGetTransmitStatusI(usbp, ep)) {
+    return;
+  }
+  uint8_t i = r->queue.head;
+  size_t size = r->size[i];
+  memcpy(&r->tx, &r->buf[i], size);
+#ifdef REPORT_SOF_SYNC
+  report_sof_stats_add(ST2US((uint16_t)(chVTGetSystemTimeX() - r->queue.time[i])));
+#endif /* REPORT_SOF_SYNC */
+  report_queue_pop(&r->queue);
+  usbStartTransmitI(usbp, ep, (uint8_t *)&r->tx, size);
+}
+
+/* puts report into the queue, overwriting newest one when full, and starts
+ * it unless reports are committed at SOF
+ * called in locked state */
+static void report_queue_i(USBDriver *usbp, usbep_t ep, report_fifo_t *r, const void *report, size_t size) {
+  uint8_t i = report_queue_push(&r->queue);
+  memcpy(&r->buf[i], report, size);
+  r->size[i] = size;
+#ifdef REPORT_SOF_SYNC
   (void)usbp;
   (void)ep;
+  r->queue.time[i] = chVTGetSystemTimeX();
+#else /* REPORT_SOF_SYNC */
+  report_start_i(usbp, ep, r);
+#endif /* REPORT_SOF_SYNC */
+}
+
+/* IN callback: starts next report in the queue */
+static void report_in_cb(USBDriver *usbp, usbep_t ep, report_fifo_t *r) {
+#ifdef REPORT_SOF_SYNC
+  /* committed in SOF callback */
+  (void)usbp;
+  (void)ep;
+  (void)r;
+#else /* REPORT_SOF_SYNC */
+  osalSysLockFromISR();
+  report_start_i(usbp, ep, r);
+  osalSysUnlockFromISR();
+#endif /* REPORT_SOF_SYNC */
+}
+
+/* keyboard IN callback hander (a kbd report has made it IN) */
+void kbd_in_cb(USBDriver *usbp, usbep_t ep) {
+  report_in_cb(usbp, ep, &kbd_reports);
 }
 
 #ifdef NKRO_ENABLE
 /* nkro IN callback hander (a nkro report has made it IN) */
 void nkro_in_cb(USBDriver *usbp, usbep_t ep) {
-  /* STUB */
-  (void)usbp;
-  (void)ep;
+  report_in_cb(usbp, ep, &nkro_reports);
 }
 #endif /* NKRO_ENABLE */
 
 /* start-of-frame handler
- * TODO: i guess it would be better to re-implement using timers,
- *  so that this is not going to have to be checked every 1ms */
+ * commits queued reports with REPORT_SOF_SYNC */
 void kbd_sof_cb(USBDriver *usbp) {
+#ifdef REPORT_SOF_SYNC
+  osalSysLockFromISR();
+  if(usbGetDriverStateI(usbp) == USB_ACTIVE) {
+    report_start_i(usbp, KBD_ENDPOINT, &kbd_reports);
+#ifdef NKRO_ENABLE
+    report_start_i(usbp, NKRO_ENDPOINT, &nkro_reports);
+#endif /* NKRO_ENABLE */
+#ifdef MOUSE_ENABLE
+    report_start_i(usbp, MOUSE_ENDPOINT, &mouse_reports);
+#endif /* MOUSE_ENABLE */
+#ifdef EXTRAKEY_ENABLE
+    report_start_i(usbp, EXTRA_ENDPOINT, &extra_reports);
+#endif /* EXTRAKEY_ENABLE */
+  }
+  chBSemSignalI(&sof_sem);
+  osalSysUnlockFromISR();
+#else /* REPORT_SOF_SYNC */
   (void)usbp;
+#endif /* REPORT_SOF_SYNC */
 }
 
+#ifdef REPORT_SOF_SYNC
+/* waits for next SOF, times out when host doesn't send SOF */
+void wait_sof(void) {
+  chBSemWaitTimeout(&sof_sem, MS2ST(2));
+}
+#endif /* REPORT_SOF_SYNC */
+
 /* Idle requests timer code
  * callback (called from ISR, unlocked state) */
 static void keyboard_idle_timer_cb(void *arg) {
@@ -1107,7 +1393,9 @@ static void keyboard_idle_timer_cb(void *arg) {
   if(keyboard_idle) {
 #endif /* NKRO_ENABLE */
     /* TODO: are we sure we want the KBD_ENDPOINT? */
-    if(!usbGetTransmitStatusI(usbp, KBD_ENDPOINT)) {
+    /* keyboard_report_sent is the newest queued report; it is the last one
+     * transmitted only when nothing is left in the queue */
+    if(!kbd_reports.queue.count && !usbGetTransmitStatusI(usbp, KBD_ENDPOINT)) {
       usbStartTransmitI(usbp, KBD_ENDPOINT, (uint8_t *)&keyboard_report_sent, KBD_EPSIZE);
     }
     /* rearm the timer */
@@ -1124,50 +1412,40 @@ uint8_t keyboard_leds(void) {
   return (uint8_t)(keyboard_led_stats & 0xFF);
 }
 
-/* prepare and start sending a report IN
- * not callable from ISR or locked state */
+/* queues report; never blocks, newest report is overwritten when the queue
+ * is full. not callable from ISR or locked state */
 void send_keyboard(report_keyboard_t *report) {
   osalSysLock();
   if(usbGetDriverStateI(&USB_DRIVER) != USB_ACTIVE) {
     osalSysUnlock();
     return;
   }
-  osalSysUnlock();
 
 #ifdef NKRO_ENABLE
   if(keyboard_nkro) {  /* NKRO protocol */
-    /* need to wait until the previous packet has made it through */
-    /* can rewrite this using the synchronous API, then would wait
-     * until *after* the packet has been transmitted. I think
-     * this is more efficient */
-    /* busy wait, should be short and not very common */
-    osalSysLock();
-    if(usbGetTransmitStatusI(&USB_DRIVER, NKRO_ENDPOINT)) {
-      /* Need to either suspend, or loop and call unlock/lock during
-       * every iteration - otherwise the system will remain locked,
-       * no interrupts served, so USB not going through as well.
-       * Note: for suspend, need USB_USE_WAIT == TRUE in halconf.h */
-      osalThreadSuspendS(&(&USB_DRIVER)->epc[NKRO_ENDPOINT]->in_state->thread);
-    }
-    usbStartTransmitI(&USB_DRIVER, NKRO_ENDPOINT, (uint8_t *)report, sizeof(report_keyboard_t));
-    osalSysUnlock();
+    report_queue_i(&USB_DRIVER, NKRO_ENDPOINT, &nkro_reports, report, sizeof(report_keyboard_t));
   } else
 #endif /* NKRO_ENABLE */
   { /* boot protocol */
-    /* need to wait until the previous packet has made it through */
-    /* busy wait, should be short and not very common */
-    osalSysLock();
-    if(usbGetTransmitStatusI(&USB_DRIVER, KBD_ENDPOINT)) {
-      /* Need to either suspend, or loop and call unlock/lock during
-       * every iteration - otherwise the system will remain locked,
-       * no interrupts served, so USB not going through as well.
-       * Note: for suspend, need USB_USE_WAIT == TRUE in halconf.h */
-      osalThreadSuspendS(&(&USB_DRIVER)->epc[KBD_ENDPOINT]->in_state->thread);
-    }
-    usbStartTransmitI(&USB_DRIVER, KBD_ENDPOINT, (uint8_t *)report, KBD_EPSIZE);
-    osalSysUnlock();
+    report_queue_i(&USB_DRIVER, KBD_ENDPOINT, &kbd_reports, report, KBD_EPSIZE);
   }
   keyboard_report_sent = *report;
+  osalSysUnlock();
+}
+
+/* false while next report would overwrite the newest one in the queue */
+bool keyboard_ready(void) {
+  bool ready = true;
+  osalSysLock();
+  if(usbGetDriverStateI(&USB_DRIVER) == USB_ACTIVE) {
+#ifdef NKRO_ENABLE
+    ready = (keyboard_nkro ? nkro_reports.queue.count : kbd_reports.queue.count) < REPORT_QUEUE_SIZE;
+#else /* NKRO_ENABLE */
+    ready = kbd_reports.queue.count < REPORT_QUEUE_SIZE;
+#endif /* NKRO_ENABLE */
+  }
+  osalSysUnlock();
+  return ready;
 }
 
 /* ---------------------------------------------------------
@@ -1179,32 +1457,50 @@ void send_keyboard(report_keyboard_t *report) {
 
 /* mouse IN callback hander (a mouse report has made it IN) */
 void mouse_in_cb(USBDriver *usbp, usbep_t ep) {
-  (void)usbp;
-  (void)ep;
+  report_in_cb(usbp, ep, &mouse_reports);
 }
 
+/* queues report; never blocks, newest report is overwritten when the queue
+ * is full. Host in boot protocol gets 8-bit report(MOUSE_EXT_REPORT) */
 void send_mouse(report_mouse_t *report) {
   osalSysLock();
   if(usbGetDriverStateI(&USB_DRIVER) != USB_ACTIVE) {
     osalSysUnlock();
     return;
   }
+#ifdef MOUSE_EXT_REPORT
+  if(!mouse_protocol) {
+    report_mouse_boot_t boot;
+    report_mouse_boot(&boot, report);
+    report_queue_i(&USB_DRIVER, MOUSE_ENDPOINT, &mouse_reports, &boot, sizeof(report_mouse_boot_t));
+    osalSysUnlock();
+    return;
+  }
+#endif /* MOUSE_EXT_REPORT */
+  report_queue_i(&USB_DRIVER, MOUSE_ENDPOINT, &mouse_reports, report, sizeof(report_mouse_t));
   osalSysUnlock();
+}
 
-  /* TODO: LUFA manually waits for the endpoint to become ready
-   * for about 10ms for mouse, kbd, system; 1ms for nkro
-   * is this really needed?
-   */
-
+/* host.c holds and merges mouse reports while this returns false; motion
+ * is merged rather than queued, so only one report waits at a time */
+bool mouse_ready(void) {
+  bool ready = true;
   osalSysLock();
-  usbStartTransmitI(&USB_DRIVER, MOUSE_ENDPOINT, (uint8_t *)report, sizeof(report_mouse_t));
+  if(usbGetDriverStateI(&USB_DRIVER) == USB_ACTIVE) {
+    ready = mouse_reports.queue.count == 0;
+  }
   osalSysUnlock();
+  return ready;
 }
 
 #else /* MOUSE_ENABLE */
 void send_mouse(report_mouse_t *report) {
   (void)report;
 }
+
+bool mouse_ready(void) {
+  return true;
+}
 #endif /* MOUSE_ENABLE */
 
 /* ---------------------------------------------------------
@@ -1216,9 +1512,7 @@ void send_mouse(report_mouse_t *report) {
 
 /* extrakey IN callback hander */
 void extra_in_cb(USBDriver *usbp, usbep_t ep) {
-  /* STUB */
-  (void)usbp;
-  (void)ep;
+  report_in_cb(usbp, ep, &extra_reports);
 }
 
 static void send_extra_report(uint8_t report_id, uint16_t data) {
@@ -1233,8 +1527,19 @@ static void send_extra_report(uint8_t report_id, uint16_t data) {
     .usage = data
   };
 
-  usbStartTransmitI(&USB_DRIVER, EXTRA_ENDPOINT, (uint8_t *)&report, sizeof(report_extra_t));
+  report_queue_i(&USB_DRIVER, EXTRA_ENDPOINT, &extra_reports, &report, sizeof(report_extra_t));
+  osalSysUnlock();
+}
+
+/* false while next report would overwrite the newest one in the queue */
+bool extra_ready(void) {
+  bool ready = true;
+  osalSysLock();
+  if(usbGetDriverStateI(&USB_DRIVER) == USB_ACTIVE) {
+    ready = extra_reports.queue.count < REPORT_QUEUE_SIZE;
+  }
   osalSysUnlock();
+  return ready;
 }
 
 void send_system(uint16_t data) {
@@ -1252,6 +1557,9 @@ void send_system(uint16_t data) {
 void send_consumer(uint16_t data) {
   (void)data;
 }
+bool extra_ready(void) {
+  return true;
+}
 #endif /* EXTRAKEY_ENABLE */
 
 /* ---------------------------------------------------------
@@ -1379,6 +1687,59 @@ int8_t sendchar(uint8_t c) {
 }
 #endif /* CONSOLE_ENABLE */
 
+/* ---------------------------------------------------------
+ *                   Raw HID functions
+ * ---------------------------------------------------------
+ */
+
+#ifdef RAW_ENABLE
+
+/* starts transmit of pending raw report if endpoint is free
+ * called in locked state */
+static void raw_start_i(USBDriver *usbp, usbep_t ep) {
+  if(!raw_in_pending || usbGetTransmitStatusI(usbp, ep)) {
+    return;
+  }
+  raw_in_tx ^= 1;
+  raw_in_pending = false;
+  usbStartTransmitI(usbp, ep, raw_in_buf[raw_in_tx], RAW_EPSIZE);
+}
+
+/* raw hid IN callback hander (a report has made it IN): starts pending one
+ * called from ISR, unlocked state */
+void raw_in_cb(USBDriver *usbp, usbep_t ep) {
+  osalSysLockFromISR();
+  raw_start_i(usbp, ep);
+  osalSysUnlockFromISR();
+}
+
+/* raw hid OUT callback hander (a request has arrived)
+ * called from ISR, unlocked state */
+void raw_out_cb(USBDriver *usbp, usbep_t ep) {
+  osalSysLockFromISR();
+  raw_hid_receive(raw_out_buf, usbGetReceiveTransactionSizeX(usbp, ep));
+  /* rearm for next request */
+  usbStartReceiveI(usbp, ep, raw_out_buf, RAW_EPSIZE);
+  osalSysUnlockFromISR();
+}
+
+/* queues report IN behind one in transit, returns false if a report is
+ * already waiting; raw_in_cb() starts it */
+bool raw_hid_send(const uint8_t *data) {
+  osalSysLock();
+  if(usbGetDriverStateI(&USB_DRIVER) != USB_ACTIVE || raw_in_pending) {
+    osalSysUnlock();
+    return false;
+  }
+  memcpy(raw_in_buf[raw_in_tx ^ 1], data, RAW_EPSIZE);
+  raw_in_pending = true;
+  raw_start_i(&USB_DRIVER, RAW_ENDPOINT);
+  osalSysUnlock();
+  return true;
+}
+
+#endif /* RAW_ENABLE */
+
 void sendchar_pf(void *p, char c) {
   (void)p;
   sendchar((uint8_t)c);
@@ -39,6 +39,11 @@ void init_usb_driver(USBDriver *usbp);
 /* Send remote wakeup packet */
 void send_remote_wakeup(USBDriver *usbp);
 
+/* polling interval(ms) of boot keyboard and extrakey endpoints */
+#ifndef USB_POLLING_INTERVAL_MS
+#define USB_POLLING_INTERVAL_MS 10
+#endif
+
 /* ---------------
  * Keyboard header
  * ---------------
@@ -66,6 +71,11 @@ void kbd_in_cb(USBDriver *usbp, usbep_t ep);
 /* start-of-frame handler */
 void kbd_sof_cb(USBDriver *usbp);
 
+#ifdef REPORT_SOF_SYNC
+/* waits for next SOF; not callable from ISR */
+void wait_sof(void);
+#endif /* REPORT_SOF_SYNC */
+
 #ifdef NKRO_ENABLE
 /* nkro IN callback hander */
 void nkro_in_cb(USBDriver *usbp, usbep_t ep);
@@ -134,6 +144,29 @@ void console_flush_output(void);
 void console_in_cb(USBDriver *usbp, usbep_t ep);
 #endif /* CONSOLE_ENABLE */
 
+/* --------------
+ * Raw HID header
+ * --------------
+ */
+
+#ifdef RAW_ENABLE
+
+#define RAW_INTERFACE          5
+#define RAW_ENDPOINT           6
+/* RAW_EPSIZE is defined in raw_hid.h */
+
+/* raw hid IN request callback handler */
+void raw_in_cb(USBDriver *usbp, usbep_t ep);
+
+/* raw hid OUT request callback handler */
+void raw_out_cb(USBDriver *usbp, usbep_t ep);
+#endif /* RAW_ENABLE */
+
 void sendchar_pf(void *p, char c);
 
+#ifdef REPORT_THREAD
+/* loop time and stack usage of scan and report threads(main.c) */
+void thread_stats_print(void);
+#endif /* REPORT_THREAD */
+
 #endif /* _USB_MAIN_H_ */
@@ -36,6 +36,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "host_driver.h"
 #include "iwrap.h"
 #include "print.h"
+#include "timer.h"
 
 
 /* iWRAP MUX mode utils. 3.10 HID raw mode(iWRAP_HID_Application_Note.pdf) */
@@ -51,6 +52,24 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 static uint8_t connected = 0;
 //static uint8_t channel = 1;
 
+/* Link state
+ * While disconnected reports are not sent but latest state of keyboard,
+ * consumer and mouse buttons is kept. When iwrap_check_connection() finds
+ * link up again the state is sent at once to release keys stuck on host. */
+static report_keyboard_t link_keyboard;
+#ifdef EXTRAKEY_ENABLE
+static uint16_t link_consumer = 0;
+#endif
+#if defined(MOUSEKEY_ENABLE) || defined(PS2_MOUSE_ENABLE)
+static uint8_t link_buttons = 0;
+#endif
+// reconnections and time(ms) from LIST to resync report sent
+static uint16_t link_reconnects = 0;
+static uint16_t link_resync_last = 0;
+static uint16_t link_resync_max = 0;
+
+static void link_resync(uint16_t start);
+
 /* iWRAP buffer */
 #define MUX_BUF_SIZE 64
 static char buf[MUX_BUF_SIZE];
@@ -290,6 +309,8 @@ uint8_t iwrap_connected(void)
 
 uint8_t iwrap_check_connection(void)
 {
+    uint8_t prev = connected;
+    uint16_t t = timer_read();
     iwrap_mux_send("LIST");
     _delay_ms(100);
 
@@ -297,9 +318,19 @@ uint8_t iwrap_check_connection(void)
         connected = 0;
     else
         connected = 1;
+
+    if (!prev && connected)
+        link_resync(t);
     return connected;
 }
 
+void iwrap_link_print(void)
+{
+    xprintf("link: %s reconnects: %u resync: %ums(max: %ums)\n",
+            connected ? "up" : "down", link_reconnects,
+            link_resync_last, link_resync_max);
+}
+
 
 /*------------------------------------------------------------------*
  * Host driver
@@ -327,9 +358,8 @@ static uint8_t keyboard_leds(void) {
     return 0;
 }
 
-static void send_keyboard(report_keyboard_t *report)
+static void xmit_keyboard(report_keyboard_t *report)
 {
-    if (!iwrap_connected() && !iwrap_check_connection()) return;
     MUX_HEADER(0x01, 0x0c);
     // HID raw mode header
     xmit(0x9f);
@@ -347,10 +377,9 @@ static void send_keyboard(report_keyboard_t *report)
     MUX_FOOTER(0x01);
 }
 
-static void send_mouse(report_mouse_t *report)
-{
 #if defined(MOUSEKEY_ENABLE) || defined(PS2_MOUSE_ENABLE)
-    if (!iwrap_connected() && !iwrap_check_connection()) return;
+static void xmit_mouse(report_mouse_t *report)
+{
     MUX_HEADER(0x01, 0x09);
     // HID raw mode header
     xmit(0x9f);
@@ -358,31 +387,21 @@ static void send_mouse(report_mouse_t *report)
     xmit(0xa1); // DATA(Input)
     xmit(0x02); // Report ID
     xmit(report->buttons);
-    xmit(report->x);
-    xmit(report->y);
+    xmit(mouse_clamp8(report->x));
+    xmit(mouse_clamp8(report->y));
     xmit(report->v);
     xmit(report->h);
     MUX_FOOTER(0x01);
-#endif
-}
-
-static void send_system(uint16_t data)
-{
-    /* not supported */
 }
+#endif
 
-static void send_consumer(uint16_t data)
-{
 #ifdef EXTRAKEY_ENABLE
-    static uint16_t last_data = 0;
+static void xmit_consumer(uint16_t data)
+{
     uint8_t bits1 = 0;
     uint8_t bits2 = 0;
     uint8_t bits3 = 0;
 
-    if (!iwrap_connected() && !iwrap_check_connection()) return;
-    if (data == last_data) return;
-    last_data = data;
-
     // 3.10 HID raw mode(iWRAP_HID_Application_Note.pdf)
     switch (data) {
         case AUDIO_VOL_UP:
@@ -465,5 +484,63 @@ static void send_consumer(uint16_t data)
     xmit(bits2);
     xmit(bits3);
     MUX_FOOTER(0x01);
+}
+#endif
+
+static void link_resync(uint16_t start)
+{
+    xmit_keyboard(&link_keyboard);
+#ifdef EXTRAKEY_ENABLE
+    if (link_consumer) xmit_consumer(link_consumer);
+#endif
+#if defined(MOUSEKEY_ENABLE) || defined(PS2_MOUSE_ENABLE)
+    if (link_buttons) {
+        report_mouse_t mouse = { .buttons = link_buttons };
+        xmit_mouse(&mouse);
+    }
+#endif
+    link_reconnects++;
+    link_resync_last = timer_elapsed(start);
+    if (link_resync_last > link_resync_max)
+        link_resync_max = link_resync_last;
+}
+
+/* true when report can be sent now
+ * On reconnection resync already sent the latest state. */
+static bool link_ready(void)
+{
+    if (iwrap_connected()) return true;
+    iwrap_check_connection();
+    return false;
+}
+
+static void send_keyboard(report_keyboard_t *report)
+{
+    link_keyboard = *report;
+    if (!link_ready()) return;
+    xmit_keyboard(report);
+}
+
+static void send_mouse(report_mouse_t *report)
+{
+#if defined(MOUSEKEY_ENABLE) || defined(PS2_MOUSE_ENABLE)
+    link_buttons = report->buttons;
+    if (!link_ready()) return;
+    xmit_mouse(report);
+#endif
+}
+
+static void send_system(uint16_t data)
+{
+    /* not supported */
+}
+
+static void send_consumer(uint16_t data)
+{
+#ifdef EXTRAKEY_ENABLE
+    if (data == link_consumer) return;
+    link_consumer = data;
+    if (!link_ready()) return;
+    xmit_consumer(data);
 #endif
 }
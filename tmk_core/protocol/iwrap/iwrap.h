@@ -45,5 +45,7 @@ void iwrap_subrate(void);
 bool iwrap_failed(void);
 uint8_t iwrap_connected(void);
 uint8_t iwrap_check_connection(void);
+/* link state and reconnect-to-resync time */
+void iwrap_link_print(void);
 
 #endif
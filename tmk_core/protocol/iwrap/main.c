@@ -264,6 +264,7 @@ static bool console_command(uint8_t c)
             print("w: BT mode. switch to Bluetooth.\n");
 #endif
             print("k: kill first connection.\n");
+            print("s: link status and resync time.\n");
             print("Del: unpair first pairing.\n");
             print("\n");
             return 0;
@@ -306,6 +307,9 @@ static bool console_command(uint8_t c)
             print("kill\n");
             iwrap_kill();
             return 1;
+        case 's':
+            iwrap_link_print();
+            return 1;
         case 0x7F:  // DELETE
             print("unpair\n");
             iwrap_unpair();
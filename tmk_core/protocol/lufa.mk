@@ -14,6 +14,7 @@ else
 endif
 
 LUFA_SRC = $(LUFA_DIR)/lufa.c \
+	   protocol/report_queue.c \
 	   $(LUFA_DIR)/descriptor.c \
 	   $(LUFA_SRC_USB)
 
@@ -22,6 +23,8 @@ SRC += $(LUFA_SRC)
 # Search Path
 VPATH += $(TMK_DIR)/$(LUFA_DIR)
 VPATH += $(TMK_DIR)/$(LUFA_PATH)
+# report_queue.c and report_queue.h
+VPATH += $(TMK_DIR)/protocol
 
 # Option modules
 #ifdef $(or MOUSEKEY_ENABLE, PS2_MOUSE_ENABLE)
@@ -34,6 +37,7 @@ VPATH += $(TMK_DIR)/$(LUFA_PATH)
 LUFA_OPTS  = -DUSB_DEVICE_ONLY
 LUFA_OPTS += -DUSE_FLASH_DESCRIPTORS
 LUFA_OPTS += -DUSE_STATIC_OPTIONS="(USB_DEVICE_OPT_FULLSPEED | USB_OPT_REG_ENABLED | USB_OPT_AUTO_PLL)"
+# Process control requests in ISR; keyboard_init() then runs while host enumerates
 #LUFA_OPTS += -DINTERRUPT_CONTROL_ENDPOINT
 LUFA_OPTS += -DFIXED_CONTROL_ENDPOINT_SIZE=8 
 LUFA_OPTS += -DFIXED_NUM_CONFIGURATIONS=1
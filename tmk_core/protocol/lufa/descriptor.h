@@ -46,6 +46,9 @@
 
 #include <LUFA/Drivers/USB/USB.h>
 #include <avr/pgmspace.h>
+#ifdef RAW_ENABLE
+#include "raw_hid.h"
+#endif
 
 
 typedef struct
@@ -85,6 +88,14 @@ typedef struct
     USB_HID_Descriptor_HID_t              NKRO_HID;
     USB_Descriptor_Endpoint_t             NKRO_INEndpoint;
 #endif
+
+#ifdef RAW_ENABLE
+    // Raw HID Interface
+    // Output reports come through control endpoint(SET_REPORT) to save endpoint
+    USB_Descriptor_Interface_t            Raw_Interface;
+    USB_HID_Descriptor_HID_t              Raw_HID;
+    USB_Descriptor_Endpoint_t             Raw_INEndpoint;
+#endif
 } USB_Descriptor_Configuration_t;
 
 
@@ -115,9 +126,15 @@ typedef struct
 #   define NKRO_INTERFACE           CONSOLE_INTERFACE
 #endif
 
+#ifdef RAW_ENABLE
+#   define RAW_INTERFACE            (NKRO_INTERFACE + 1)
+#else
+#   define RAW_INTERFACE            NKRO_INTERFACE
+#endif
+
 
 /* nubmer of interfaces */
-#define TOTAL_INTERFACES            (NKRO_INTERFACE + 1)
+#define TOTAL_INTERFACES            (RAW_INTERFACE + 1)
 
 
 // Endopoint number and size
@@ -148,6 +165,15 @@ typedef struct
 #   if defined(__AVR_ATmega32U2__) && NKRO_IN_EPNUM > 4
 #       error "Endpoints are not available enough to support all functions. Remove some in Makefile.(MOUSEKEY, EXTRAKEY, CONSOLE, NKRO)"
 #   endif
+#else
+#   define NKRO_IN_EPNUM            CONSOLE_OUT_EPNUM
+#endif
+
+#ifdef RAW_ENABLE
+#   define RAW_IN_EPNUM             (NKRO_IN_EPNUM + 1)
+#   if (defined(__AVR_ATmega32U2__) && RAW_IN_EPNUM > 4) || RAW_IN_EPNUM > 6
+#       error "Endpoints are not available enough to support all functions. Remove some in Makefile.(MOUSEKEY, EXTRAKEY, CONSOLE, NKRO, RAW)"
+#   endif
 #endif
 
 
@@ -157,6 +183,11 @@ typedef struct
 #define CONSOLE_EPSIZE              32
 #define NKRO_EPSIZE                 32
 
+/* polling interval(ms) of boot keyboard, mouse and extrakey endpoints */
+#ifndef USB_POLLING_INTERVAL_MS
+#define USB_POLLING_INTERVAL_MS     10
+#endif
+
 
 uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue,
                                     const uint8_t wIndex,
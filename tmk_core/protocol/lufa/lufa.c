@@ -43,7 +43,15 @@
 #include "action.h"
 #include "led.h"
 #include "sendchar.h"
+#ifdef BINLOG_ENABLE
+#include "binlog.h"
+#endif
 #include "debug.h"
+#include "timer.h"
+#ifdef REPORT_SOF_SYNC
+#include <util/delay.h>
+#include "avr/timer_avr.h"
+#endif
 #ifdef SLEEP_LED_ENABLE
 #include "sleep_led.h"
 #endif
@@ -56,6 +64,7 @@
 
 #include "matrix.h"
 #include "descriptor.h"
+#include "report_queue.h"
 #include "lufa.h"
 
 
@@ -66,9 +75,18 @@ uint8_t keyboard_idle = 0;
 /* 0: Boot Protocol, 1: Report Protocol(default) */
 uint8_t keyboard_protocol = 1;
 static uint8_t keyboard_led_stats = 0;
+#ifdef MOUSE_EXT_REPORT
+/* 0: Boot Protocol(8-bit X/Y), 1: Report Protocol(16-bit X/Y, default) */
+uint8_t mouse_protocol = 1;
+#endif
 
 static report_keyboard_t keyboard_report_sent;
 
+static void send_queued_reports(void);
+#ifdef REPORT_SOF_SYNC
+static volatile uint8_t sof_count = 0;
+#endif
+
 
 /* Host driver */
 static uint8_t keyboard_leds(void);
@@ -76,12 +94,14 @@ static void send_keyboard(report_keyboard_t *report);
 static void send_mouse(report_mouse_t *report);
 static void send_system(uint16_t data);
 static void send_consumer(uint16_t data);
+static bool mouse_ready(void);
 host_driver_t lufa_driver = {
     keyboard_leds,
     send_keyboard,
     send_mouse,
     send_system,
-    send_consumer
+    send_consumer,
+    mouse_ready
 };
 
 
@@ -89,12 +109,54 @@ host_driver_t lufa_driver = {
  * Console
  ******************************************************************************/
 #ifdef CONSOLE_ENABLE
+/*
+ * Console output buffer
+ *
+ * sendchar() puts a char into this buffer without waiting for the endpoint
+ * and SOF handler moves it into console endpoint. Chars are dropped and
+ * counted in console_dropped when the buffer is full, for example while no
+ * console is listening on host. Binary log frame is queued whole or not at
+ * all, so partial packet padded with zero ends at a frame boundary.
+ */
+#ifndef CONSOLE_BUFFER_SIZE
+#define CONSOLE_BUFFER_SIZE     128
+#endif
+#if (CONSOLE_BUFFER_SIZE > 255)
+#   error "CONSOLE_BUFFER_SIZE must not exceed 255"
+#endif
+/* partial packet is sent after this number of frames(ms) */
+#ifndef CONSOLE_FLUSH_FRAMES
+#define CONSOLE_FLUSH_FRAMES    10
+#endif
+
+static uint8_t console_buf[CONSOLE_BUFFER_SIZE];
+static volatile uint8_t console_head = 0;
+static volatile uint8_t console_tail = 0;
+uint16_t console_dropped = 0;
+
+static inline uint8_t console_count(void)
+{
+    return (console_head + CONSOLE_BUFFER_SIZE - console_tail) % CONSOLE_BUFFER_SIZE;
+}
+
+/* called from SOF handler every 1ms */
 static void Console_Task(void)
 {
+    static uint8_t frames = 0;
+
     /* Device must be connected and configured for the task to run */
     if (USB_DeviceState != DEVICE_STATE_Configured)
         return;
 
+    uint8_t count = console_count();
+    if (count == 0) {
+        frames = 0;
+        return;
+    }
+    // wait for full packet for a while
+    if (count < CONSOLE_EPSIZE && ++frames < CONSOLE_FLUSH_FRAMES)
+        return;
+
     uint8_t ep = Endpoint_GetCurrentEndpoint();
 
 #if 0
@@ -124,19 +186,25 @@ static void Console_Task(void)
 
     /* IN packet */
     Endpoint_SelectEndpoint(CONSOLE_IN_EPNUM);
-    if (!Endpoint_IsEnabled() || !Endpoint_IsConfigured()) {
+    if (!Endpoint_IsEnabled() || !Endpoint_IsConfigured() || !Endpoint_IsReadWriteAllowed()) {
         Endpoint_SelectEndpoint(ep);
         return;
     }
 
-    // fill empty bank
-    while (Endpoint_IsReadWriteAllowed())
-        Endpoint_Write_8(0);
-
-    // flash senchar packet
-    if (Endpoint_IsINReady()) {
-        Endpoint_ClearIN();
+    uint8_t tail = console_tail;
+    for (uint8_t i = 0; i < CONSOLE_EPSIZE; i++) {
+        if (count) {
+            Endpoint_Write_8(console_buf[tail]);
+            tail = (tail + 1) % CONSOLE_BUFFER_SIZE;
+            count--;
+        } else {
+            // fill empty bank
+            Endpoint_Write_8(0);
+        }
     }
+    Endpoint_ClearIN();
+    console_tail = tail;
+    frames = 0;
 
     Endpoint_SelectEndpoint(ep);
 }
@@ -187,6 +255,10 @@ void EVENT_USB_Device_Reset(void)
 #ifdef LUFA_DEBUG
     print("[R]");
 #endif
+#ifdef MOUSE_EXT_REPORT
+    /* HID device returns to Report Protocol on bus reset */
+    mouse_protocol = 1;
+#endif
 }
 
 void EVENT_USB_Device_Suspend()
@@ -205,22 +277,17 @@ void EVENT_USB_Device_WakeUp()
     hook_usb_wakeup();
 }
 
-#ifdef CONSOLE_ENABLE
-static bool console_flush = false;
-#define CONSOLE_FLUSH_SET(b)   do { \
-    uint8_t sreg = SREG; cli(); console_flush = b; SREG = sreg; \
-} while (0)
-
+#if defined(CONSOLE_ENABLE) || defined(REPORT_SOF_SYNC)
 // called every 1ms
 void EVENT_USB_Device_StartOfFrame(void)
 {
-    static uint8_t count;
-    if (++count % 50) return;
-    count = 0;
-
-    if (!console_flush) return;
+#ifdef REPORT_SOF_SYNC
+    uint8_t ep = Endpoint_GetCurrentEndpoint();
+    send_queued_reports();
+    Endpoint_SelectEndpoint(ep);
+    sof_count++;
+#endif
     Console_Task();
-    console_flush = false;
 }
 #endif
 
@@ -237,6 +304,10 @@ void EVENT_USB_Device_ConfigurationChanged(void)
 #endif
     bool ConfigSuccess = true;
 
+#ifdef MOUSE_EXT_REPORT
+    mouse_protocol = 1;
+#endif
+
     /* Setup Keyboard HID Report Endpoints */
     ConfigSuccess &= ENDPOINT_CONFIG(KEYBOARD_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
                                      KEYBOARD_EPSIZE, ENDPOINT_BANK_SINGLE);
@@ -268,6 +339,12 @@ void EVENT_USB_Device_ConfigurationChanged(void)
     ConfigSuccess &= ENDPOINT_CONFIG(NKRO_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
                                      NKRO_EPSIZE, ENDPOINT_BANK_SINGLE);
 #endif
+
+#ifdef RAW_ENABLE
+    /* Setup Raw HID Report Endpoint */
+    ConfigSuccess &= ENDPOINT_CONFIG(RAW_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
+                                     RAW_EPSIZE, ENDPOINT_BANK_SINGLE);
+#endif
 }
 
 /*
@@ -341,6 +418,20 @@ void EVENT_USB_Device_ControlRequest(void)
                     xprintf("[L%d]", USB_ControlRequest.wIndex);
 #endif
                     break;
+#ifdef RAW_ENABLE
+                case RAW_INTERFACE:
+                {
+                    uint8_t data[RAW_EPSIZE];
+                    uint8_t len = USB_ControlRequest.wLength;
+                    if (USB_ControlRequest.wLength > RAW_EPSIZE) break;
+
+                    Endpoint_ClearSETUP();
+                    Endpoint_Read_Control_Stream_LE(data, len);
+                    Endpoint_ClearStatusStage();
+                    raw_hid_receive(data, len);
+                    break;
+                }
+#endif
                 }
 
             }
@@ -360,6 +451,15 @@ void EVENT_USB_Device_ControlRequest(void)
                     print("[p]");
 #endif
                 }
+#if defined(MOUSE_ENABLE) && defined(MOUSE_EXT_REPORT)
+                if (USB_ControlRequest.wIndex == MOUSE_INTERFACE) {
+                    Endpoint_ClearSETUP();
+                    while (!(Endpoint_IsINReady()));
+                    Endpoint_Write_8(mouse_protocol);
+                    Endpoint_ClearIN();
+                    Endpoint_ClearStatusStage();
+                }
+#endif
             }
 
             break;
@@ -376,6 +476,14 @@ void EVENT_USB_Device_ControlRequest(void)
                     print("[P]");
 #endif
                 }
+#if defined(MOUSE_ENABLE) && defined(MOUSE_EXT_REPORT)
+                if (USB_ControlRequest.wIndex == MOUSE_INTERFACE) {
+                    Endpoint_ClearSETUP();
+                    Endpoint_ClearStatusStage();
+
+                    mouse_protocol = (USB_ControlRequest.wValue & 0xFF);
+                }
+#endif
             }
 
             break;
@@ -417,109 +525,211 @@ static uint8_t keyboard_leds(void)
     return keyboard_led_stats;
 }
 
-static void send_keyboard(report_keyboard_t *report)
+/*
+ * Report queue
+ *
+ * send_* functions don't wait for endpoint bank. When the bank still holds
+ * previous report new one is queued and sent from main loop after host takes
+ * it, that is, a report per polling interval. When the queue is full the
+ * newest entry is replaced so that host gets the latest state. The queue is
+ * handled by report_sender_t of report_queue.c.
+ * Reports made before configuration are also queued so that keys pressed
+ * during startup reach host.
+ *
+ * With REPORT_SOF_SYNC send_* functions only stage reports in the queue and
+ * SOF handler commits them to endpoints, so that reports are written at the
+ * same point of frame regardless of when they are made. Main loop scans
+ * matrix once per frame right after SOF(and REPORT_SOF_SCAN_DELAY us) so
+ * that the report is ready for the next SOF. Latency from staging to commit
+ * is recorded in report_sof_stats.
+ */
+#ifndef REPORT_SOF_SCAN_DELAY
+#define REPORT_SOF_SCAN_DELAY   0
+#endif
+
+#ifdef REPORT_SOF_SYNC
+/* reports are written only in SOF handler */
+#define SEND_DIRECT     false
+
+/* microseconds from Timer0 of common/avr/timer.c; wraps around in 65ms */
+uint16_t report_time_us(void)
 {
-    uint8_t timeout = 255;
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t ms = timer_count;
+    uint8_t raw = TIMER_RAW;
+    // compare match not serviced yet
+    if ((TIFR0 & (1<<OCF0A)) && raw < TIMER_RAW_TOP) ms++;
+    SREG = sreg;
+    return ms * 1000 + (uint16_t)((uint32_t)raw * 1000 / (TIMER_RAW_TOP + 1));
+}
+#else
+#define SEND_DIRECT     (USB_DeviceState == DEVICE_STATE_Configured)
+#endif
 
-    if (USB_DeviceState != DEVICE_STATE_Configured)
-        return;
+/* Writes report if endpoint bank is free */
+static bool write_report(uint8_t ep, const void *report, uint8_t size)
+{
+    Endpoint_SelectEndpoint(ep);
+    if (!Endpoint_IsReadWriteAllowed()) return false;
+
+    Endpoint_Write_Stream_LE(report, size, NULL);
+
+    /* Finalize the stream transfer to send the last packet */
+    Endpoint_ClearIN();
+    return true;
+}
 
-    /* Select the Keyboard Report Endpoint */
+static bool write_keyboard(const void *report)
+{
+    bool sent;
 #ifdef NKRO_ENABLE
     if (keyboard_protocol && keyboard_nkro) {
         /* Report protocol - NKRO */
-        Endpoint_SelectEndpoint(NKRO_IN_EPNUM);
-
-        /* Check if write ready for a polling interval around 1ms */
-        while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(8);
-        if (!Endpoint_IsReadWriteAllowed()) return;
-
-        /* Write Keyboard Report Data */
-        Endpoint_Write_Stream_LE(report, NKRO_EPSIZE, NULL);
+        sent = write_report(NKRO_IN_EPNUM, report, NKRO_EPSIZE);
     }
     else
 #endif
     {
         /* Boot protocol */
-        Endpoint_SelectEndpoint(KEYBOARD_IN_EPNUM);
+        sent = write_report(KEYBOARD_IN_EPNUM, report, KEYBOARD_EPSIZE);
+    }
+    if (sent) keyboard_report_sent = *(const report_keyboard_t *)report;
+    return sent;
+}
 
-        /* Check if write ready for a polling interval around 10ms */
-        while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(40);
-        if (!Endpoint_IsReadWriteAllowed()) return;
+static report_keyboard_t keyboard_queue_buf[REPORT_QUEUE_SIZE];
+static report_sender_t keyboard_sender = {
+    .buf = keyboard_queue_buf,
+    .size = sizeof(report_keyboard_t),
+    .write = write_keyboard
+};
 
-        /* Write Keyboard Report Data */
-        Endpoint_Write_Stream_LE(report, KEYBOARD_EPSIZE, NULL);
+#ifdef MOUSE_ENABLE
+static bool write_mouse(const void *report)
+{
+#ifdef MOUSE_EXT_REPORT
+    if (!mouse_protocol) {
+        report_mouse_boot_t boot;
+        report_mouse_boot(&boot, report);
+        return write_report(MOUSE_IN_EPNUM, &boot, sizeof(report_mouse_boot_t));
     }
+#endif
+    return write_report(MOUSE_IN_EPNUM, report, sizeof(report_mouse_t));
+}
 
-    /* Finalize the stream transfer to send the last packet */
-    Endpoint_ClearIN();
+static report_mouse_t mouse_queue_buf[REPORT_QUEUE_SIZE];
+static report_sender_t mouse_sender = {
+    .buf = mouse_queue_buf,
+    .size = sizeof(report_mouse_t),
+    .write = write_mouse
+};
+#endif
 
-    keyboard_report_sent = *report;
+#ifdef EXTRAKEY_ENABLE
+static bool write_extra(const void *report)
+{
+    return write_report(EXTRAKEY_IN_EPNUM, report, sizeof(report_extra_t));
 }
 
-static void send_mouse(report_mouse_t *report)
+static report_extra_t extra_queue_buf[REPORT_QUEUE_SIZE];
+static report_sender_t extra_sender = {
+    .buf = extra_queue_buf,
+    .size = sizeof(report_extra_t),
+    .write = write_extra
+};
+#endif
+
+#ifdef RAW_ENABLE
+bool raw_hid_send(const uint8_t *data)
 {
-#ifdef MOUSE_ENABLE
-    uint8_t timeout = 255;
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return false;
+    return write_report(RAW_IN_EPNUM, (void *)data, RAW_EPSIZE);
+}
+#endif
 
+/* Sends one queued report of each endpoint if its bank is free
+ * called from SOF handler with REPORT_SOF_SYNC */
+static void send_queued_reports(void)
+{
     if (USB_DeviceState != DEVICE_STATE_Configured)
         return;
 
-    /* Select the Mouse Report Endpoint */
-    Endpoint_SelectEndpoint(MOUSE_IN_EPNUM);
+    report_send_queued(&keyboard_sender);
+#ifdef MOUSE_ENABLE
+    report_send_queued(&mouse_sender);
+#endif
+#ifdef EXTRAKEY_ENABLE
+    report_send_queued(&extra_sender);
+#endif
+}
 
-    /* Check if write ready for a polling interval around 10ms */
-    while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(40);
-    if (!Endpoint_IsReadWriteAllowed()) return;
+static void send_keyboard(report_keyboard_t *report)
+{
+    if (USB_DeviceState == DEVICE_STATE_Suspended)
+        return;
 
-    /* Write Mouse Report Data */
-    Endpoint_Write_Stream_LE(report, sizeof(report_mouse_t), NULL);
+    if (USB_DeviceState == DEVICE_STATE_Configured)
+        suspend_report_sent();
+    report_send(&keyboard_sender, report, SEND_DIRECT);
+}
 
-    /* Finalize the stream transfer to send the last packet */
-    Endpoint_ClearIN();
+/* host.c holds and merges mouse reports while this returns false */
+static bool mouse_ready(void)
+{
+#ifdef MOUSE_ENABLE
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return USB_DeviceState == DEVICE_STATE_Suspended;
+    if (mouse_sender.queue.count)
+        return false;
+#ifdef REPORT_SOF_SYNC
+    return true;
+#else
+    Endpoint_SelectEndpoint(MOUSE_IN_EPNUM);
+    return Endpoint_IsReadWriteAllowed();
+#endif
+#else
+    return true;
 #endif
 }
 
-static void send_system(uint16_t data)
+static void send_mouse(report_mouse_t *report)
 {
-    uint8_t timeout = 255;
-
-    if (USB_DeviceState != DEVICE_STATE_Configured)
+#ifdef MOUSE_ENABLE
+    if (USB_DeviceState == DEVICE_STATE_Suspended)
         return;
 
-    report_extra_t r = {
-        .report_id = REPORT_ID_SYSTEM,
-        .usage = data
-    };
-    Endpoint_SelectEndpoint(EXTRAKEY_IN_EPNUM);
-
-    /* Check if write ready for a polling interval around 10ms */
-    while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(40);
-    if (!Endpoint_IsReadWriteAllowed()) return;
-
-    Endpoint_Write_Stream_LE(&r, sizeof(report_extra_t), NULL);
-    Endpoint_ClearIN();
+    report_send(&mouse_sender, report, SEND_DIRECT);
+#endif
 }
 
-static void send_consumer(uint16_t data)
+#ifdef EXTRAKEY_ENABLE
+static void send_extra(uint8_t report_id, uint16_t data)
 {
-    uint8_t timeout = 255;
-
-    if (USB_DeviceState != DEVICE_STATE_Configured)
+    if (USB_DeviceState == DEVICE_STATE_Suspended)
         return;
 
     report_extra_t r = {
-        .report_id = REPORT_ID_CONSUMER,
+        .report_id = report_id,
         .usage = data
     };
-    Endpoint_SelectEndpoint(EXTRAKEY_IN_EPNUM);
+    report_send(&extra_sender, &r, SEND_DIRECT);
+}
+#endif
 
-    /* Check if write ready for a polling interval around 10ms */
-    while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(40);
-    if (!Endpoint_IsReadWriteAllowed()) return;
+static void send_system(uint16_t data)
+{
+#ifdef EXTRAKEY_ENABLE
+    send_extra(REPORT_ID_SYSTEM, data);
+#endif
+}
 
-    Endpoint_Write_Stream_LE(&r, sizeof(report_extra_t), NULL);
-    Endpoint_ClearIN();
+static void send_consumer(uint16_t data)
+{
+#ifdef EXTRAKEY_ENABLE
+    send_extra(REPORT_ID_CONSUMER, data);
+#endif
 }
 
 
@@ -527,66 +737,50 @@ static void send_consumer(uint16_t data)
  * sendchar
  ******************************************************************************/
 #ifdef CONSOLE_ENABLE
-#define SEND_TIMEOUT 5
 int8_t sendchar(uint8_t c)
 {
 #ifdef LUFA_DEBUG_SUART
     xmit(c);
 #endif
-    // Not wait once timeouted.
-    // Because sendchar() is called so many times, waiting each call causes big lag.
-    static bool timeouted = false;
+    uint8_t sreg = SREG;
+    cli();
 
-    // prevents Console_Task() from running during sendchar() runs.
-    // or char will be lost. These two function is mutually exclusive.
-    CONSOLE_FLUSH_SET(false);
-
-    if (USB_DeviceState != DEVICE_STATE_Configured)
+    uint8_t next = (console_head + 1) % CONSOLE_BUFFER_SIZE;
+    if (next == console_tail) {
+        console_dropped++;
+        SREG = sreg;
         return -1;
-
-    uint8_t ep = Endpoint_GetCurrentEndpoint();
-    Endpoint_SelectEndpoint(CONSOLE_IN_EPNUM);
-    if (!Endpoint_IsEnabled() || !Endpoint_IsConfigured()) {
-        goto ERROR_EXIT;
     }
+    console_buf[console_head] = c;
+    console_head = next;
 
-    if (timeouted && !Endpoint_IsReadWriteAllowed()) {
-        goto ERROR_EXIT;
-    }
+    SREG = sreg;
+    return 0;
+}
 
-    timeouted = false;
+#ifdef BINLOG_ENABLE
+bool binlog_write(const uint8_t *frame, uint8_t len)
+{
+#ifdef LUFA_DEBUG_SUART
+    for (uint8_t i = 0; i < len; i++) xmit(frame[i]);
+#endif
+    uint8_t sreg = SREG;
+    cli();
 
-    uint8_t timeout = SEND_TIMEOUT;
-    while (!Endpoint_IsReadWriteAllowed()) {
-        if (USB_DeviceState != DEVICE_STATE_Configured) {
-            goto ERROR_EXIT;
-        }
-        if (Endpoint_IsStalled()) {
-            goto ERROR_EXIT;
-        }
-        if (!(timeout--)) {
-            timeouted = true;
-            goto ERROR_EXIT;
-        }
-        _delay_ms(1);
+    if (CONSOLE_BUFFER_SIZE - 1 - console_count() < len) {
+        console_dropped++;
+        SREG = sreg;
+        return false;
     }
-
-    Endpoint_Write_8(c);
-
-    // send when bank is full
-    if (!Endpoint_IsReadWriteAllowed()) {
-        while (!(Endpoint_IsINReady()));
-        Endpoint_ClearIN();
-    } else {
-        CONSOLE_FLUSH_SET(true);
+    for (uint8_t i = 0; i < len; i++) {
+        console_buf[console_head] = frame[i];
+        console_head = (console_head + 1) % CONSOLE_BUFFER_SIZE;
     }
 
-    Endpoint_SelectEndpoint(ep);
-    return 0;
-ERROR_EXIT:
-    Endpoint_SelectEndpoint(ep);
-    return -1;
+    SREG = sreg;
+    return true;
 }
+#endif
 #else
 int8_t sendchar(uint8_t c)
 {
@@ -601,6 +795,24 @@ int8_t sendchar(uint8_t c)
 /*******************************************************************************
  * main
  ******************************************************************************/
+#ifdef REPORT_SOF_SYNC
+/* waits for next SOF; times out when host doesn't send SOF */
+static void sof_wait(void)
+{
+    static uint8_t last = 0;
+    uint16_t t = timer_read();
+    while (sof_count == last && timer_elapsed(t) < 2) {
+#if !defined(INTERRUPT_CONTROL_ENDPOINT)
+        USB_USBTask();
+#endif
+    }
+    last = sof_count;
+#if REPORT_SOF_SCAN_DELAY
+    _delay_us(REPORT_SOF_SCAN_DELAY);
+#endif
+}
+#endif
+
 static void setup_mcu(void)
 {
     /* Disable watchdog if enabled by bootloader/fuses */
@@ -636,25 +848,30 @@ int main(void)
 
     hook_early_init();
     keyboard_setup();
+    // for boot timeline; keyboard_init() doesn't reset the count
+    timer_init();
     setup_usb();
     sei();
 
-    /* wait for USB startup & debug output */
+    bool configured = false;
+#if !defined(INTERRUPT_CONTROL_ENDPOINT)
+    /* Control requests are processed in main loop. Blocking device setup in
+     * matrix_init() of converters would stall enumeration, so wait for it. */
     while (USB_DeviceState != DEVICE_STATE_Configured) {
-#if defined(INTERRUPT_CONTROL_ENDPOINT)
-        ;
-#else
         USB_USBTask();
-#endif
     }
-    print("USB configured.\n");
+    configured = true;
+    xprintf("boot: USB configured %ums\n", timer_read());
+#endif
 
-    /* init modules */
+    /* init modules while host enumerates device; reports are queued until
+     * configuration */
     keyboard_init();
     host_set_driver(&lufa_driver);
 #ifdef SLEEP_LED_ENABLE
     sleep_led_init();
 #endif
+    xprintf("boot: keyboard init %ums\n", timer_read());
 
     print("Keyboard start.\n");
     hook_late_init();
@@ -666,7 +883,21 @@ int main(void)
             hook_usb_suspend_loop();
         }
 
+        if (!configured && USB_DeviceState == DEVICE_STATE_Configured) {
+            configured = true;
+            xprintf("boot: USB configured %ums\n", timer_read());
+        }
+
+#ifdef REPORT_SOF_SYNC
+        sof_wait();
+        keyboard_task();
+#else
         keyboard_task();
+        send_queued_reports();
+#endif
+#ifdef RAW_ENABLE
+        raw_hid_task();
+#endif
 
 #if !defined(INTERRUPT_CONTROL_ENDPOINT)
         USB_USBTask();
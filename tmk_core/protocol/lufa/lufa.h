@@ -56,6 +56,11 @@ extern "C" {
 
 extern host_driver_t lufa_driver;
 
+#ifdef CONSOLE_ENABLE
+/* number of chars dropped due to console buffer overflow */
+extern uint16_t console_dropped;
+#endif
+
 #ifdef __cplusplus
 }
 #endif
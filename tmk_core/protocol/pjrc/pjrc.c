@@ -23,6 +23,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "pjrc.h"
 
 
+#ifdef MOUSE_EXT_REPORT
+#   error "MOUSE_EXT_REPORT is supported only on LUFA and ChibiOS"
+#endif
+
+
 /*------------------------------------------------------------------*
  * Host driver
  *------------------------------------------------------------------*/
@@ -400,7 +400,7 @@ static const uint8_t PROGMEM config1_descriptor[CONFIG1_DESC_SIZE] = {
 	KBD_ENDPOINT | 0x80,			// bEndpointAddress
 	0x03,					// bmAttributes (0x03=intr)
 	KBD_SIZE, 0,				// wMaxPacketSize
-	10,					// bInterval
+	USB_POLLING_INTERVAL_MS,		// bInterval
 
 #ifdef MOUSE_ENABLE
 	// interface descriptor, USB spec 9.6.5, page 267-269, Table 9-12
@@ -491,7 +491,7 @@ static const uint8_t PROGMEM config1_descriptor[CONFIG1_DESC_SIZE] = {
 	EXTRA_ENDPOINT | 0x80,			// bEndpointAddress
 	0x03,					// bmAttributes (0x03=intr)
 	EXTRA_SIZE, 0,				// wMaxPacketSize
-	10,					// bInterval
+	USB_POLLING_INTERVAL_MS,		// bInterval
 #endif
 
 #ifdef NKRO_ENABLE
@@ -36,6 +36,11 @@ void usb_init(void);			// initialize everything
 uint8_t usb_configured(void);		// is the USB port configured
 void usb_remote_wakeup(void);
 
+/* polling interval(ms) of boot keyboard and extrakey endpoints */
+#ifndef USB_POLLING_INTERVAL_MS
+#define USB_POLLING_INTERVAL_MS		10
+#endif
+
 
 #define EP_TYPE_CONTROL			0x00
 #define EP_TYPE_BULK_IN			0x81
@@ -29,6 +29,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 static report_mouse_t mouse_report = {};
 
+/* movement not sent yet; PS/2 9-bit data beyond USB range is carried over */
+static int16_t residual_x = 0;
+static int16_t residual_y = 0;
+static uint8_t buttons = 0;
+static uint8_t buttons_prev = 0;
+
 
 static void print_usb_data(void);
 
@@ -56,128 +62,219 @@ uint8_t ps2_mouse_init(void) {
     print("ps2_mouse_init: read DevID: ");
     phex(rcv); phex(ps2_error); print("\n");
 
+#ifdef PS2_MOUSE_STREAM_MODE
+    // send Set Sample Rate
+    rcv = ps2_host_send(PS2_MOUSE_SET_SAMPLE_RATE);
+    if (rcv == PS2_ACK) rcv = ps2_host_send(PS2_MOUSE_SAMPLE_RATE);
+    print("ps2_mouse_init: send 0xF3: ");
+    phex(rcv); phex(ps2_error); print("\n");
+
+    // send Enable Data Reporting
+    rcv = ps2_host_send(PS2_MOUSE_ENABLE_DATA_REPORTING);
+    print("ps2_mouse_init: send 0xF4: ");
+    phex(rcv); phex(ps2_error); print("\n");
+#else
     // send Set Remote mode
-    rcv = ps2_host_send(0xF0);
+    rcv = ps2_host_send(PS2_MOUSE_SET_REMOTE_MODE);
     print("ps2_mouse_init: send 0xF0: ");
     phex(rcv); phex(ps2_error); print("\n");
+#endif
 
     return 0;
 }
 
-#define X_IS_NEG  (mouse_report.buttons & (1<<PS2_MOUSE_X_SIGN))
-#define Y_IS_NEG  (mouse_report.buttons & (1<<PS2_MOUSE_Y_SIGN))
-#define X_IS_OVF  (mouse_report.buttons & (1<<PS2_MOUSE_X_OVFLW))
-#define Y_IS_OVF  (mouse_report.buttons & (1<<PS2_MOUSE_Y_OVFLW))
-void ps2_mouse_task(void)
+/* PS/2 movement is '9-bit integer'(-256 to 255) which is comprised of sign-bit and 8-bit value.
+ * bit: 8    7 ... 0
+ *      sign \8-bit/
+ */
+static int16_t movement(uint8_t data, bool neg, bool ovf)
 {
-    enum { SCROLL_NONE, SCROLL_BTN, SCROLL_SENT };
-    static uint8_t scroll_state = SCROLL_NONE;
-    static uint8_t buttons_prev = 0;
+    if (ovf) return neg ? -256 : 255;
+    return neg ? (int16_t)data - 256 : data;
+}
 
-    /* receives packet from mouse */
-    uint8_t rcv;
-    rcv = ps2_host_send(PS2_MOUSE_READ_DATA);
-    if (rcv == PS2_ACK) {
-        mouse_report.buttons = ps2_host_recv_response();
-        mouse_report.x = ps2_host_recv_response();
-        mouse_report.y = ps2_host_recv_response();
-    } else {
-        if (debug_mouse) print("ps2_mouse: fail to get mouse packet\n");
-        return;
-    }
+/* Meanwhile USB HID mouse indicates 8bit data(-127 to 127), note that -128 is not used.
+ * With MOUSE_EXT_REPORT packet fits in 16bit report as it is.
+ * Movement out of the range is left in residual for next report. */
+static int16_t residual_take(int16_t *residual)
+{
+    int16_t v = *residual;
+    if (v > MOUSE_XY_MAX) v = MOUSE_XY_MAX;
+    if (v < -MOUSE_XY_MAX) v = -MOUSE_XY_MAX;
+    *residual -= v;
+    return v;
+}
 
-    /* if mouse moves or buttons state changes */
-    if (mouse_report.x || mouse_report.y ||
-            ((mouse_report.buttons ^ buttons_prev) & PS2_MOUSE_BTN_MASK)) {
+static void residual_limit(int16_t *residual)
+{
+    if (*residual > PS2_MOUSE_RESIDUAL_MAX) *residual = PS2_MOUSE_RESIDUAL_MAX;
+    if (*residual < -PS2_MOUSE_RESIDUAL_MAX) *residual = -PS2_MOUSE_RESIDUAL_MAX;
+}
 
+static void packet_add(uint8_t status, uint8_t x, uint8_t y)
+{
 #ifdef PS2_MOUSE_DEBUG
-        xprintf("%ud ", timer_read());
-        print("ps2_mouse raw: [");
-        phex(mouse_report.buttons); print("|");
-        print_hex8((uint8_t)mouse_report.x); print(" ");
-        print_hex8((uint8_t)mouse_report.y); print("]\n");
+    xprintf("%ud ", timer_read());
+    print("ps2_mouse raw: [");
+    phex(status); print("|");
+    print_hex8(x); print(" ");
+    print_hex8(y); print("]\n");
 #endif
 
-        buttons_prev = mouse_report.buttons;
+    residual_x += movement(x, status & (1<<PS2_MOUSE_X_SIGN), status & (1<<PS2_MOUSE_X_OVFLW));
+    // invert coordinate of y to conform to USB HID mouse
+    residual_y -= movement(y, status & (1<<PS2_MOUSE_Y_SIGN), status & (1<<PS2_MOUSE_Y_OVFLW));
+    residual_limit(&residual_x);
+    residual_limit(&residual_y);
+
+    // remove sign and overflow flags
+    buttons = status & PS2_MOUSE_BTN_MASK;
+}
 
-        // PS/2 mouse data is '9-bit integer'(-256 to 255) which is comprised of sign-bit and 8-bit value.
-        // bit: 8    7 ... 0
-        //      sign \8-bit/
-        //
-        // Meanwhile USB HID mouse indicates 8bit data(-127 to 127), note that -128 is not used.
-        //
-        // This converts PS/2 data into HID value. Use only -127-127 out of PS/2 9-bit.
-        mouse_report.x = X_IS_NEG ?
-                          ((!X_IS_OVF && -127 <= mouse_report.x && mouse_report.x <= -1) ?  mouse_report.x : -127) :
-                          ((!X_IS_OVF && 0 <= mouse_report.x && mouse_report.x <= 127) ? mouse_report.x : 127);
-        mouse_report.y = Y_IS_NEG ?
-                          ((!Y_IS_OVF && -127 <= mouse_report.y && mouse_report.y <= -1) ?  mouse_report.y : -127) :
-                          ((!Y_IS_OVF && 0 <= mouse_report.y && mouse_report.y <= 127) ? mouse_report.y : 127);
+/* sends report if mouse moves or buttons state changes; returns false when
+ * host.c doesn't take it, then movement and buttons are kept for retry */
+static bool mouse_send(void)
+{
+    enum { SCROLL_NONE, SCROLL_BTN, SCROLL_SENT };
+    static uint8_t scroll_state = SCROLL_NONE;
 
-        // remove sign and overflow flags
-        mouse_report.buttons &= PS2_MOUSE_BTN_MASK;
+    if (!residual_x && !residual_y && buttons == buttons_prev) return true;
 
-        // invert coordinate of y to conform to USB HID mouse
-        mouse_report.y = -mouse_report.y;
+    int16_t x = residual_x, y = residual_y;
+    uint8_t prev = buttons_prev;
+    buttons_prev = buttons;
+    mouse_report.buttons = buttons;
+    mouse_report.x = residual_take(&residual_x);
+    mouse_report.y = residual_take(&residual_y);
 
 
 #if PS2_MOUSE_SCROLL_BTN_MASK
-        static uint16_t scroll_button_time = 0;
-        if ((mouse_report.buttons & (PS2_MOUSE_SCROLL_BTN_MASK)) == (PS2_MOUSE_SCROLL_BTN_MASK)) {
-            if (scroll_state == SCROLL_NONE) {
-                scroll_button_time = timer_read();
-                scroll_state = SCROLL_BTN;
-            }
-
-            // doesn't send Scroll Button
-            //mouse_report.buttons &= ~(PS2_MOUSE_SCROLL_BTN_MASK);
-
-            if (mouse_report.x || mouse_report.y) {
-                scroll_state = SCROLL_SENT;
-
-                mouse_report.v = -mouse_report.y/(PS2_MOUSE_SCROLL_DIVISOR_V);
-                mouse_report.h =  mouse_report.x/(PS2_MOUSE_SCROLL_DIVISOR_H);
-                mouse_report.x = 0;
-                mouse_report.y = 0;
-                //host_mouse_send(&mouse_report);
-            }
+    static uint16_t scroll_button_time = 0;
+    if ((mouse_report.buttons & (PS2_MOUSE_SCROLL_BTN_MASK)) == (PS2_MOUSE_SCROLL_BTN_MASK)) {
+        if (scroll_state == SCROLL_NONE) {
+            scroll_button_time = timer_read();
+            scroll_state = SCROLL_BTN;
+        }
+
+        // doesn't send Scroll Button
+        //mouse_report.buttons &= ~(PS2_MOUSE_SCROLL_BTN_MASK);
+
+        if (mouse_report.x || mouse_report.y) {
+            scroll_state = SCROLL_SENT;
+
+            mouse_report.v = mouse_clamp8(-mouse_report.y/(PS2_MOUSE_SCROLL_DIVISOR_V));
+            mouse_report.h = mouse_clamp8( mouse_report.x/(PS2_MOUSE_SCROLL_DIVISOR_H));
+            mouse_report.x = 0;
+            mouse_report.y = 0;
+            //host_mouse_send(&mouse_report);
         }
-        else if ((mouse_report.buttons & (PS2_MOUSE_SCROLL_BTN_MASK)) == 0) {
+    }
+    else if ((mouse_report.buttons & (PS2_MOUSE_SCROLL_BTN_MASK)) == 0) {
 #if PS2_MOUSE_SCROLL_BTN_SEND
-            if (scroll_state == SCROLL_BTN &&
-                    TIMER_DIFF_16(timer_read(), scroll_button_time) < PS2_MOUSE_SCROLL_BTN_SEND) {
-                // send Scroll Button(down and up at once) when not scrolled
-                mouse_report.buttons |= (PS2_MOUSE_SCROLL_BTN_MASK);
-                host_mouse_send(&mouse_report);
-                _delay_ms(100);
-                mouse_report.buttons &= ~(PS2_MOUSE_SCROLL_BTN_MASK);
-            }
-#endif
-            scroll_state = SCROLL_NONE;
+        if (scroll_state == SCROLL_BTN &&
+                TIMER_DIFF_16(timer_read(), scroll_button_time) < PS2_MOUSE_SCROLL_BTN_SEND) {
+            // send Scroll Button(down and up at once) when not scrolled
+            mouse_report.buttons |= (PS2_MOUSE_SCROLL_BTN_MASK);
+            host_mouse_send(&mouse_report);
+            _delay_ms(100);
+            mouse_report.buttons &= ~(PS2_MOUSE_SCROLL_BTN_MASK);
         }
-        // doesn't send Scroll Button
-        mouse_report.buttons &= ~(PS2_MOUSE_SCROLL_BTN_MASK);
+#endif
+        scroll_state = SCROLL_NONE;
+    }
+    // doesn't send Scroll Button
+    mouse_report.buttons &= ~(PS2_MOUSE_SCROLL_BTN_MASK);
 #endif
 
 
-        host_mouse_send(&mouse_report);
+    bool sent = host_mouse_send(&mouse_report);
+    if (sent) {
         print_usb_data();
+    } else {
+        residual_x = x;
+        residual_y = y;
+        buttons_prev = prev;
     }
+
     // clear report
     mouse_report.x = 0;
     mouse_report.y = 0;
     mouse_report.v = 0;
     mouse_report.h = 0;
     mouse_report.buttons = 0;
+    return sent;
+}
+
+#ifdef PS2_MOUSE_STREAM_MODE
+/* bytes of a packet are sent in a row; partial packet is discarded after this(ms) */
+#define PACKET_TIMEOUT  10
+
+/* assembles packets from bytes received by interrupt */
+void ps2_mouse_task(void)
+{
+    static uint8_t packet[3];
+    static uint8_t index = 0;
+    static uint16_t last_time = 0;
+
+    // button change not taken yet: leave packets in buffer
+    if (buttons != buttons_prev && !mouse_send()) return;
+
+    while (true) {
+        uint8_t data = ps2_host_recv();
+        if (ps2_error == PS2_ERR_NODATA) break;
+
+        if (index && TIMER_DIFF_16(timer_read(), last_time) > PACKET_TIMEOUT) {
+            if (debug_mouse) print("ps2_mouse: packet timeout\n");
+            index = 0;
+        }
+        last_time = timer_read();
+
+        // bit3 of first byte is always 1
+        if (index == 0 && !(data & 0x08)) {
+            if (debug_mouse) print("ps2_mouse: out of sync\n");
+            continue;
+        }
+
+        packet[index++] = data;
+        if (index < 3) continue;
+        index = 0;
+
+        packet_add(packet[0], packet[1], packet[2]);
+        // movement is merged until buttons state changes
+        if (buttons != buttons_prev && !mouse_send()) return;
+    }
+    mouse_send();
+}
+#else
+void ps2_mouse_task(void)
+{
+    /* receives packet from mouse */
+    uint8_t rcv;
+    rcv = ps2_host_send(PS2_MOUSE_READ_DATA);
+    if (rcv == PS2_ACK) {
+        uint8_t status = ps2_host_recv_response();
+        uint8_t x = ps2_host_recv_response();
+        uint8_t y = ps2_host_recv_response();
+        packet_add(status, x, y);
+    } else {
+        if (debug_mouse) print("ps2_mouse: fail to get mouse packet\n");
+    }
+    mouse_send();
 }
+#endif
 
 static void print_usb_data(void)
 {
     if (!debug_mouse) return;
     print("ps2_mouse usb: [");
     phex(mouse_report.buttons); print("|");
+#ifdef MOUSE_EXT_REPORT
+    print_hex16((uint16_t)mouse_report.x); print(" ");
+    print_hex16((uint16_t)mouse_report.y); print(" ");
+#else
     print_hex8((uint8_t)mouse_report.x); print(" ");
     print_hex8((uint8_t)mouse_report.y); print(" ");
+#endif
     print_hex8((uint8_t)mouse_report.v); print(" ");
     print_hex8((uint8_t)mouse_report.h); print("]\n");
 }
@@ -205,7 +302,10 @@ static void print_usb_data(void)
  * Stream Mode: devices sends the data when it changs its state
  * Remote Mode: host polls the data periodically
  *
- * This code uses Remote Mode and polls the data with Read Data(0xEB).
+ * This code uses Remote Mode and polls the data with Read Data(0xEB) by default.
+ * With PS2_MOUSE_STREAM_MODE mouse sends packets at PS2_MOUSE_SAMPLE_RATE and
+ * ps2_mouse_task() assembles them from bytes received by interrupt without
+ * waiting for mouse.
  *
  * Data format:
  * byte|7       6       5       4       3       2       1       0
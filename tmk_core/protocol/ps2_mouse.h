@@ -20,7 +20,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <stdbool.h>
 
-#define PS2_MOUSE_READ_DATA     0xEB
+#define PS2_MOUSE_READ_DATA                 0xEB
+#define PS2_MOUSE_SET_REMOTE_MODE           0xF0
+#define PS2_MOUSE_SET_SAMPLE_RATE           0xF3
+#define PS2_MOUSE_ENABLE_DATA_REPORTING     0xF4
 
 /*
  * Data format:
@@ -60,6 +63,25 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 
 
+/*
+ * Stream mode: define PS2_MOUSE_STREAM_MODE to use
+ * Requires PS2_USE_INT or PS2_USE_USART to receive packets.
+ */
+/* samples per second: 10, 20, 40, 60, 80, 100 or 200 */
+#ifndef PS2_MOUSE_SAMPLE_RATE
+#define PS2_MOUSE_SAMPLE_RATE           100
+#endif
+
+#if defined(PS2_MOUSE_STREAM_MODE) && defined(PS2_USE_BUSYWAIT)
+#   error "PS2_MOUSE_STREAM_MODE requires PS2_USE_INT or PS2_USE_USART"
+#endif
+
+/* limit of movement carried over to next report when it exceeds USB range */
+#ifndef PS2_MOUSE_RESIDUAL_MAX
+#define PS2_MOUSE_RESIDUAL_MAX          1024
+#endif
+
+
 uint8_t ps2_mouse_init(void);
 void ps2_mouse_task(void);
 
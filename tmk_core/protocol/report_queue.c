@@ -0,0 +1,51 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "report_queue.h"
+#ifdef REPORT_SOF_SYNC
+#include "host.h"
+#endif
+
+
+void report_send(report_sender_t *s, const void *report, bool direct)
+{
+    if (direct && s->queue.count == 0 && s->write(report)) return;
+
+    uint8_t sreg = SREG;
+    cli();
+    uint8_t i = report_queue_push(&s->queue);
+#ifdef REPORT_SOF_SYNC
+    s->queue.time[i] = report_time_us();
+#endif
+    memcpy((uint8_t *)s->buf + i * s->size, report, s->size);
+    SREG = sreg;
+}
+
+void report_send_queued(report_sender_t *s)
+{
+    if (!s->queue.count) return;
+    if (!s->write((uint8_t *)s->buf + s->queue.head * s->size)) return;
+
+#ifdef REPORT_SOF_SYNC
+    report_sof_stats_add(report_time_us() - s->queue.time[s->queue.head]);
+#endif
+    report_queue_pop(&s->queue);
+}
@@ -0,0 +1,90 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef REPORT_QUEUE_H
+#define REPORT_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Indexes of report queue
+ *
+ * Reports themselves are kept in array of REPORT_QUEUE_SIZE by user.
+ * When the queue is full the newest entry is overwritten so that host gets
+ * the latest state. Caller needs to disable interrupts when the queue is
+ * also used in ISR.
+ */
+#ifndef REPORT_QUEUE_SIZE
+#define REPORT_QUEUE_SIZE   4
+#endif
+
+typedef struct {
+    uint8_t head;
+    uint8_t count;
+#ifdef REPORT_SOF_SYNC
+    uint16_t time[REPORT_QUEUE_SIZE];
+#endif
+} report_queue_t;
+
+/* index of newest report */
+static inline uint8_t report_queue_last(report_queue_t *q)
+{
+    return (q->head + q->count - 1) % REPORT_QUEUE_SIZE;
+}
+
+/* index of slot for new report; newest one is overwritten when full */
+static inline uint8_t report_queue_push(report_queue_t *q)
+{
+    if (q->count < REPORT_QUEUE_SIZE) q->count++;
+    return report_queue_last(q);
+}
+
+/* removes oldest report at head */
+static inline void report_queue_pop(report_queue_t *q)
+{
+    q->head = (q->head + 1) % REPORT_QUEUE_SIZE;
+    q->count--;
+}
+
+
+/*
+ * Report sender of endpoint
+ *
+ * report_send() writes report to endpoint when nothing is queued, otherwise
+ * puts it into the queue; report_send_queued() writes queued reports in order
+ * one at a time whenever the endpoint takes it.
+ */
+typedef struct {
+    report_queue_t queue;
+    void *buf;          /* array of REPORT_QUEUE_SIZE reports */
+    uint8_t size;       /* size of a report */
+    /* writes report; false when endpoint is busy */
+    bool (*write)(const void *report);
+} report_sender_t;
+
+/* queues report unless 'direct' and it is written at once */
+void report_send(report_sender_t *s, const void *report, bool direct);
+/* writes oldest queued report if endpoint is free; called from ISR with
+ * REPORT_SOF_SYNC */
+void report_send_queued(report_sender_t *s);
+
+#ifdef REPORT_SOF_SYNC
+/* time in us to measure latency of queued reports, provided by protocol */
+uint16_t report_time_us(void);
+#endif
+
+#endif
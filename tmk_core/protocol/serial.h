@@ -44,4 +44,9 @@ uint8_t serial_recv(void);
 int16_t serial_recv2(void);
 void serial_send(uint8_t data);
 
+/* RX error counters(serial_soft.c) */
+extern volatile uint16_t serial_framing_errors;
+extern volatile uint16_t serial_parity_errors;
+extern volatile uint16_t serial_overrun_errors;
+
 #endif
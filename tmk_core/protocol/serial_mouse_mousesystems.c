@@ -104,6 +104,14 @@ void serial_mouse_task(void)
     if (!(buffer[0] & (1 << 0)))
         report.buttons |= MOUSE_BTN2;
 
+#ifdef MOUSE_EXT_REPORT
+    /* both movements of packet fit in one 16-bit report */
+    report.x = (int8_t)buffer[1] + (int8_t)buffer[3];
+    report.y = -(int8_t)buffer[2] - (int8_t)buffer[4];
+
+    print_usb_data(&report);
+    host_mouse_send(&report);
+#else
     /* USB HID uses only values from -127 to 127 */
     report.x = MAX((int8_t)buffer[1], -127);
     report.y = MAX(-(int8_t)buffer[2], -127);
@@ -118,6 +126,7 @@ void serial_mouse_task(void)
         print_usb_data(&report);
         host_mouse_send(&report);
     }
+#endif
 }
 
 static void print_usb_data(const report_mouse_t *report)
@@ -42,15 +42,51 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "serial.h"
 
 /*
- *  Stupid Inefficient Busy-wait Software Serial
+ *  Software Serial
  *  which is still useful for negative logic signal like Sun protocol
  *  if it is not supported by hardware UART.
  *
+ *  RX is interrupt driven: edge of start bit starts timer and timer compare
+ *  interrupt samples each bit at its center, then received data is put into
+ *  ring buffer. Main loop is not blocked while receiving.
+ *  TX is still busy-wait.
+ *
  *  TODO: delay is not accurate enough. Instruction cycle should be counted and inline assemby is needed.
  */
 
 #define WAIT_US     (1000000L/SERIAL_SOFT_BAUD)
 
+/* timer counts of a bit period(prescaler 1) */
+#define BIT_COUNT   (F_CPU/SERIAL_SOFT_BAUD - 1)
+#if (F_CPU/SERIAL_SOFT_BAUD > 65535)
+#   error "SERIAL_SOFT_BAUD is too low for 16bit timer without prescaler."
+#endif
+
+/* Timer for RX bit sampling: 16bit timer in CTC mode
+ * Timer3 is used when available since Timer1 is used by sleep LED and backlight.
+ */
+#ifndef SERIAL_SOFT_TIMER_VECT
+#   if defined(TCCR3A)
+#       define SERIAL_SOFT_TIMER_VECT       TIMER3_COMPA_vect
+#       define SERIAL_SOFT_TIMER_START(t)   do { \
+            TCCR3A = 0; TCNT3 = 0; OCR3A = (t); \
+            TIFR3 = (1<<OCF3A); TIMSK3 |= (1<<OCIE3A); \
+            TCCR3B = (1<<WGM32) | (1<<CS30); \
+        } while (0)
+#       define SERIAL_SOFT_TIMER_SET(t)     (OCR3A = (t))
+#       define SERIAL_SOFT_TIMER_STOP()     do { TCCR3B = 0; TIMSK3 &= ~(1<<OCIE3A); } while (0)
+#   else
+#       define SERIAL_SOFT_TIMER_VECT       TIMER1_COMPA_vect
+#       define SERIAL_SOFT_TIMER_START(t)   do { \
+            TCCR1A = 0; TCNT1 = 0; OCR1A = (t); \
+            TIFR1 = (1<<OCF1A); TIMSK1 |= (1<<OCIE1A); \
+            TCCR1B = (1<<WGM12) | (1<<CS10); \
+        } while (0)
+#       define SERIAL_SOFT_TIMER_SET(t)     (OCR1A = (t))
+#       define SERIAL_SOFT_TIMER_STOP()     do { TCCR1B = 0; TIMSK1 &= ~(1<<OCIE1A); } while (0)
+#   endif
+#endif
+
 #ifdef SERIAL_SOFT_LOGIC_NEGATIVE
     #define SERIAL_SOFT_RXD_IN()        !(SERIAL_SOFT_RXD_READ())
     #define SERIAL_SOFT_TXD_ON()        SERIAL_SOFT_TXD_LO()
@@ -86,11 +122,19 @@ void serial_init(void)
 }
 
 /* RX ring buffer */
-#define RBUF_SIZE   8
+#ifndef SERIAL_SOFT_RXD_BUF_SIZE
+#define SERIAL_SOFT_RXD_BUF_SIZE    16
+#endif
+#define RBUF_SIZE   SERIAL_SOFT_RXD_BUF_SIZE
 static uint8_t rbuf[RBUF_SIZE];
-static uint8_t rbuf_head = 0;
+static volatile uint8_t rbuf_head = 0;
 static uint8_t rbuf_tail = 0;
 
+/* RX error counters */
+volatile uint16_t serial_framing_errors = 0;
+volatile uint16_t serial_parity_errors = 0;
+volatile uint16_t serial_overrun_errors = 0;
+
 
 uint8_t serial_recv(void)
 {
@@ -171,69 +215,90 @@ void serial_send(uint8_t data)
     _delay_us(WAIT_US);
 }
 
+/* RX state: bit being sampled at next timer interrupt */
+#ifdef SERIAL_SOFT_DATA_7BIT
+#   define DATA_BITS    7
+#else
+#   define DATA_BITS    8
+#endif
+#define RX_IDLE         0xFF
+#define RX_START        0
+#define RX_PARITY       (DATA_BITS + 1)     /* stop bit follows */
+
+static volatile uint8_t rx_state = RX_IDLE;
+static uint8_t rx_data;
+static uint8_t rx_parity;
+
 /* detect edge of start bit */
 ISR(SERIAL_SOFT_RXD_VECT)
 {
-    SERIAL_SOFT_DEBUG_TGL();
     SERIAL_SOFT_RXD_INT_ENTER();
 
-    uint8_t data = 0;
-
-#ifdef SERIAL_SOFT_BIT_ORDER_MSB
-    #ifdef SERIAL_SOFT_DATA_7BIT
-    uint8_t mask = 0x40;
-    #else
-    uint8_t mask = 0x80;
-    #endif
-#else
-    uint8_t mask = 0x01;
-#endif
+    // edges in the middle of frame are ignored
+    if (rx_state == RX_IDLE) {
+        SERIAL_SOFT_DEBUG_TGL();
+        rx_state = RX_START;
+        // to center of start bit
+        SERIAL_SOFT_TIMER_START(BIT_COUNT/2);
+    }
 
-    uint8_t parity = 0;
+    SERIAL_SOFT_RXD_INT_EXIT();
+}
 
-    /* to center of start bit */
-    _delay_us(WAIT_US/2);
+/* sample a bit at its center */
+ISR(SERIAL_SOFT_TIMER_VECT)
+{
     SERIAL_SOFT_DEBUG_TGL();
-    do {
-        /* to center of next bit */
-        _delay_us(WAIT_US);
+    uint8_t bit = SERIAL_SOFT_RXD_IN();
 
-    SERIAL_SOFT_DEBUG_TGL();
-        if (SERIAL_SOFT_RXD_IN()) {
-            data |= mask;
-            parity ^= 1;
+    if (rx_state == RX_START) {
+        if (bit) {
+            // glitch: not start bit
+            goto RX_END;
         }
+        SERIAL_SOFT_TIMER_SET(BIT_COUNT);
+        rx_data = 0;
+        rx_parity = 0;
+    } else if (rx_state <= DATA_BITS) {
+        if (bit) {
 #ifdef SERIAL_SOFT_BIT_ORDER_MSB
-        mask >>= 1;
+            rx_data |= (1 << (DATA_BITS - rx_state));
 #else
-        mask <<= 1;
-#endif
-#ifdef SERIAL_SOFT_DATA_7BIT
-    } while (mask&0x7F);
-#else
-    } while (mask&0xFF);
+            rx_data |= (1 << (rx_state - 1));
 #endif
-
+            rx_parity ^= 1;
+        }
 #if defined(SERIAL_SOFT_PARITY_EVEN) || defined(SERIAL_SOFT_PARITY_ODD)
-    /* to center of parity bit */
-    _delay_us(WAIT_US);
-    if (SERIAL_SOFT_RXD_IN()) { parity ^= 1; }
-    SERIAL_SOFT_DEBUG_TGL();
+    } else if (rx_state == RX_PARITY) {
+        if (bit) { rx_parity ^= 1; }
 #endif
-
-    /* to center of stop bit */
-    _delay_us(WAIT_US);
-
-    uint8_t next = (rbuf_head + 1) % RBUF_SIZE;
+    } else {
+        // stop bit
+        if (!bit) {
+            serial_framing_errors++;
+            goto RX_END;
+        }
 #if defined(SERIAL_SOFT_PARITY_EVEN) || defined(SERIAL_SOFT_PARITY_ODD)
-    if ((parity == SERIAL_SOFT_PARITY_VAL) && next != rbuf_tail) {
-#else
-    if (next != rbuf_tail) {
+        if (rx_parity != SERIAL_SOFT_PARITY_VAL) {
+            serial_parity_errors++;
+            goto RX_END;
+        }
 #endif
-        rbuf[rbuf_head] = data;
-        rbuf_head = next;
+        uint8_t next = (rbuf_head + 1) % RBUF_SIZE;
+        if (next != rbuf_tail) {
+            rbuf[rbuf_head] = rx_data;
+            rbuf_head = next;
+        } else {
+            serial_overrun_errors++;
+        }
+        goto RX_END;
     }
+    rx_state++;
+    return;
 
+RX_END:
+    SERIAL_SOFT_TIMER_STOP();
+    rx_state = RX_IDLE;
+    // discard edges seen during the frame
     SERIAL_SOFT_RXD_INT_EXIT();
-    SERIAL_SOFT_DEBUG_TGL();
 }
@@ -8,6 +8,7 @@ USB_HOST_SHIELD_DIR = $(USB_HID_DIR)/USB_Host_Shield_2.0
 USB_HOST_SHIELD_SRC = \
 	$(USB_HOST_SHIELD_DIR)/Usb.cpp \
 	$(USB_HOST_SHIELD_DIR)/hid.cpp \
+	$(USB_HOST_SHIELD_DIR)/hiduniversal.cpp \
 	$(USB_HOST_SHIELD_DIR)/usbhub.cpp \
 	$(USB_HOST_SHIELD_DIR)/parsetools.cpp \
 	$(USB_HOST_SHIELD_DIR)/message.cpp 
@@ -38,6 +39,10 @@ ARDUINO_CORES_SRC = \
 #
 SRC += $(USB_HID_DIR)/parser.cpp
 
+# Report descriptor parser and report protocol keyboard
+SRC += $(USB_HID_DIR)/report_desc.c
+SRC += $(USB_HID_DIR)/hid_keyboard.cpp
+
 # replace arduino/CDC.cpp
 SRC += $(USB_HID_DIR)/override_Serial.cpp
 
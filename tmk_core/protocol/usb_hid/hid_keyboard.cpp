@@ -0,0 +1,201 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "hid_keyboard.h"
+#include "timer.h"
+#include "debug.h"
+
+
+#define REPORT_DESC_MAX_SIZE    512
+#define REPORT_MAX_SIZE         64
+
+/* boot keyboard interface protocol */
+#define PROTOCOL_KEYBOARD       1
+
+
+/* feeds report descriptor from control transfer into parser */
+class ReportDescReader : public USBReadParser {
+public:
+    hid_rdesc_parser_t parser;
+    virtual void Parse(const uint16_t len, const uint8_t *pbuf, const uint16_t &offset) {
+        hid_rdesc_parse(&parser, pbuf, len);
+    }
+};
+
+
+HIDKeyboard::HIDKeyboard(USB *p) :
+HIDUniversal(p),
+changed(0),
+time_stamp(0),
+iface_count(0),
+iface_conf(0),
+interval(0),
+last_poll(0)
+{
+    ClearKeys();
+    hid_kbd_layout_init(&layout);
+}
+
+uint8_t HIDKeyboard::Init(uint8_t parent, uint8_t port, bool lowspeed)
+{
+    iface_count = 0;
+    iface_conf = 0;
+    interval = 0;
+    hid_kbd_layout_init(&layout);
+
+    uint8_t rcode = HIDUniversal::Init(parent, port, lowspeed);
+    if (rcode) return rcode;
+
+    // not a keyboard: don't take a keyboard slot with mouse or gamepad
+    if (layout.field_count == 0) {
+        dprintf("HIDKeyboard %d: no key field\n", bAddress);
+        Release();
+        return USB_DEV_CONFIG_ERROR_DEVICE_NOT_SUPPORTED;
+    }
+    return 0;
+}
+
+uint8_t HIDKeyboard::Release()
+{
+    // release all keys of detached keyboard
+    ClearKeys();
+    iface_count = 0;
+    return HIDUniversal::Release();
+}
+
+void HIDKeyboard::EndpointXtract(uint8_t conf, uint8_t iface_num, uint8_t alt, uint8_t proto, const USB_ENDPOINT_DESCRIPTOR *pep)
+{
+    HIDUniversal::EndpointXtract(conf, iface_num, alt, proto, pep);
+
+    // interrupt IN endpoint of first configuration
+    if ((pep->bmAttributes & 0x03) != 3 || !(pep->bEndpointAddress & 0x80)) return;
+    if (iface_count && conf != iface_conf) return;
+    if (iface_count >= maxHidInterfaces) return;
+
+    iface_conf = conf;
+    iface[iface_count].num = iface_num;
+    iface[iface_count].proto = proto;
+    iface[iface_count].ep = pep->bEndpointAddress & 0x0F;
+    iface[iface_count].size = (uint8_t)pep->wMaxPacketSize;
+    iface_count++;
+
+    if (interval == 0 || pep->bInterval < interval) {
+        interval = pep->bInterval;
+    }
+}
+
+uint8_t HIDKeyboard::OnInitSuccessful()
+{
+    ReportDescReader reader;
+    uint8_t buf[REPORT_MAX_SIZE];
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < iface_count; i++) {
+        uint8_t num = iface[i].num;
+
+        hid_rdesc_init(&reader.parser, &layout, num);
+        uint8_t rcode = pUsb->ctrlReq(bAddress, 0, bmREQ_HID_REPORT, USB_REQUEST_GET_DESCRIPTOR, 0x00,
+                HID_DESCRIPTOR_REPORT, num, REPORT_DESC_MAX_SIZE, sizeof(buf), buf, &reader);
+        if (rcode) {
+            dprintf("rdesc %d:%d error: %02X\n", bAddress, num, rcode);
+        }
+
+        if (!hid_kbd_layout_has_iface(&layout, num) && iface[i].proto == PROTOCOL_KEYBOARD) {
+            dprintf("rdesc %d:%d boot protocol\n", bAddress, num);
+            SetProtocol(num, 0);
+            hid_kbd_layout_add_boot(&layout, num);
+        }
+
+        // poll only interfaces with key field
+        if (hid_kbd_layout_has_iface(&layout, num)) {
+            iface[count++] = iface[i];
+        } else {
+            dprintf("rdesc %d:%d no key field\n", bAddress, num);
+        }
+    }
+    iface_count = count;
+
+    if (debug_enable) {
+        for (uint8_t i = 0; i < layout.field_count; i++) {
+            hid_kbd_field_t *f = &layout.field[i];
+            dprintf("field %d:%d id:%02X %s off:%d cnt:%d min:%02X\n", bAddress, f->iface, f->report_id,
+                    f->is_array ? "array" : "bitmap", f->bit_offset, f->count, f->usage_min);
+        }
+    }
+    return 0;
+}
+
+uint8_t HIDKeyboard::Poll()
+{
+    uint8_t buf[REPORT_MAX_SIZE];
+
+    if (!isReady()) return 0;
+    if (timer_elapsed(last_poll) < interval) return 0;
+    last_poll = timer_read();
+
+    for (uint8_t i = 0; i < iface_count; i++) {
+        uint16_t read = iface[i].size;
+        if (read > sizeof(buf)) read = sizeof(buf);
+
+        uint8_t rcode = pUsb->inTransfer(bAddress, iface[i].ep, &read, buf);
+        if (rcode == hrNAK) continue;
+        if (rcode) return rcode;
+
+        if (debug_keyboard) {
+            dprintf("input %d:%d:", bAddress, iface[i].num);
+            for (uint8_t j = 0; j < read; j++) {
+                dprintf(" %02X", buf[j]);
+            }
+            dprint("\r\n");
+        }
+
+        uint16_t state[16];
+        int8_t source = hid_kbd_decode(&layout, iface[i].num, buf, read, state);
+        if (source >= 0) {
+            UpdateKeys(source, state);
+        }
+    }
+    return 0;
+}
+
+void HIDKeyboard::SetLED(uint8_t leds)
+{
+    if (!isReady() || layout.led_iface == HID_KBD_NO_IFACE) return;
+
+    if (layout.led_report_id) {
+        uint8_t buf[2] = { layout.led_report_id, leds };
+        SetReport(0, layout.led_iface, 2, layout.led_report_id, 2, buf);
+    } else {
+        SetReport(0, layout.led_iface, 2, 0, 1, &leds);
+    }
+}
+
+void HIDKeyboard::ClearKeys()
+{
+    for (uint8_t r = 0; r < 16; r++) {
+        if (keys[r]) changed |= (1 << r);
+        keys[r] = 0;
+        for (uint8_t s = 0; s < HID_KBD_SOURCES; s++) {
+            source_keys[s][r] = 0;
+        }
+    }
+}
+
+void HIDKeyboard::UpdateKeys(uint8_t source, const uint16_t *state)
+{
+    changed |= hid_kbd_update(&layout, source_keys, source, state, keys);
+    time_stamp = timer_read();
+}
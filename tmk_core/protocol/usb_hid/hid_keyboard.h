@@ -0,0 +1,76 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef HID_KEYBOARD_H
+#define HID_KEYBOARD_H
+
+#include "hiduniversal.h"
+#include "report_desc.h"
+
+
+/*
+ * HID keyboard in report protocol
+ *
+ * Reads report descriptor of each HID interface to locate key fields so that
+ * NKRO(bitmap) keyboards are supported as well as 6KRO ones. Interface which
+ * has no key field in its descriptor falls back to boot protocol when it is
+ * boot keyboard, otherwise it is not polled. Device without any key field is
+ * left to other drivers.
+ *
+ * Key state is kept as bitmap of usage IDs: bit (code & 0x0F) of keys[code >> 4].
+ * It is OR of state of each source(interface and report ID) of the device.
+ * 'changed' has a bit for each row of keys[] updated since it was cleared by user.
+ */
+class HIDKeyboard : public HIDUniversal {
+public:
+    uint16_t keys[16];
+    uint16_t changed;
+    uint16_t time_stamp;
+
+    HIDKeyboard(USB *p);
+
+    void SetLED(uint8_t leds);
+
+    // USBDeviceConfig implementation
+    uint8_t Init(uint8_t parent, uint8_t port, bool lowspeed);
+    uint8_t Release();
+    uint8_t Poll();
+
+    // UsbConfigXtracter implementation
+    void EndpointXtract(uint8_t conf, uint8_t iface, uint8_t alt, uint8_t proto, const USB_ENDPOINT_DESCRIPTOR *ep);
+
+protected:
+    uint8_t OnInitSuccessful();
+
+private:
+    struct {
+        uint8_t num;
+        uint8_t proto;
+        uint8_t ep;
+        uint8_t size;
+    } iface[maxHidInterfaces];
+    uint8_t iface_count;
+    uint8_t iface_conf;
+    uint8_t interval;
+    uint16_t last_poll;
+    hid_kbd_layout_t layout;
+    uint16_t source_keys[HID_KBD_SOURCES][16];
+
+    void ClearKeys();
+    void UpdateKeys(uint8_t source, const uint16_t *state);
+};
+
+#endif
@@ -0,0 +1,319 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "report_desc.h"
+
+
+/* Short item prefix without size bits */
+#define ITEM_INPUT          0x80
+#define ITEM_OUTPUT         0x90
+#define ITEM_COLLECTION     0xA0
+#define ITEM_FEATURE        0xB0
+#define ITEM_END_COLLECTION 0xC0
+#define ITEM_USAGE_PAGE     0x04
+#define ITEM_LOGICAL_MIN    0x14
+#define ITEM_REPORT_SIZE    0x74
+#define ITEM_REPORT_ID      0x84
+#define ITEM_REPORT_COUNT   0x94
+#define ITEM_USAGE          0x08
+#define ITEM_USAGE_MIN      0x18
+#define ITEM_USAGE_MAX      0x28
+#define ITEM_LONG           0xFE
+
+/* Main item data bits */
+#define IOF_CONSTANT        (1<<0)
+#define IOF_VARIABLE        (1<<1)
+
+#define PAGE_KEYBOARD       0x07
+#define PAGE_LED            0x08
+
+#define USAGE_ERROR_ROLLOVER    0x01
+#define USAGE_A                 0x04
+
+
+void hid_kbd_layout_init(hid_kbd_layout_t *layout)
+{
+    layout->field_count = 0;
+    layout->source_count = 0;
+    layout->led_iface = HID_KBD_NO_IFACE;
+    layout->led_report_id = 0;
+}
+
+static hid_kbd_field_t *add_field(hid_kbd_layout_t *layout, uint8_t iface, uint8_t report_id)
+{
+    uint8_t source = layout->source_count;
+    for (uint8_t i = 0; i < layout->field_count; i++) {
+        hid_kbd_field_t *f = &layout->field[i];
+        if (f->iface == iface && f->report_id == report_id) {
+            source = f->source;
+            break;
+        }
+    }
+    if (source >= HID_KBD_SOURCES) return 0;
+    if (layout->field_count >= HID_KBD_FIELDS) return 0;
+    if (source == layout->source_count) layout->source_count++;
+
+    hid_kbd_field_t *f = &layout->field[layout->field_count++];
+    f->iface = iface;
+    f->report_id = report_id;
+    f->source = source;
+    return f;
+}
+
+void hid_kbd_layout_add_boot(hid_kbd_layout_t *layout, uint8_t iface)
+{
+    hid_kbd_field_t *f;
+
+    /* byte 0: modifiers */
+    if ((f = add_field(layout, iface, 0))) {
+        f->bit_offset = 0;
+        f->count = 8;
+        f->usage_min = 0xE0;
+        f->is_array = 0;
+    }
+    /* byte 2-7: keys */
+    if ((f = add_field(layout, iface, 0))) {
+        f->bit_offset = 16;
+        f->count = 6;
+        f->usage_min = 0;
+        f->is_array = 1;
+    }
+    if (layout->led_iface == HID_KBD_NO_IFACE) {
+        layout->led_iface = iface;
+        layout->led_report_id = 0;
+    }
+}
+
+bool hid_kbd_layout_has_iface(const hid_kbd_layout_t *layout, uint8_t iface)
+{
+    for (uint8_t i = 0; i < layout->field_count; i++) {
+        if (layout->field[i].iface == iface) return true;
+    }
+    return false;
+}
+
+
+void hid_rdesc_init(hid_rdesc_parser_t *parser, hid_kbd_layout_t *layout, uint8_t iface)
+{
+    *parser = (hid_rdesc_parser_t){};
+    parser->layout = layout;
+    parser->iface = iface;
+}
+
+static void clear_local(hid_rdesc_parser_t *p)
+{
+    p->usage_min = 0;
+    p->usage_max = 0;
+    p->has_usage = false;
+}
+
+static void input_item(hid_rdesc_parser_t *p)
+{
+    uint16_t bits = (uint16_t)p->report_size * p->report_count;
+
+    if (!(p->data & IOF_CONSTANT) && p->usage_page == PAGE_KEYBOARD) {
+        hid_kbd_field_t *f = 0;
+        if ((p->data & IOF_VARIABLE) && p->report_size == 1) {
+            if ((f = add_field(p->layout, p->iface, p->report_id))) {
+                f->usage_min = p->usage_min;
+                f->is_array = 0;
+            }
+        } else if (!(p->data & IOF_VARIABLE) && p->report_size == 8 && !(p->input_bits & 7)) {
+            if ((f = add_field(p->layout, p->iface, p->report_id))) {
+                /* array value is an index from Logical Minimum into usage range */
+                f->usage_min = (uint8_t)(p->usage_min - p->logical_min);
+                f->is_array = 1;
+            }
+        }
+        if (f) {
+            f->bit_offset = p->input_bits;
+            f->count = p->report_count;
+        }
+    }
+    p->input_bits += bits;
+}
+
+static void output_item(hid_rdesc_parser_t *p)
+{
+    if (!(p->data & IOF_CONSTANT) && p->usage_page == PAGE_LED &&
+            p->layout->led_iface == HID_KBD_NO_IFACE) {
+        p->layout->led_iface = p->iface;
+        p->layout->led_report_id = p->report_id;
+    }
+}
+
+static void process_item(hid_rdesc_parser_t *p)
+{
+    uint32_t data = p->data;
+    int32_t sdata = (int32_t)data;
+
+    /* sign extension for Logical Minimum */
+    if (p->size == 1) sdata = (int8_t)data;
+    else if (p->size == 2) sdata = (int16_t)data;
+
+    switch (p->prefix & 0xFC) {
+        case ITEM_INPUT:
+            input_item(p);
+            clear_local(p);
+            break;
+        case ITEM_OUTPUT:
+            output_item(p);
+            clear_local(p);
+            break;
+        case ITEM_FEATURE:
+        case ITEM_COLLECTION:
+        case ITEM_END_COLLECTION:
+            clear_local(p);
+            break;
+        case ITEM_USAGE_PAGE:
+            p->usage_page = data;
+            break;
+        case ITEM_LOGICAL_MIN:
+            p->logical_min = sdata;
+            break;
+        case ITEM_REPORT_SIZE:
+            p->report_size = data;
+            break;
+        case ITEM_REPORT_COUNT:
+            p->report_count = data;
+            break;
+        case ITEM_REPORT_ID:
+            // each report ID has its own data; interleaved IDs are not supported
+            if (p->report_id != data) {
+                p->report_id = data;
+                p->input_bits = 0;
+            }
+            break;
+        case ITEM_USAGE:
+            // use first usage as origin of listed usages
+            if (!p->has_usage) {
+                p->usage_min = data;
+                p->has_usage = true;
+            }
+            break;
+        case ITEM_USAGE_MIN:
+            p->usage_min = data;
+            p->has_usage = true;
+            break;
+        case ITEM_USAGE_MAX:
+            p->usage_max = data;
+            break;
+    }
+}
+
+void hid_rdesc_parse(hid_rdesc_parser_t *p, const uint8_t *buf, uint16_t len)
+{
+    while (len--) {
+        uint8_t b = *buf++;
+
+        if (p->skip) {
+            p->skip--;
+            continue;
+        }
+
+        if (p->remain) {
+            p->data |= (uint32_t)b << (8 * (p->size - p->remain));
+            if (--p->remain == 0) process_item(p);
+            continue;
+        }
+
+        if (p->prefix == ITEM_LONG) {
+            // long item: bDataSize, bLongItemTag, data
+            p->skip = b + 1;
+            p->prefix = 0;
+            continue;
+        }
+
+        p->prefix = b;
+        if (b == ITEM_LONG) continue;
+
+        p->size = (b & 0x03) == 3 ? 4 : (b & 0x03);
+        p->remain = p->size;
+        p->data = 0;
+        if (p->size == 0) process_item(p);
+    }
+}
+
+
+int8_t hid_kbd_decode(const hid_kbd_layout_t *layout, uint8_t iface,
+                      const uint8_t *report, uint8_t len, uint16_t keys[16])
+{
+    uint16_t state[16] = {};
+    int8_t source = -1;
+
+    for (uint8_t i = 0; i < layout->field_count; i++) {
+        const hid_kbd_field_t *f = &layout->field[i];
+        const uint8_t *data = report;
+        uint8_t data_len = len;
+
+        if (f->iface != iface) continue;
+        if (f->report_id) {
+            if (len == 0 || report[0] != f->report_id) continue;
+            data++;
+            data_len--;
+        }
+        source = f->source;
+
+        if (f->is_array) {
+            for (uint16_t j = 0; j < f->count; j++) {
+                uint16_t pos = (f->bit_offset >> 3) + j;
+                if (pos >= data_len) break;
+                if (data[pos] == 0) continue;
+
+                uint8_t code = f->usage_min + data[pos];
+                // phantom state: keep last state
+                if (code == USAGE_ERROR_ROLLOVER) return -1;
+                if (code < USAGE_A) continue;
+                state[code >> 4] |= (1 << (code & 0x0F));
+            }
+        } else {
+            for (uint16_t j = 0; j < f->count; j++) {
+                uint16_t bit = f->bit_offset + j;
+                uint16_t code = f->usage_min + j;
+                if ((bit >> 3) >= data_len || code > 0xFF) break;
+                if (code < USAGE_A) continue;
+                if (data[bit >> 3] & (1 << (bit & 7))) {
+                    state[code >> 4] |= (1 << (code & 0x0F));
+                }
+            }
+        }
+    }
+
+    if (source < 0) return -1;
+    for (uint8_t r = 0; r < 16; r++) {
+        keys[r] = state[r];
+    }
+    return source;
+}
+
+uint16_t hid_kbd_update(const hid_kbd_layout_t *layout, uint16_t sources[][16],
+                        uint8_t source, const uint16_t state[16], uint16_t keys[16])
+{
+    uint16_t changed = 0;
+    for (uint8_t r = 0; r < 16; r++) {
+        sources[source][r] = state[r];
+
+        uint16_t row = 0;
+        for (uint8_t s = 0; s < layout->source_count; s++) {
+            row |= sources[s][r];
+        }
+        if (keys[r] != row) {
+            keys[r] = row;
+            changed |= (1 << r);
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,126 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef REPORT_DESC_H
+#define REPORT_DESC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * HID report descriptor parser for keyboards
+ *
+ * Finds key fields of Keyboard/Keypad page(0x07) in Input reports:
+ *   bitmap - Variable field with 1-bit size; modifiers and NKRO keys
+ *   array  - Array field with 8-bit size; boot protocol style 6KRO keys
+ * and LED page(0x08) Output report to set indicators.
+ *
+ * Descriptor can be fed in chunks as it arrives from control transfer.
+ * Layout of several interfaces of a device can be kept in one hid_kbd_layout_t.
+ *
+ * Each pair of interface and report ID with key fields is a source. A report
+ * carries key state of its source only and state of all sources are ORed into
+ * key state of the device. Fields of sources over HID_KBD_SOURCES are ignored.
+ */
+#ifndef HID_KBD_FIELDS
+#define HID_KBD_FIELDS  6
+#endif
+#ifndef HID_KBD_SOURCES
+#define HID_KBD_SOURCES 3
+#endif
+
+#define HID_KBD_NO_IFACE    0xFF
+
+typedef struct {
+    uint16_t bit_offset;    /* from start of report data(after report ID) */
+    uint16_t count;
+    uint8_t  usage_min;     /* usage of first bit or usage of array value 0 */
+    uint8_t  report_id;     /* 0: no report ID */
+    uint8_t  iface;
+    uint8_t  is_array;
+    uint8_t  source;        /* index of source(iface and report_id) */
+} hid_kbd_field_t;
+
+typedef struct {
+    hid_kbd_field_t field[HID_KBD_FIELDS];
+    uint8_t field_count;
+    uint8_t source_count;
+    uint8_t led_iface;      /* HID_KBD_NO_IFACE: no LED output */
+    uint8_t led_report_id;
+} hid_kbd_layout_t;
+
+typedef struct {
+    hid_kbd_layout_t *layout;
+    uint8_t  iface;
+
+    /* item being read */
+    uint8_t  prefix;
+    uint8_t  remain;        /* data bytes left of the item */
+    uint8_t  skip;          /* data bytes left of long item */
+    uint8_t  size;
+    uint32_t data;
+
+    /* global items */
+    uint16_t usage_page;
+    int16_t  logical_min;
+    uint8_t  report_size;
+    uint16_t report_count;
+    uint8_t  report_id;
+
+    /* local items */
+    uint16_t usage_min;
+    uint16_t usage_max;
+    bool     has_usage;
+
+    uint16_t input_bits;    /* position in Input report of current report ID */
+} hid_rdesc_parser_t;
+
+
+void hid_kbd_layout_init(hid_kbd_layout_t *layout);
+/* layout of boot protocol keyboard report on the interface */
+void hid_kbd_layout_add_boot(hid_kbd_layout_t *layout, uint8_t iface);
+/* whether the interface has any key field */
+bool hid_kbd_layout_has_iface(const hid_kbd_layout_t *layout, uint8_t iface);
+
+void hid_rdesc_init(hid_rdesc_parser_t *parser, hid_kbd_layout_t *layout, uint8_t iface);
+void hid_rdesc_parse(hid_rdesc_parser_t *parser, const uint8_t *buf, uint16_t len);
+
+/*
+ * Decode Input report from the interface into key state bitmap of its source.
+ * keys[] has a bit for each usage ID 0x00-0xFF: bit (code & 0x0F) of keys[code >> 4].
+ * Returns source index of the report, or -1 leaving keys[] untouched when the
+ * report has no key field or indicates phantom state(ErrorRollOver).
+ */
+int8_t hid_kbd_decode(const hid_kbd_layout_t *layout, uint8_t iface,
+                      const uint8_t *report, uint8_t len, uint16_t keys[16]);
+
+/*
+ * Store state of the source and update keys[] with OR of all sources.
+ * Returns bitmap of rows of keys[] changed.
+ */
+uint16_t hid_kbd_update(const hid_kbd_layout_t *layout, uint16_t sources[][16],
+                        uint8_t source, const uint16_t state[16], uint16_t keys[16]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
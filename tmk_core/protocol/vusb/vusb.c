@@ -26,6 +26,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "vusb.h"
 
 
+#ifdef MOUSE_EXT_REPORT
+#   error "MOUSE_EXT_REPORT is supported only on LUFA and ChibiOS"
+#endif
+
+
 static uint8_t vusb_keyboard_leds = 0;
 static uint8_t vusb_idle_rate = 0;
 
@@ -0,0 +1,11 @@
+/*
+ * chibios/eeconfig.c configuration: STM32F103 with 4KB of flash for
+ * emulated EEPROM, two 1KB pages per bank
+ */
+#define NO_PRINT
+#define NO_DEBUG
+
+#define STM32F1XX
+#define EEPROM_FLASH_START      0x08010000UL
+#define EEPROM_FLASH_END        0x08011000UL
+#define EEPROM_FLASH_PAGE_SIZE  1024
@@ -0,0 +1,25 @@
+/* host stub: flash interface registers of STM32F1 driven by simulator */
+#include <stdint.h>
+
+typedef struct {
+    volatile uint32_t ACR;
+    volatile uint32_t KEYR;
+    volatile uint32_t OPTKEYR;
+    volatile uint32_t SR;
+    volatile uint32_t CR;
+    volatile uint32_t AR;
+} FLASH_TypeDef;
+
+/* applies effect of register and memory writes since previous access */
+FLASH_TypeDef *sim_flash(void);
+#define FLASH               (sim_flash())
+
+#define FLASH_SR_BSY        0x01
+#define FLASH_SR_PGERR      0x04
+#define FLASH_SR_WRPRTERR   0x10
+#define FLASH_SR_EOP        0x20
+
+#define FLASH_CR_PG         0x01
+#define FLASH_CR_PER        0x02
+#define FLASH_CR_STRT       0x40
+#define FLASH_CR_LOCK       0x80
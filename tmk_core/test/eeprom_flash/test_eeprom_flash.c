@@ -0,0 +1,354 @@
+/*
+ * Host test of journaled EEPROM emulation of chibios/eeconfig.c(STM32F0/F1)
+ *
+ * Flash region is mapped at its address of real chip and flash interface is
+ * simulated on register access: programming takes effect only with PG set,
+ * a halfword which is not erased can only be cleared to zero, and erase sets
+ * a page to 0xFFFF. Power loss is injected before the n-th program or erase,
+ * leaving that halfword partly programmed or the page half erased, then
+ * eeprom_initialize() runs again as after reset.
+ */
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <sys/mman.h>
+#include "test.h"
+#include "hal.h"
+
+#define REGION_SIZE     (EEPROM_FLASH_END - EEPROM_FLASH_START)
+#define REGION_WORDS    (REGION_SIZE / 2)
+#define PAGES           (REGION_SIZE / EEPROM_FLASH_PAGE_SIZE)
+#define BANK_SLOTS      (REGION_SIZE / 2 / 4)
+#define EEPROM_BYTES    128
+#define BANK1           (REGION_WORDS / 2)
+
+#define KEY1            0x45670123
+#define KEY2            0xCDEF89AB
+
+void eeprom_initialize(void);
+void eeprom_task(void);
+uint8_t eeprom_read_byte(const uint8_t *addr);
+void eeprom_write_byte(uint8_t *addr, uint8_t value);
+
+static volatile uint16_t *flash;
+static uint16_t shadow[REGION_WORDS];       // flash as programmed
+static FLASH_TypeDef regs;
+static bool key1;
+
+static uint32_t ops;                        // programs and erases
+static uint32_t cut_at;                     // power loss before this op
+static jmp_buf power_loss;
+
+static uint32_t page_erases[PAGES];
+static uint32_t stray_writes;
+static bool in_write;
+static uint32_t erases_in_write;
+
+static uint32_t rand_state = 1;
+static uint16_t rand16(void)
+{
+    rand_state = rand_state * 1103515245 + 12345;
+    return rand_state >> 16;
+}
+
+
+static bool power_cut(void)
+{
+    return ++ops == cut_at;
+}
+
+FLASH_TypeDef *sim_flash(void)
+{
+    // status flags are write-1-to-clear; eeconfig.c clears them all at once
+    if (regs.SR == (FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR)) regs.SR = 0;
+
+    if (regs.KEYR == KEY1) {
+        key1 = true;
+    } else if (regs.KEYR == KEY2 && key1) {
+        regs.CR &= ~FLASH_CR_LOCK;
+        key1 = false;
+    }
+    regs.KEYR = 0;
+
+    bool written = memcmp((const void *)flash, shadow, REGION_SIZE) != 0;
+    for (uint32_t i = 0; written && i < REGION_WORDS; i++) {
+        // skip unchanged blocks quickly
+        if (i % 32 == 0 && memcmp((const void *)&flash[i], &shadow[i], 64) == 0) {
+            i += 31;
+            continue;
+        }
+        uint16_t data = flash[i];
+        if (data == shadow[i]) continue;
+        if ((regs.CR & (FLASH_CR_PG | FLASH_CR_LOCK)) != FLASH_CR_PG) {
+            stray_writes++;
+            flash[i] = shadow[i];
+            continue;
+        }
+        if (power_cut()) {
+            // some of bits to clear are left set
+            shadow[i] &= data | rand16();
+            flash[i] = shadow[i];
+            longjmp(power_loss, 1);
+        }
+        if (shadow[i] != 0xFFFF && data != 0) {
+            flash[i] = shadow[i];
+            regs.SR |= FLASH_SR_PGERR;
+        } else {
+            shadow[i] = data;
+            regs.SR |= FLASH_SR_EOP;
+        }
+    }
+
+    if ((regs.CR & (FLASH_CR_PER | FLASH_CR_STRT | FLASH_CR_LOCK)) == (FLASH_CR_PER | FLASH_CR_STRT)) {
+        uint32_t offset = regs.AR - EEPROM_FLASH_START;
+        regs.CR &= ~FLASH_CR_STRT;
+        CHECK(offset < REGION_SIZE && offset % EEPROM_FLASH_PAGE_SIZE == 0);
+        uint16_t *page = &shadow[offset / 2];
+        uint32_t words = EEPROM_FLASH_PAGE_SIZE / 2;
+        if (power_cut()) {
+            // first half of page
+            memset(page, 0xFF, words);
+            memcpy((void *)&flash[offset / 2], page, words * 2);
+            longjmp(power_loss, 1);
+        }
+        memset(page, 0xFF, words * 2);
+        memcpy((void *)&flash[offset / 2], page, words * 2);
+        page_erases[offset / EEPROM_FLASH_PAGE_SIZE]++;
+        if (in_write) erases_in_write++;
+        regs.SR |= FLASH_SR_EOP;
+    }
+    return &regs;
+}
+
+/* power-on: flash keeps its content */
+static void reset(void)
+{
+    memset(&regs, 0, sizeof(regs));
+    regs.CR = FLASH_CR_LOCK;
+    key1 = false;
+    cut_at = 0;
+    eeprom_initialize();
+}
+
+/* blank chip */
+static void blank(void)
+{
+    memset(shadow, 0xFF, sizeof(shadow));
+    memcpy((void *)flash, shadow, REGION_SIZE);
+    memset(page_erases, 0, sizeof(page_erases));
+    ops = 0;
+    stray_writes = 0;
+    erases_in_write = 0;
+    reset();
+}
+
+static uint8_t read(uint8_t addr)
+{
+    return eeprom_read_byte((const uint8_t *)(uintptr_t)addr);
+}
+
+static void write(uint8_t addr, uint8_t value)
+{
+    in_write = true;
+    eeprom_write_byte((uint8_t *)(uintptr_t)addr, value);
+    in_write = false;
+}
+
+static uint32_t erases(void)
+{
+    uint32_t n = 0;
+    for (uint8_t i = 0; i < PAGES; i++) n += page_erases[i];
+    return n;
+}
+
+
+/* blank flash is formatted and reads as erased EEPROM */
+static void test_format(void)
+{
+    blank();
+    for (uint16_t a = 0; a < EEPROM_BYTES; a++) {
+        CHECK_EQ(read(a), 0xFF);
+    }
+    // formatted by compaction into second bank: generation 1
+    CHECK_EQ(flash[BANK1], 1);
+    CHECK_EQ(flash[BANK1 + 1], 0xEE5A);
+    CHECK_EQ(flash[1], 0xFFFF);
+    CHECK_EQ(erases(), 0);
+    CHECK_EQ(stray_writes, 0);
+    CHECK(regs.CR & FLASH_CR_LOCK);
+}
+
+/* a write appends one record; same value and out of range are ignored */
+static void test_journal(void)
+{
+    blank();
+    uint32_t start = ops;
+    write(3, 0x12);
+    CHECK_EQ(ops - start, 2);
+    CHECK_EQ(flash[BANK1 + 2], 0x1203);
+    CHECK_EQ(flash[BANK1 + 3], (uint16_t)~0x1203);
+    write(3, 0x12);
+    write(EEPROM_BYTES, 0x34);
+    CHECK_EQ(ops - start, 2);
+    write(3, 0x56);
+    write(0, 0x01);
+    CHECK_EQ(ops - start, 6);
+
+    reset();
+    CHECK_EQ(read(3), 0x56);
+    CHECK_EQ(read(0), 0x01);
+    CHECK_EQ(read(1), 0xFF);
+    CHECK_EQ(read(EEPROM_BYTES), 0xFF);
+    CHECK_EQ(stray_writes, 0);
+}
+
+/* record whose check halfword doesn't match is ignored */
+static void test_broken_record(void)
+{
+    blank();
+    write(7, 0x11);
+    write(7, 0x22);
+    // cleared check of the last record
+    shadow[BANK1 + 5] = flash[BANK1 + 5] = 0;
+    reset();
+    CHECK_EQ(read(7), 0x11);
+    write(7, 0x33);
+    reset();
+    CHECK_EQ(read(7), 0x33);
+}
+
+/* full bank is compacted into the other one by eeprom_write_byte() */
+static void test_compact_on_write(void)
+{
+    static uint8_t model[EEPROM_BYTES];
+
+    blank();
+    memset(model, 0xFF, sizeof(model));
+    for (uint32_t i = 0; i < BANK_SLOTS * 3; i++) {
+        uint8_t a = rand16() % EEPROM_BYTES;
+        uint8_t v = rand16();
+        write(a, v);
+        model[a] = v;
+    }
+    CHECK(erases_in_write > 0);
+    for (uint16_t a = 0; a < EEPROM_BYTES; a++) {
+        CHECK_EQ(read(a), model[a]);
+    }
+    reset();
+    for (uint16_t a = 0; a < EEPROM_BYTES; a++) {
+        CHECK_EQ(read(a), model[a]);
+    }
+    CHECK_EQ(stray_writes, 0);
+}
+
+/* with eeprom_task() in main loop writes never wait for erase, and pages
+ * are erased about once per bank of writes */
+static void test_compact_in_task(void)
+{
+    static uint8_t model[EEPROM_BYTES];
+    const uint32_t writes = 20000;
+
+    blank();
+    memset(model, 0xFF, sizeof(model));
+    for (uint32_t i = 0; i < writes; i++) {
+        // a few settings changed over and over
+        uint8_t a = rand16() % 16;
+        uint8_t v = rand16();
+        write(a, v);
+        model[a] = v;
+        eeprom_task();
+    }
+    CHECK_EQ(erases_in_write, 0);
+    for (uint8_t p = 0; p < PAGES; p++) {
+        CHECK(page_erases[p] > 0);
+        CHECK(page_erases[p] <= writes / (BANK_SLOTS - EEPROM_BYTES) + 1);
+    }
+    reset();
+    for (uint16_t a = 0; a < EEPROM_BYTES; a++) {
+        CHECK_EQ(read(a), model[a]);
+    }
+}
+
+/* Power loss at every program and erase of a sequence which goes through
+ * compactions: all completed writes survive and the interrupted one reads
+ * as either old or new value. */
+static void test_power_loss(void)
+{
+    static uint8_t model[EEPROM_BYTES];
+    const uint32_t writes = BANK_SLOTS + BANK_SLOTS / 4;
+    uint32_t total = 0;
+    int failures = test_failures;
+
+    for (uint32_t cut = 1; ; cut++) {
+        volatile int pending = -1;
+        volatile uint8_t old = 0, new = 0;
+
+        rand_state = 1;
+        blank();
+        memset(model, 0xFF, sizeof(model));
+        cut_at = ops + cut;
+        if (setjmp(power_loss) == 0) {
+            for (uint32_t i = 0; i < writes; i++) {
+                uint8_t a = rand16() % 16;
+                uint8_t v = rand16();
+                pending = a;
+                old = model[a];
+                new = v;
+                write(a, v);
+                model[a] = v;
+                pending = -1;
+                // compaction and erase in background from time to time
+                if (i % 8 == 0) eeprom_task();
+            }
+            // no power loss: all cut points are done
+            total = cut - 1;
+            break;
+        }
+
+        in_write = false;
+        reset();
+        for (uint16_t a = 0; a < EEPROM_BYTES; a++) {
+            uint8_t v = read(a);
+            if (a == pending) {
+                CHECK(v == old || v == new);
+            } else {
+                CHECK_EQ(v, model[a]);
+            }
+        }
+        if (test_failures != failures) {
+            printf("    power loss at op %u\n", cut);
+            break;
+        }
+
+        // still works after recovery
+        write(5, 0xA5);
+        reset();
+        CHECK_EQ(read(5), 0xA5);
+    }
+    printf("    %u power loss points\n", total);
+    CHECK(total > writes * 2);
+    // sequence went through compaction into first bank
+    CHECK_EQ(flash[1], 0xEE5A);
+}
+
+
+int main(void)
+{
+    flash = mmap((void *)EEPROM_FLASH_START, REGION_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (flash != (volatile uint16_t *)EEPROM_FLASH_START) {
+        printf("can't map flash at %08lX\n", EEPROM_FLASH_START);
+        return 1;
+    }
+
+    TEST(test_format);
+    TEST(test_journal);
+    TEST(test_broken_record);
+    TEST(test_compact_on_write);
+    TEST(test_compact_in_task);
+    TEST(test_power_loss);
+    return test_result();
+}
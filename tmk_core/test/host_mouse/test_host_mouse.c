@@ -0,0 +1,203 @@
+/*
+ * Host test of mouse report queue of host.c
+ *
+ * Fake driver records reports it gets and its mouse_ready() is switched by
+ * test to model busy endpoint.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "test.h"
+#include "host.h"
+#include "debug.h"
+
+#define SENT_MAX    32
+
+debug_config_t debug_config;
+
+static bool ready;
+static bool sent_while_busy;
+static report_mouse_t sent[SENT_MAX];
+static uint8_t sent_count;
+
+static uint8_t keyboard_leds(void) { return 0; }
+static void send_keyboard(report_keyboard_t *report) { (void)report; }
+static void send_system(uint16_t data) { (void)data; }
+static void send_consumer(uint16_t data) { (void)data; }
+static bool mouse_ready(void) { return ready; }
+
+static void send_mouse(report_mouse_t *report)
+{
+    if (!ready) sent_while_busy = true;
+    if (sent_count < SENT_MAX) sent[sent_count++] = *report;
+}
+
+static host_driver_t driver = {
+    keyboard_leds, send_keyboard, send_mouse, send_system, send_consumer, mouse_ready
+};
+
+
+static bool mouse(uint8_t buttons, int8_t x)
+{
+    report_mouse_t r = { .buttons = buttons, .x = x };
+    return host_mouse_send(&r);
+}
+
+static void start(bool is_ready)
+{
+    // flush what previous test left and release buttons
+    ready = true;
+    host_set_driver(&driver);
+    host_mouse_task();
+    mouse(0, 0);
+
+    ready = is_ready;
+    sent_while_busy = false;
+    sent_count = 0;
+    host_mouse_merged = 0;
+}
+
+static void flush(void)
+{
+    ready = true;
+    host_mouse_task();
+}
+
+static int32_t sent_x(void)
+{
+    int32_t x = 0;
+    for (uint8_t i = 0; i < sent_count; i++) x += sent[i].x;
+    return x;
+}
+
+
+/* ready driver gets each report as it is */
+static void test_ready(void)
+{
+    start(true);
+    mouse(0, 1);
+    mouse(0, 2);
+    mouse(1, 0);
+    CHECK_EQ(sent_count, 3);
+    CHECK_EQ(sent[1].x, 2);
+    CHECK_EQ(sent[2].buttons, 1);
+    CHECK_EQ(host_mouse_merged, 0);
+}
+
+/* movement is merged while busy, button changes are kept */
+static void test_merge(void)
+{
+    start(false);
+    mouse(0, 10);
+    mouse(0, 20);
+    mouse(1, 1);
+    mouse(1, 2);
+    mouse(0, 3);
+    CHECK_EQ(sent_count, 0);
+    flush();
+    CHECK_EQ(sent_count, 3);
+    CHECK_EQ(sent[0].x, 30);
+    CHECK_EQ(sent[1].buttons, 1);
+    CHECK_EQ(sent[1].x, 3);
+    CHECK_EQ(sent[2].buttons, 0);
+    CHECK_EQ(host_mouse_merged, 2);
+}
+
+/* full queue: movement-only report is merged back into report with same
+ * buttons, nothing is sent while busy and no button change is lost */
+static void test_full_movement(void)
+{
+    start(false);
+    mouse(1, 100);
+    mouse(1, 100);      // out of range to merge: movement-only entry
+    mouse(0, 0);
+    mouse(1, 0);
+    CHECK(mouse(0, 5)); // full
+    CHECK(!sent_while_busy);
+    CHECK_EQ(sent_count, 0);
+    flush();
+    CHECK_EQ(sent_count, 4);
+    CHECK_EQ(sent[0].buttons, 1);
+    CHECK_EQ(sent[0].x, 127);   // movement out of range is dropped
+    CHECK_EQ(sent[1].buttons, 0);
+    CHECK_EQ(sent[1].x, 0);
+    CHECK_EQ(sent[2].buttons, 1);
+    CHECK_EQ(sent[2].x, 0);
+    CHECK_EQ(sent[3].buttons, 0);
+    CHECK_EQ(sent[3].x, 5);
+}
+
+/* sent report can't take movement back: head is kept as it is and report
+ * with button change waits */
+static void test_full_head(void)
+{
+    static const uint8_t buttons[] = { 1, 1, 0, 1, 0, 1 };
+
+    start(true);
+    mouse(1, 0);        // sent: button 1 is down
+    ready = false;
+    mouse(1, 7);        // movement-only
+    mouse(0, 0);
+    mouse(1, 0);
+    mouse(0, 0);        // full
+    CHECK(!mouse(1, 0));
+    CHECK(!sent_while_busy);
+    flush();
+    CHECK(mouse(1, 0));
+    CHECK_EQ(sent_count, 6);
+    for (uint8_t i = 0; i < sent_count; i++) {
+        CHECK_EQ(sent[i].buttons, buttons[i]);
+    }
+    CHECK_EQ(sent[1].x, 7);
+}
+
+/* full queue of button changes: report with another button change is not
+ * taken until driver gets ready, then every button edge reaches driver */
+static void test_full_buttons(void)
+{
+    static const uint8_t buttons[] = { 1, 0, 1, 0, 3 };
+
+    start(false);
+    for (uint8_t i = 0; i < 4; i++) {
+        CHECK(mouse(buttons[i], 1));
+    }
+    CHECK(!mouse(buttons[4], 1));
+    // same buttons as newest: movement is merged
+    CHECK(mouse(0, 1));
+    CHECK(!sent_while_busy);
+    CHECK_EQ(sent_count, 0);
+    flush();
+    CHECK(mouse(buttons[4], 1));
+    CHECK_EQ(sent_count, 5);
+    for (uint8_t i = 0; i < sent_count; i++) {
+        CHECK_EQ(sent[i].buttons, buttons[i]);
+    }
+    CHECK_EQ(sent[3].x, 2);
+    CHECK_EQ(sent_x(), 6);
+}
+
+/* movement saturates instead of wrapping */
+static void test_saturate(void)
+{
+    start(false);
+    mouse(1, 0);
+    mouse(0, 0);
+    mouse(0, 127);
+    mouse(0, 127);      // movement-only entry
+    mouse(1, 0);        // full: 127 folds into 127
+    flush();
+    CHECK_EQ(sent_count, 4);
+    CHECK_EQ(sent[2].x, 127);
+}
+
+
+int main(void)
+{
+    TEST(test_ready);
+    TEST(test_merge);
+    TEST(test_full_movement);
+    TEST(test_full_head);
+    TEST(test_full_buttons);
+    TEST(test_saturate);
+    return test_result();
+}
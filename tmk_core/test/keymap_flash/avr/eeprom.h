@@ -0,0 +1,3 @@
+/* host stub */
+void sim_eeprom_busy_wait(void);
+#define eeprom_busy_wait()  sim_eeprom_busy_wait()
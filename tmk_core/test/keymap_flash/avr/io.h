@@ -0,0 +1,8 @@
+/* host stub: ATmega32U4 flash geometry and status register */
+#include <stdint.h>
+
+#define SPM_PAGESIZE    128
+#define FLASHEND        0x7FFF
+#define E2END           0x3FF
+
+extern uint8_t SREG;
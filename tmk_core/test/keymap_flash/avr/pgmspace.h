@@ -0,0 +1,11 @@
+/* host stub: flash is plain memory */
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define pgm_read_byte(p)    (*(const uint8_t *)(p))
+#define memcmp_P            memcmp
+
+/* word of absolute flash address, used for bootloader signature */
+uint16_t sim_flash_word(uint32_t addr);
+#define pgm_read_word(addr) sim_flash_word(addr)
@@ -0,0 +1,9 @@
+/*
+ * raw_hid.c and keymap_flash.c configuration with default 2KB keymap region
+ * of 128 byte pages
+ */
+#define NO_PRINT
+#define NO_DEBUG
+
+#define MATRIX_ROWS     8
+#define MATRIX_COLS     8
@@ -0,0 +1,292 @@
+/*
+ * Host test of runtime keymap update: keymap_flash.c through raw_hid.c
+ *
+ * Keymap region is an array in RAM and boot section helper is replaced with
+ * a model of SPM page programming: erase sets the page to 0xFF and write can
+ * only clear bits. Host side computes page delta from CRCs like raw_hid.py
+ * keymap-update and sends changed pages only.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "test.h"
+#include "raw_hid.h"
+#include "keymap_flash.h"
+
+#define PAGES       KEYMAP_FLASH_PAGES
+#define PAGE_SIZE   KEYMAP_FLASH_PAGE_SIZE
+
+uint8_t SREG = 0x80;
+
+/* keymap region */
+uint8_t __keymap_start[KEYMAP_FLASH_SIZE];
+
+static bool helper_available = true;
+static uint8_t stuck_mask;          // bits which can't be cleared
+static uint16_t programs;           // pages programmed
+static uint16_t program_page_mask;
+static bool program_int_enabled;
+static bool eeprom_waited;
+static uint16_t keyboard_cleared;
+
+/* last response */
+static uint8_t response[RAW_EPSIZE];
+static uint8_t response_count;
+
+
+/* hardware */
+uint16_t sim_flash_word(uint32_t addr) { (void)addr; return 0xFFFF; }
+void sim_eeprom_busy_wait(void) { eeprom_waited = true; }
+
+bool keymap_flash_helper_available(void)
+{
+    return helper_available;
+}
+
+void keymap_flash_helper_program(uint16_t addr, const uint8_t *data)
+{
+    uint16_t offset = (uint16_t)(addr - keymap_flash_start());
+    uint8_t *p = &__keymap_start[offset];
+
+    CHECK_EQ(offset % PAGE_SIZE, 0);
+    program_int_enabled = SREG & 0x80;
+    programs++;
+    program_page_mask |= 1 << (offset / PAGE_SIZE);
+
+    memset(p, 0xFF, PAGE_SIZE);
+    for (uint16_t i = 0; i < PAGE_SIZE; i++) {
+        p[i] &= data[i] | stuck_mask;
+    }
+}
+
+/* tmk_core */
+uint32_t timer_read32(void) { return 0; }
+void clear_keyboard(void) { keyboard_cleared++; }
+const uint16_t eeprom_size = 128;
+uint8_t eeprom_read_byte(const uint8_t *addr) { (void)addr; return 0xFF; }
+void eeprom_write_byte(uint8_t *addr, uint8_t value) { (void)addr; (void)value; }
+
+bool raw_hid_send(const uint8_t *data)
+{
+    memcpy(response, data, RAW_EPSIZE);
+    response_count++;
+    return true;
+}
+
+
+/* sends request and returns status; data of response is at response + 3 */
+static uint8_t request(uint8_t cmd, const uint8_t *args, uint8_t len)
+{
+    static uint8_t seq;
+    uint8_t buf[RAW_EPSIZE] = { cmd, ++seq };
+    memcpy(&buf[2], args, len);
+
+    uint8_t count = response_count;
+    raw_hid_receive(buf, sizeof(buf));
+    raw_hid_task();
+    CHECK_EQ(response_count, count + 1);
+    CHECK_EQ(response[0], cmd);
+    CHECK_EQ(response[1], seq);
+    return response[2];
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+/* CRCs of pages of the device in chunks as long as response allows */
+static void device_crcs(uint16_t *crcs)
+{
+    uint8_t page = 0;
+    while (page < PAGES) {
+        uint8_t n = PAGES - page;
+        if (n > RAW_DATA_SIZE / 2) n = RAW_DATA_SIZE / 2;
+        CHECK_EQ(request(RAW_CMD_KEYMAP_CRC, (uint8_t[]){ page, n }, 2), RAW_OK);
+        for (uint8_t i = 0; i < n; i++) {
+            crcs[page + i] = get16(&response[3 + i * 2]);
+        }
+        page += n;
+    }
+}
+
+/* fills page buffer in chunks and programs it */
+static uint8_t write_page(uint8_t page, const uint8_t *data)
+{
+    const uint8_t chunk = RAW_EPSIZE - 5;
+    for (uint16_t offset = 0; offset < PAGE_SIZE; offset += chunk) {
+        uint8_t len = (PAGE_SIZE - offset < chunk) ? PAGE_SIZE - offset : chunk;
+        uint8_t args[RAW_EPSIZE - 2] = { offset & 0xFF, offset >> 8, len };
+        memcpy(&args[3], &data[offset], len);
+        CHECK_EQ(request(RAW_CMD_KEYMAP_DATA, args, 3 + len), RAW_OK);
+    }
+    uint16_t crc = keymap_flash_crc(data, PAGE_SIZE);
+    return request(RAW_CMD_KEYMAP_WRITE, (uint8_t[]){ page, crc & 0xFF, crc >> 8 }, 3);
+}
+
+/* writes pages whose CRC differs from image, returns number of them */
+static uint8_t update(const uint8_t *image)
+{
+    uint16_t crcs[PAGES];
+    uint8_t changed = 0;
+
+    device_crcs(crcs);
+    for (uint8_t page = 0; page < PAGES; page++) {
+        const uint8_t *data = &image[page * PAGE_SIZE];
+        if (keymap_flash_crc(data, PAGE_SIZE) == crcs[page]) continue;
+        CHECK_EQ(write_page(page, data), RAW_OK);
+        changed++;
+    }
+    return changed;
+}
+
+static void reset(void)
+{
+    for (uint16_t i = 0; i < KEYMAP_FLASH_SIZE; i++) {
+        __keymap_start[i] = i * 7;
+    }
+    helper_available = true;
+    stuck_mask = 0;
+    programs = 0;
+    program_page_mask = 0;
+    eeprom_waited = false;
+    keyboard_cleared = 0;
+    SREG = 0x80;
+}
+
+
+/* CRC-16/CCITT check value and per-page CRC */
+static void test_crc(void)
+{
+    reset();
+    CHECK_EQ(keymap_flash_crc((const uint8_t *)"123456789", 9), 0x29B1);
+    CHECK_EQ(keymap_flash_crc(NULL, 0), 0xFFFF);
+    for (uint8_t page = 0; page < PAGES; page++) {
+        CHECK_EQ(keymap_flash_page_crc(page), keymap_flash_crc(&__keymap_start[page * PAGE_SIZE], PAGE_SIZE));
+    }
+
+    uint16_t crcs[PAGES];
+    device_crcs(crcs);
+    for (uint8_t page = 0; page < PAGES; page++) {
+        CHECK_EQ(crcs[page], keymap_flash_page_crc(page));
+    }
+}
+
+static void test_info(void)
+{
+    reset();
+    CHECK_EQ(request(RAW_CMD_KEYMAP_INFO, NULL, 0), RAW_OK);
+    CHECK_EQ(get16(&response[3]), keymap_flash_start());
+    CHECK_EQ(get16(&response[5]), KEYMAP_FLASH_SIZE);
+    CHECK_EQ(get16(&response[7]), PAGE_SIZE);
+    CHECK_EQ(response[9], 1);
+
+    helper_available = false;
+    CHECK_EQ(request(RAW_CMD_KEYMAP_INFO, NULL, 0), RAW_OK);
+    CHECK_EQ(response[9], 0);
+}
+
+/* only pages with changes are programmed and region ends up as image */
+static void test_update_delta(void)
+{
+    static uint8_t image[KEYMAP_FLASH_SIZE];
+
+    reset();
+    memcpy(image, __keymap_start, sizeof(image));
+    image[2 * PAGE_SIZE] ^= 0x01;
+    image[5 * PAGE_SIZE + PAGE_SIZE - 1] = 0x00;
+    image[PAGES * PAGE_SIZE - 1] ^= 0xFF;
+
+    CHECK_EQ(update(image), 3);
+    CHECK_EQ(programs, 3);
+    CHECK_EQ(program_page_mask, (1 << 2) | (1 << 5) | (1 << (PAGES - 1)));
+    CHECK(memcmp(image, __keymap_start, sizeof(image)) == 0);
+    CHECK_EQ(keyboard_cleared, 3);
+
+    // programmed with interrupts disabled and after EEPROM write
+    CHECK(!program_int_enabled);
+    CHECK(eeprom_waited);
+    CHECK_EQ(SREG, 0x80);
+
+    // nothing left to do
+    programs = 0;
+    CHECK_EQ(update(image), 0);
+    CHECK_EQ(programs, 0);
+}
+
+/* page which has the data already is not programmed */
+static void test_unchanged_page(void)
+{
+    reset();
+    CHECK_EQ(write_page(4, &__keymap_start[4 * PAGE_SIZE]), RAW_OK);
+    CHECK_EQ(programs, 0);
+}
+
+/* buffer whose CRC doesn't match is not written */
+static void test_buffer_crc(void)
+{
+    static uint8_t data[PAGE_SIZE];
+
+    reset();
+    memset(data, 0x55, sizeof(data));
+    CHECK_EQ(write_page(1, data), RAW_OK);
+    data[10] = 0xAA;
+    CHECK_EQ(request(RAW_CMD_KEYMAP_DATA, (uint8_t[]){ 10, 0, 1, 0xAA }, 4), RAW_OK);
+    CHECK_EQ(request(RAW_CMD_KEYMAP_WRITE, (uint8_t[]){ 1, 0x00, 0x00 }, 3), RAW_ERR_VERIFY);
+    CHECK_EQ(programs, 1);
+    CHECK_EQ(__keymap_start[PAGE_SIZE + 10], 0x55);
+}
+
+static void test_arguments(void)
+{
+    reset();
+    // beyond page buffer
+    CHECK_EQ(request(RAW_CMD_KEYMAP_DATA, (uint8_t[]){ PAGE_SIZE - 1, 0, 2, 0, 0 }, 5), RAW_ERR_ARGUMENT);
+    CHECK_EQ(request(RAW_CMD_KEYMAP_DATA, (uint8_t[]){ 0, 0, RAW_EPSIZE - 4 }, 3), RAW_ERR_ARGUMENT);
+    // beyond region
+    CHECK_EQ(request(RAW_CMD_KEYMAP_WRITE, (uint8_t[]){ PAGES, 0, 0 }, 3), RAW_ERR_ARGUMENT);
+    CHECK_EQ(request(RAW_CMD_KEYMAP_CRC, (uint8_t[]){ PAGES - 1, 2 }, 2), RAW_ERR_ARGUMENT);
+    CHECK_EQ(request(RAW_CMD_KEYMAP_CRC, (uint8_t[]){ 0, RAW_DATA_SIZE / 2 + 1 }, 2), RAW_ERR_ARGUMENT);
+    CHECK(!keymap_flash_write_page(PAGES, __keymap_start));
+    CHECK_EQ(programs, 0);
+}
+
+/* without helper nothing is touched */
+static void test_unavailable(void)
+{
+    static uint8_t data[PAGE_SIZE];
+
+    reset();
+    helper_available = false;
+    memset(data, 0x12, sizeof(data));
+    CHECK_EQ(write_page(0, data), RAW_ERR_UNAVAILABLE);
+    CHECK_EQ(programs, 0);
+    CHECK_EQ(keyboard_cleared, 0);
+}
+
+/* page which doesn't read back as written fails */
+static void test_verify(void)
+{
+    static uint8_t data[PAGE_SIZE];
+
+    reset();
+    stuck_mask = 0x04;
+    memset(data, 0x00, sizeof(data));
+    CHECK_EQ(write_page(3, data), RAW_ERR_VERIFY);
+    CHECK_EQ(programs, 1);
+    CHECK_EQ(SREG, 0x80);
+}
+
+
+int main(void)
+{
+    TEST(test_crc);
+    TEST(test_info);
+    TEST(test_update_delta);
+    TEST(test_unchanged_page);
+    TEST(test_buffer_crc);
+    TEST(test_arguments);
+    TEST(test_unavailable);
+    TEST(test_verify);
+    return test_result();
+}
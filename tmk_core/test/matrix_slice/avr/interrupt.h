@@ -0,0 +1,3 @@
+/* host stub */
+#define sei()
+#define cli()
@@ -0,0 +1,6 @@
+/* host stub: ports of simulated controller */
+#include <stdint.h>
+
+extern uint8_t PORTB, PORTC, PORTD, DDRB, DDRC, DDRD;
+uint8_t sim_pinc(void);
+#define PINC    sim_pinc()
@@ -0,0 +1,22 @@
+/*
+ * fc660c.c configuration for simulated Topre controller: scans 2 of 8 rows
+ * per matrix_scan() call.
+ */
+#include <stdint.h>
+
+#define F_CPU                   16000000UL
+#define NO_PRINT
+#define NO_DEBUG
+
+#define MATRIX_ROWS             8
+#define MATRIX_COLS             16
+#define MATRIX_SCAN_SLICE       2
+
+#define TOPRE_SETTLE_DEFAULT    2
+#define TOPRE_RECOVERY_DEFAULT  75
+
+/* Timer0 of AVR at 250kHz */
+uint8_t sim_timer_raw(void);
+#define TIMER_RAW_FREQ          250000
+#define TIMER_RAW               sim_timer_raw()
+#define TIMER_RAW_TOP           (TIMER_RAW_FREQ/1000)
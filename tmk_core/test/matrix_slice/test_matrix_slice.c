@@ -0,0 +1,188 @@
+/*
+ * Host test of sliced matrix scan of fc660c.c
+ *
+ * Controller of Topre switches is simulated on its ports: KEY_STATE goes low
+ * while selected key is pressed and enabled. Delays advance simulated time so
+ * that latency of key press through matrix_scan() can be measured.
+ */
+#include <stdbool.h>
+#include "test.h"
+#include "matrix.h"
+#include "topre.h"
+
+#define TASK_US     100     // keyboard_task work other than matrix_scan()
+#define KEYS        4
+
+uint8_t PORTB, PORTC, PORTD, DDRB, DDRC, DDRD;
+
+static double now;          // us
+
+typedef struct {
+    uint8_t row, col;
+    double press, release;
+} key_t;
+static key_t keys[KEYS];
+static uint8_t key_count;
+
+// row being scanned and its state when the scan started
+static int8_t scan_row = -1;
+static matrix_row_t scan_row_start;
+static uint16_t row_torn;
+static uint16_t sweeps;
+
+// called on each KEY_STATE read of the selected key
+static void (*on_read)(uint8_t row, uint8_t col);
+
+
+/* hardware */
+void _delay_us(double us) { now += us; }
+void _delay_ms(double ms) { now += ms * 1000; }
+void _delay_loop_2(uint16_t count) { now += count * 4.0 / (F_CPU / 1000000); }
+
+uint8_t sim_timer_raw(void)
+{
+    // CTC mode: counts 0 to TIMER_RAW_TOP
+    return (uint64_t)(now / 4) % (TIMER_RAW_TOP + 1);
+}
+
+uint8_t sim_pinc(void)
+{
+    uint8_t row = (PORTD >> 4) & 0x07;
+    uint8_t col = (PORTB & 0x07) | ((PORTB & (1<<4)) ? 0x08 : 0);
+    bool enabled = !(PORTD & (1<<7));
+
+    // matrix_get_row() must not change until the row is completed
+    if (row != scan_row) {
+        scan_row = row;
+        scan_row_start = matrix_get_row(row);
+    } else if (matrix_get_row(row) != scan_row_start) {
+        row_torn++;
+    }
+    if (enabled && on_read) on_read(row, col);
+
+    bool on = false;
+    for (uint8_t i = 0; i < key_count; i++) {
+        key_t *k = &keys[i];
+        if (k->row == row && k->col == col && k->press <= now && now < k->release) on = true;
+    }
+    return (enabled && on) ? 0 : (1<<6);
+}
+
+/* tmk_core */
+uint16_t timer_read(void) { return (uint32_t)(now / 1000); }
+uint32_t timer_read32(void) { return (uint32_t)(now / 1000); }
+uint8_t topre_settle_us = TOPRE_SETTLE_DEFAULT;
+uint8_t topre_recovery_us = TOPRE_RECOVERY_DEFAULT;
+void topre_timing_init(void) {}
+void topre_scan_stat(uint16_t start) { (void)start; sweeps++; }
+
+
+static bool is_on(uint8_t row, uint8_t col)
+{
+    return matrix_get_row(row) & ((matrix_row_t)1 << col);
+}
+
+/* main loop until the key is seen in the state; returns time */
+static double loop_until(uint8_t row, uint8_t col, bool on)
+{
+    for (uint16_t i = 0; i < 1000; i++) {
+        matrix_scan();
+        now += TASK_US;
+        if (is_on(row, col) == on) return now;
+    }
+    return -1;
+}
+
+static void reset(void)
+{
+    key_count = 0;
+    on_read = 0;
+    // settle all rows to no key
+    for (uint8_t i = 0; i < MATRIX_ROWS / MATRIX_SCAN_SLICE; i++) matrix_scan();
+}
+
+static double row_us(void)
+{
+    // col select 2us, hysteresis 10us, settle, 5us and recovery per key
+    return MATRIX_COLS * (2 + 10 + 5 + topre_settle_us + topre_recovery_us);
+}
+
+
+static void test_slice_time(void)
+{
+    reset();
+    uint16_t s = sweeps;
+    for (uint8_t i = 0; i < MATRIX_ROWS / MATRIX_SCAN_SLICE; i++) {
+        double t = now;
+        matrix_scan();
+        // a call covers MATRIX_SCAN_SLICE rows only
+        CHECK((now - t) <= MATRIX_SCAN_SLICE * row_us());
+        CHECK((now - t) > (MATRIX_SCAN_SLICE - 1) * row_us());
+    }
+    CHECK_EQ(sweeps - s, 1);
+}
+
+static void test_latency(void)
+{
+    // press keys at various moment of sweep
+    double sweep = MATRIX_ROWS * row_us();
+    double slice = MATRIX_SCAN_SLICE * row_us() + TASK_US;
+    double max = 0, sum = 0;
+    uint16_t n = 0;
+
+    for (uint8_t row = 0; row < MATRIX_ROWS; row += 3) {
+        for (uint16_t offset = 0; offset < 64; offset++) {
+            reset();
+            keys[0] = (key_t){ row, 15, now + sweep * offset / 64, 1e12 };
+            key_count = 1;
+            double t = loop_until(row, 15, true);
+            CHECK(t > 0);
+            double latency = t - keys[0].press;
+            if (latency > max) max = latency;
+            sum += latency;
+            n++;
+
+            // release
+            keys[0].release = now;
+            t = loop_until(row, 15, false);
+            CHECK(t > 0 && t - keys[0].release <= sweep + slice);
+        }
+    }
+    printf("latency max:%.0fus avg:%.0fus sweep:%.0fus\n", max, sum / n, sweep);
+    // worst case: just missed the key, waits rest of sweep and the slice
+    CHECK(max <= sweep + slice);
+    CHECK(sum / n < sweep);
+}
+
+static void press_mid_row(uint8_t row, uint8_t col)
+{
+    if (row == 3 && col == 8) {
+        keys[0] = (key_t){ 3, 0, now, 1e12 };
+        keys[1] = (key_t){ 3, 15, now, 1e12 };
+        key_count = 2;
+    }
+}
+
+static void test_row_complete(void)
+{
+    // keys pressed while row 3 is in scan: col 0 is already read
+    reset();
+    on_read = press_mid_row;
+    uint16_t torn = row_torn;
+    CHECK(loop_until(3, 15, true) > 0);
+    CHECK(!is_on(3, 0));
+    on_read = 0;
+    CHECK(loop_until(3, 0, true) > 0);
+    CHECK(is_on(3, 15));
+    CHECK_EQ(row_torn - torn, 0);
+}
+
+int main(void)
+{
+    matrix_init();
+    TEST(test_slice_time);
+    TEST(test_latency);
+    TEST(test_row_complete);
+    CHECK_EQ(row_torn, 0);
+    return test_result();
+}
@@ -0,0 +1,3 @@
+/* host stub: advances simulated time by 4 cycles per count */
+#include <stdint.h>
+void _delay_loop_2(uint16_t count);
@@ -0,0 +1,245 @@
+/*
+ * Host test of HID report descriptor parser
+ *
+ * Descriptors are captured from TMK keyboard and a composite keyboard with
+ * mouse and consumer reports on one interface.
+ */
+#include <string.h>
+#include "test.h"
+#include "report_desc.h"
+
+#define KEY(keys, code) (((keys)[(code) >> 4] >> ((code) & 0x0F)) & 1)
+
+/* TMK boot keyboard */
+static const uint8_t boot_desc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7,
+    0x15, 0x00, 0x25, 0x01, 0x95, 0x08, 0x75, 0x01, 0x81, 0x02, 0x95, 0x01,
+    0x75, 0x08, 0x81, 0x01, 0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x95, 0x05,
+    0x75, 0x01, 0x91, 0x82, 0x95, 0x01, 0x75, 0x03, 0x91, 0x01, 0x05, 0x07,
+    0x19, 0x00, 0x29, 0xFF, 0x15, 0x00, 0x26, 0xFF, 0x00, 0x95, 0x06, 0x75,
+    0x08, 0x81, 0x00, 0xC0
+};
+
+/* TMK NKRO keyboard: modifiers and 248-bit bitmap */
+static const uint8_t nkro_desc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7,
+    0x15, 0x00, 0x25, 0x01, 0x95, 0x08, 0x75, 0x01, 0x81, 0x02, 0x05, 0x08,
+    0x19, 0x01, 0x29, 0x05, 0x95, 0x05, 0x75, 0x01, 0x91, 0x82, 0x95, 0x01,
+    0x75, 0x03, 0x91, 0x01, 0x05, 0x07, 0x19, 0x00, 0x29, 0xF7, 0x15, 0x00,
+    0x25, 0x01, 0x95, 0xF8, 0x75, 0x01, 0x81, 0x02, 0xC0
+};
+
+/* report ID 1: mouse, 2: consumer, 3: NKRO keyboard */
+static const uint8_t composite_desc[] = {
+    0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x85, 0x01, 0x09, 0x01, 0xA1, 0x00,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x03, 0x15, 0x00, 0x25, 0x01, 0x95, 0x03,
+    0x75, 0x01, 0x81, 0x02, 0x95, 0x01, 0x75, 0x05, 0x81, 0x01, 0x05, 0x01,
+    0x09, 0x30, 0x09, 0x31, 0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x02,
+    0x81, 0x06, 0xC0, 0xC0,
+    0x05, 0x0C, 0x09, 0x01, 0xA1, 0x01, 0x85, 0x02, 0x19, 0x00, 0x2A, 0x3C,
+    0x02, 0x15, 0x00, 0x26, 0x3C, 0x02, 0x95, 0x01, 0x75, 0x10, 0x81, 0x00,
+    0xC0,
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, 0x03, 0x05, 0x07, 0x19, 0xE0,
+    0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    0x19, 0x00, 0x29, 0x77, 0x95, 0x78, 0x81, 0x02, 0xC0
+};
+
+/* boot mouse */
+static const uint8_t mouse_desc[] = {
+    0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x09, 0x01, 0xA1, 0x00, 0x05, 0x09,
+    0x19, 0x01, 0x29, 0x03, 0x15, 0x00, 0x25, 0x01, 0x95, 0x03, 0x75, 0x01,
+    0x81, 0x02, 0x95, 0x01, 0x75, 0x05, 0x81, 0x01, 0x05, 0x01, 0x09, 0x30,
+    0x09, 0x31, 0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x02, 0x81, 0x06,
+    0xC0, 0xC0
+};
+
+static void parse(hid_kbd_layout_t *layout, uint8_t iface,
+                  const uint8_t *desc, uint16_t len, uint16_t chunk)
+{
+    hid_rdesc_parser_t parser;
+    hid_rdesc_init(&parser, layout, iface);
+    for (uint16_t i = 0; i < len; i += chunk) {
+        hid_rdesc_parse(&parser, desc + i, (len - i < chunk) ? len - i : chunk);
+    }
+}
+
+static void test_boot(void)
+{
+    hid_kbd_layout_t layout;
+    hid_kbd_layout_init(&layout);
+    parse(&layout, 0, boot_desc, sizeof(boot_desc), sizeof(boot_desc));
+
+    CHECK_EQ(layout.field_count, 2);
+    CHECK_EQ(layout.source_count, 1);
+    CHECK_EQ(layout.led_iface, 0);
+    CHECK_EQ(layout.led_report_id, 0);
+
+    // LShift + A + B
+    const uint8_t report[8] = { 0x02, 0x00, 0x04, 0x05 };
+    uint16_t keys[16];
+    CHECK_EQ(hid_kbd_decode(&layout, 0, report, sizeof(report), keys), 0);
+    CHECK(KEY(keys, 0xE1));
+    CHECK(KEY(keys, 0x04));
+    CHECK(KEY(keys, 0x05));
+    CHECK(!KEY(keys, 0x06));
+    CHECK(!KEY(keys, 0xE0));
+}
+
+static void test_boot_layout_matches_descriptor(void)
+{
+    hid_kbd_layout_t parsed, boot;
+    hid_kbd_layout_init(&parsed);
+    hid_kbd_layout_init(&boot);
+    parse(&parsed, 0, boot_desc, sizeof(boot_desc), sizeof(boot_desc));
+    hid_kbd_layout_add_boot(&boot, 0);
+
+    const uint8_t report[8] = { 0x81, 0x00, 0x29, 0x2C, 0x39 };
+    uint16_t a[16], b[16];
+    CHECK_EQ(hid_kbd_decode(&parsed, 0, report, sizeof(report), a), 0);
+    CHECK_EQ(hid_kbd_decode(&boot, 0, report, sizeof(report), b), 0);
+    CHECK(memcmp(a, b, sizeof(a)) == 0);
+}
+
+static void test_phantom(void)
+{
+    hid_kbd_layout_t layout;
+    hid_kbd_layout_init(&layout);
+    parse(&layout, 0, boot_desc, sizeof(boot_desc), sizeof(boot_desc));
+
+    const uint8_t report[8] = { 0x00, 0x00, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01 };
+    uint16_t keys[16] = { 0xAAAA };
+    CHECK_EQ(hid_kbd_decode(&layout, 0, report, sizeof(report), keys), -1);
+    CHECK_EQ(keys[0], 0xAAAA);
+}
+
+static void test_nkro_chunked(void)
+{
+    // descriptor arrives in 8-byte packets of control transfer
+    hid_kbd_layout_t layout;
+    hid_kbd_layout_init(&layout);
+    parse(&layout, 0, nkro_desc, sizeof(nkro_desc), 8);
+
+    CHECK_EQ(layout.field_count, 2);
+    CHECK_EQ(layout.field[1].bit_offset, 8);
+    CHECK_EQ(layout.field[1].count, 0xF8);
+
+    // RCtrl, A, Z, F24(0x73) and 0xF0
+    uint8_t report[32] = { 0x10 };
+    report[1 + 0x04/8] |= 1 << (0x04 & 7);
+    report[1 + 0x1D/8] |= 1 << (0x1D & 7);
+    report[1 + 0x73/8] |= 1 << (0x73 & 7);
+    report[1 + 0xF0/8] |= 1 << (0xF0 & 7);
+    uint16_t keys[16];
+    CHECK_EQ(hid_kbd_decode(&layout, 0, report, sizeof(report), keys), 0);
+    CHECK(KEY(keys, 0xE4));
+    CHECK(KEY(keys, 0x04));
+    CHECK(KEY(keys, 0x1D));
+    CHECK(KEY(keys, 0x73));
+    CHECK(KEY(keys, 0xF0));
+    CHECK(!KEY(keys, 0x05));
+
+    // short report: keys in missing bytes are released, RCtrl and A remain
+    uint16_t n = 0;
+    CHECK_EQ(hid_kbd_decode(&layout, 0, report, 4, keys), 0);
+    for (uint8_t r = 0; r < 16; r++) n += __builtin_popcount(keys[r]);
+    CHECK_EQ(n, 2);
+}
+
+static void test_composite(void)
+{
+    // iface 0: boot keyboard, iface 1: mouse/consumer/NKRO with report IDs
+    hid_kbd_layout_t layout;
+    uint16_t sources[HID_KBD_SOURCES][16] = {};
+    uint16_t keys[16] = {};
+    uint16_t state[16];
+    int8_t s;
+
+    hid_kbd_layout_init(&layout);
+    parse(&layout, 0, boot_desc, sizeof(boot_desc), sizeof(boot_desc));
+    parse(&layout, 1, composite_desc, sizeof(composite_desc), 8);
+    CHECK_EQ(layout.source_count, 2);
+    CHECK(hid_kbd_layout_has_iface(&layout, 1));
+    CHECK_EQ(layout.led_iface, 0);
+
+    // report ID 3 fields start after report ID
+    CHECK_EQ(layout.field[2].report_id, 3);
+    CHECK_EQ(layout.field[2].bit_offset, 0);
+    CHECK_EQ(layout.field[3].bit_offset, 8);
+
+    // LShift held on iface 0
+    const uint8_t shift[8] = { 0x02 };
+    s = hid_kbd_decode(&layout, 0, shift, sizeof(shift), state);
+    CHECK_EQ(s, 0);
+    CHECK_EQ(hid_kbd_update(&layout, sources, s, state, keys), 1 << 0xE);
+    CHECK(KEY(keys, 0xE1));
+
+    // A pressed on iface 1
+    uint8_t nkro[17] = { 0x03, 0x00, 1 << (0x04 & 7) };
+    s = hid_kbd_decode(&layout, 1, nkro, sizeof(nkro), state);
+    CHECK_EQ(s, 1);
+    CHECK_EQ(hid_kbd_update(&layout, sources, s, state, keys), 1 << 0);
+    CHECK(KEY(keys, 0x04));
+    CHECK(KEY(keys, 0xE1));
+
+    // mouse and consumer reports have no key field
+    const uint8_t mouse[4] = { 0x01, 0x01, 0x10, 0xF0 };
+    const uint8_t consumer[3] = { 0x02, 0xE9, 0x00 };
+    CHECK_EQ(hid_kbd_decode(&layout, 1, mouse, sizeof(mouse), state), -1);
+    CHECK_EQ(hid_kbd_decode(&layout, 1, consumer, sizeof(consumer), state), -1);
+
+    // A released on iface 1: LShift is still held
+    nkro[2] = 0;
+    s = hid_kbd_decode(&layout, 1, nkro, sizeof(nkro), state);
+    CHECK_EQ(s, 1);
+    CHECK_EQ(hid_kbd_update(&layout, sources, s, state, keys), 1 << 0);
+    CHECK(!KEY(keys, 0x04));
+    CHECK(KEY(keys, 0xE1));
+
+    // same key on both: held until released on both
+    nkro[1] = 0x02;
+    s = hid_kbd_decode(&layout, 1, nkro, sizeof(nkro), state);
+    hid_kbd_update(&layout, sources, s, state, keys);
+    const uint8_t none[8] = {};
+    s = hid_kbd_decode(&layout, 0, none, sizeof(none), state);
+    CHECK_EQ(hid_kbd_update(&layout, sources, s, state, keys), 0);
+    CHECK(KEY(keys, 0xE1));
+    nkro[1] = 0;
+    s = hid_kbd_decode(&layout, 1, nkro, sizeof(nkro), state);
+    CHECK_EQ(hid_kbd_update(&layout, sources, s, state, keys), 1 << 0xE);
+    CHECK(!KEY(keys, 0xE1));
+}
+
+static void test_mouse_only(void)
+{
+    hid_kbd_layout_t layout;
+    hid_kbd_layout_init(&layout);
+    parse(&layout, 0, mouse_desc, sizeof(mouse_desc), 8);
+
+    CHECK_EQ(layout.field_count, 0);
+    CHECK_EQ(layout.source_count, 0);
+    CHECK_EQ(layout.led_iface, HID_KBD_NO_IFACE);
+    CHECK(!hid_kbd_layout_has_iface(&layout, 0));
+}
+
+static void test_source_limit(void)
+{
+    hid_kbd_layout_t layout;
+    hid_kbd_layout_init(&layout);
+    for (uint8_t i = 0; i < HID_KBD_SOURCES + 1; i++) {
+        parse(&layout, i, nkro_desc, sizeof(nkro_desc), sizeof(nkro_desc));
+    }
+    CHECK_EQ(layout.source_count, HID_KBD_SOURCES);
+    CHECK(!hid_kbd_layout_has_iface(&layout, HID_KBD_SOURCES));
+}
+
+int main(void)
+{
+    TEST(test_boot);
+    TEST(test_boot_layout_matches_descriptor);
+    TEST(test_phantom);
+    TEST(test_nkro_chunked);
+    TEST(test_composite);
+    TEST(test_mouse_only);
+    TEST(test_source_limit);
+    return test_result();
+}
@@ -0,0 +1,3 @@
+/* host stub: global interrupt flag in SREG */
+#define sei()   (SREG |= 0x80)
+#define cli()   (SREG &= ~0x80)
@@ -0,0 +1,4 @@
+/* host stub: status register */
+#include <stdint.h>
+
+extern uint8_t SREG;
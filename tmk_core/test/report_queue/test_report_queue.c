@@ -0,0 +1,248 @@
+/*
+ * Test of report_queue.c: keyboard report latency with LUFA report queue
+ *
+ * Endpoint bank holds one report and host takes it every polling interval.
+ * Device side calls report_send() and report_send_queued() as lufa.c does:
+ * report is written to the bank when nothing is queued and the bank is free,
+ * otherwise it is queued and main loop(or SOF with REPORT_SOF_SYNC) writes
+ * one queued report whenever the bank is free. Each report carries sequence
+ * number of key change so that latency and lost changes are seen by host.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <avr/io.h>
+#include "test.h"
+#include "report_queue.h"
+
+#define FRAME_US    1000
+#define LOOP_US     300     // main loop period: matrix scan and keyboard_task
+
+typedef enum { SEND_LOOP, SEND_SOF } send_mode_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t sum;
+    uint32_t max;
+    uint32_t lost;          // key changes host never saw
+    uint32_t last_seq;      // newest change host saw
+} stats_t;
+
+static uint32_t now;        // us
+
+static uint8_t interval;    // polling interval in frames
+static send_mode_t mode;
+
+/* endpoint bank */
+static bool bank_full;
+static uint32_t bank_seq;
+
+uint8_t SREG = 0x80;
+
+/* key changes */
+#define EVENTS_MAX  2000
+static uint32_t event_time[EVENTS_MAX + 1];     // indexed by seq from 1
+static uint32_t event_count;
+
+static stats_t stats;
+
+static uint32_t rand_state = 1;
+static uint32_t rand_range(uint32_t n)
+{
+    rand_state = rand_state * 1103515245 + 12345;
+    return (rand_state >> 8) % n;
+}
+
+
+static bool write_report(const void *report)
+{
+    if (bank_full) return false;
+    bank_seq = *(const uint32_t *)report;
+    bank_full = true;
+    return true;
+}
+
+/* device */
+static uint32_t queue_buf[REPORT_QUEUE_SIZE];
+static report_sender_t sender = {
+    .buf = queue_buf,
+    .size = sizeof(uint32_t),
+    .write = write_report
+};
+
+static void host_poll(void)
+{
+    if (!bank_full) return;
+    bank_full = false;
+
+    uint32_t seq = bank_seq;
+    if (seq <= stats.last_seq) return;
+    stats.lost += seq - stats.last_seq - 1;
+    stats.last_seq = seq;
+
+    uint32_t latency = now - event_time[seq];
+    stats.count++;
+    stats.sum += latency;
+    if (latency > stats.max) stats.max = latency;
+}
+
+static void sim_init(uint8_t poll_interval, send_mode_t send_mode)
+{
+    interval = poll_interval;
+    mode = send_mode;
+    bank_full = false;
+    sender.queue = (report_queue_t){ 0 };
+    event_count = 0;
+    stats = (stats_t){ 0 };
+}
+
+/* adds key change at time t in us, in order of time */
+static void sim_event(uint32_t t)
+{
+    if (event_count < EVENTS_MAX) event_time[++event_count] = t;
+}
+
+/* runs until all events are made and host has had time to take them */
+static void sim_run(void)
+{
+    uint32_t end = event_time[event_count] + (REPORT_QUEUE_SIZE + 2) * interval * FRAME_US;
+    uint32_t next_loop = 0;
+    uint32_t next_frame = 0;
+    uint32_t frame = 0;
+    uint32_t seq = 1;
+
+    for (now = 0; now <= end; now++) {
+        if (now == next_frame) {
+            if (mode == SEND_SOF) report_send_queued(&sender);
+            if (frame % interval == 0) host_poll();
+            frame++;
+            next_frame += FRAME_US;
+        }
+        if (now == next_loop) {
+            // changes found by this scan go in one report, the latest wins
+            uint32_t found = 0;
+            while (seq <= event_count && event_time[seq] <= now) found = seq++;
+            if (found) report_send(&sender, &found, mode == SEND_LOOP);
+            if (mode == SEND_LOOP) report_send_queued(&sender);
+            CHECK_EQ(SREG, 0x80);
+            next_loop += LOOP_US;
+        }
+    }
+}
+
+/* key changes at random times, at least 'gap' us apart */
+static void sim_typing(uint32_t n, uint32_t gap, uint32_t spread)
+{
+    uint32_t t = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        t += gap + rand_range(spread);
+        sim_event(t);
+    }
+}
+
+static uint32_t mean(void)
+{
+    return stats.count ? stats.sum / stats.count : 0;
+}
+
+
+/* Latency grows with polling interval: on average half of it plus main loop
+ * period, and at most one interval plus main loop period. */
+static void test_latency(void)
+{
+    static const uint8_t intervals[] = { 1, 2, 4, 8, 10 };
+
+    printf("    interval  mean(us)  max(us)\n");
+    for (uint8_t i = 0; i < sizeof(intervals); i++) {
+        uint8_t n = intervals[i];
+        sim_init(n, SEND_LOOP);
+        sim_typing(1000, 30000, 40000);
+        sim_run();
+        printf("    %5ums  %8lu  %7lu\n", n, (unsigned long)mean(), (unsigned long)stats.max);
+
+        uint32_t period = n * FRAME_US;
+        CHECK_EQ(stats.lost, 0);
+        CHECK_EQ(stats.count, 1000);
+        CHECK(stats.max <= period + LOOP_US);
+        CHECK(mean() >= period / 2 - period / 10);
+        CHECK(mean() <= period / 2 + LOOP_US + period / 10);
+    }
+}
+
+/* Fast typing: every change reaches host while the queue keeps up. */
+static void test_fast_typing(void)
+{
+    sim_init(10, SEND_LOOP);
+    // 12ms apart on average, a bit slower than host takes reports
+    sim_typing(1000, 8000, 8000);
+    sim_run();
+    CHECK_EQ(stats.lost, 0);
+    CHECK_EQ(stats.last_seq, event_count);
+    CHECK(stats.max <= (REPORT_QUEUE_SIZE + 1) * 10 * FRAME_US + LOOP_US);
+
+    sim_init(1, SEND_LOOP);
+    sim_typing(1000, 800, 800);
+    sim_run();
+    CHECK_EQ(stats.lost, 0);
+    CHECK(stats.max <= (REPORT_QUEUE_SIZE + 1) * FRAME_US + LOOP_US);
+}
+
+/* Burst which fits in the bank and queue is delivered without loss, one
+ * report per polling interval. */
+static void test_burst(void)
+{
+    sim_init(10, SEND_LOOP);
+    for (uint32_t i = 1; i <= REPORT_QUEUE_SIZE + 1; i++) {
+        sim_event(100000 + i * LOOP_US);
+    }
+    sim_run();
+    CHECK_EQ(stats.lost, 0);
+    CHECK_EQ(stats.count, REPORT_QUEUE_SIZE + 1);
+    CHECK(stats.max <= (REPORT_QUEUE_SIZE + 1) * 10 * FRAME_US);
+}
+
+/* Longer burst overflows the queue: newest entry is replaced, so changes in
+ * the middle are lost but host ends up with the latest state. */
+static void test_overflow(void)
+{
+    sim_init(10, SEND_LOOP);
+    for (uint32_t i = 1; i <= 20; i++) {
+        sim_event(100000 + i * LOOP_US);
+    }
+    sim_run();
+    CHECK(stats.lost > 0);
+    CHECK_EQ(stats.last_seq, event_count);
+    CHECK_EQ(stats.count, REPORT_QUEUE_SIZE + 1);
+    CHECK_EQ(sender.queue.count, 0);
+}
+
+/* REPORT_SOF_SYNC: reports wait for SOF to be committed, but host takes
+ * them in that frame anyway, so latency is same as direct write. */
+static void test_sof_sync(void)
+{
+    rand_state = 1;
+    sim_init(1, SEND_SOF);
+    sim_typing(1000, 30000, 40000);
+    sim_run();
+    uint32_t sof_max = stats.max;
+    uint32_t sof_mean = mean();
+    CHECK_EQ(stats.lost, 0);
+    CHECK(sof_max <= FRAME_US + LOOP_US);
+
+    rand_state = 1;
+    sim_init(1, SEND_LOOP);
+    sim_typing(1000, 30000, 40000);
+    sim_run();
+    CHECK_EQ(mean(), sof_mean);
+    CHECK_EQ(stats.max, sof_max);
+}
+
+
+int main(void)
+{
+    TEST(test_latency);
+    TEST(test_fast_typing);
+    TEST(test_burst);
+    TEST(test_overflow);
+    TEST(test_sof_sync);
+    return test_result();
+}
@@ -0,0 +1,10 @@
+/* host stub: flash is plain memory */
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s)             (s)
+#define pgm_read_byte(p)    (*(const uint8_t *)(p))
+#define strlen_P            strlen
+#define strcmp_P            strcmp
+#define strncmp_P           strncmp
@@ -0,0 +1,487 @@
+/*
+ * Host test of RN-42 command queue: rn42_cmd.c against a scripted fake RN-42
+ *
+ * UART is a pseudo terminal in raw mode. Firmware side writes commands to
+ * the slave and feeds characters read from it to rn42_cmd_recv() as
+ * rn42_task() does; fake RN-42 reads the master and answers after a delay.
+ * Time is simulated in 1ms steps and each step waits until bytes written
+ * are read on the other end, so results don't depend on pty scheduling.
+ *
+ * Fake RN-42 enters command mode on "$$$" only when link is down and UART
+ * has been quiet for a second, echoes with "+" and leaves command mode on
+ * "---" and "R,1". Lines of the script of a test override its answers.
+ */
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "test.h"
+#include "rn42_cmd.h"
+#include "timer.h"
+
+#define RESP_DELAY      10      // ms from command to answer
+#define QUIET_TIME      1000    // ms of no data RN-42 needs before "$$$"
+#define GUARD_TIME      1100    // CMD_GUARD_TIME of rn42_cmd.c
+#define LINK_TIMEOUT    3000    // CMD_LINK_TIMEOUT of rn42_cmd.c
+#define LINE_MAX        23      // longest line rn42_cmd.c keeps
+
+#define CHECK_STR(a, b) do { \
+    const char *_a = (a), *_b = (b); \
+    if (strcmp(_a, _b) != 0) { \
+        printf("%s:%d: %s == %s failed:\n    \"%s\"\n    \"%s\"\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+        test_failures++; \
+    } \
+} while (0)
+
+typedef struct {
+    const char *cmd;    // command line without CR/LF
+    const char *resp;   // answer, NULL: no answer
+} script_t;
+
+static uint32_t now;            // ms
+
+/* pty: firmware on slave, fake RN-42 on master */
+static int master = -1;
+static int slave = -1;
+static uint32_t to_rn42, rn42_got;
+static uint32_t to_fw, fw_got;
+
+/* fake RN-42 */
+static const script_t *script;
+static bool linked;
+static uint32_t link_down_at;
+static bool cmd_mode;
+static bool echo;
+static uint32_t last_data;      // last character in data mode
+static uint8_t dollars;
+static bool dollars_quiet;
+static uint32_t cmd_entered;    // "$$$" accepted
+static char cmd_buf[64];
+static uint8_t cmd_len;
+static bool cmd_cr;             // LF of CR/LF is part of command line
+static char answer[256];        // sent at answer_due
+static uint16_t answer_len;
+static uint32_t answer_due;
+
+/* logs joined with '|' */
+static char cmd_log[512];       // command lines RN-42 got
+static char data_log[256];      // characters RN-42 got in data mode
+static char results[512];       // responses callbacks got
+static uint8_t result_count;
+
+
+/* rn42.c and timer.c */
+void rn42_putc(uint8_t c)
+{
+    if (write(slave, &c, 1) == 1) to_rn42++;
+}
+
+bool rn42_linked(void)
+{
+    return linked;
+}
+
+uint16_t timer_read(void)
+{
+    return (uint16_t)now;
+}
+
+uint16_t timer_elapsed(uint16_t last)
+{
+    return (uint16_t)now - last;
+}
+
+
+static void log_add(char *log, size_t size, const char *s)
+{
+    if (*log) strncat(log, "|", size - strlen(log) - 1);
+    strncat(log, s, size - strlen(log) - 1);
+}
+
+static void record(const char *resp)
+{
+    log_add(results, sizeof(results), resp ? resp : "NULL");
+    result_count++;
+}
+
+/* reads bytes written to other end of pty so far */
+static void pty_read(int fd, uint32_t *got, uint32_t expected, void (*feed)(uint8_t))
+{
+    while (*got < expected) {
+        struct pollfd p = { .fd = fd, .events = POLLIN };
+        uint8_t buf[64];
+        if (poll(&p, 1, 1000) <= 0) {
+            CHECK(!"pty stalled");
+            *got = expected;
+            return;
+        }
+        ssize_t n = read(fd, buf, sizeof(buf));
+        for (ssize_t i = 0; i < n; i++) feed(buf[i]);
+        if (n > 0) *got += n;
+    }
+}
+
+static void rn42_write(const char *s)
+{
+    ssize_t n = write(master, s, strlen(s));
+    if (n > 0) to_fw += n;
+}
+
+static void rn42_answer(const char *s)
+{
+    strncat(answer, s, sizeof(answer) - answer_len - 1);
+    answer_len = strlen(answer);
+    answer_due = now + RESP_DELAY;
+}
+
+static void rn42_line(const char *l)
+{
+    log_add(cmd_log, sizeof(cmd_log), l);
+
+    for (const script_t *s = script; s && s->cmd; s++) {
+        if (strcmp(l, s->cmd) == 0) {
+            if (s->resp) rn42_answer(s->resp);
+            return;
+        }
+    }
+    if (strcmp(l, "+") == 0) {
+        echo = !echo;
+        rn42_answer(echo ? "Echo ON\r\n" : "Echo OFF\r\n");
+    } else if (strcmp(l, "v") == 0) {
+        rn42_answer("Ver 6.15 04/26/2013\r\n(c) Roving Networks\r\n");
+    } else if (strcmp(l, "---") == 0) {
+        rn42_answer("END\r\n");
+        cmd_mode = false;
+    } else if (strcmp(l, "R,1") == 0) {
+        rn42_answer("Reboot!\r\n");
+        cmd_mode = false;
+    } else if (strcmp(l, "GR") == 0) {
+        rn42_answer("0006664A1B2C\r\n");
+    } else if (l[0] == 'S' && l[1] && l[2] == ',') {
+        rn42_answer("AOK\r\n");
+    } else {
+        rn42_answer("?\r\n");
+    }
+    last_data = now;
+}
+
+static void rn42_data(uint8_t c)
+{
+    char s[2] = { c };
+    strncat(data_log, s, sizeof(data_log) - strlen(data_log) - 1);
+
+    if (c != '$') {
+        dollars = 0;
+        last_data = now;
+        return;
+    }
+    if (dollars == 0) dollars_quiet = (now - last_data >= QUIET_TIME);
+    if (++dollars < 3) return;
+    dollars = 0;
+    if (dollars_quiet && !linked) {
+        cmd_mode = true;
+        cmd_entered = now;
+        cmd_len = 0;
+        data_log[strlen(data_log) - 3] = '\0';
+        rn42_answer("CMD\r\n");
+    }
+    last_data = now;
+}
+
+static void rn42_char(uint8_t c)
+{
+    if (c == '\n' && cmd_cr) {
+        cmd_cr = false;
+        return;
+    }
+    cmd_cr = false;
+    if (!cmd_mode) {
+        rn42_data(c);
+        return;
+    }
+    if (echo) rn42_write(c == '\r' ? "\r\n" : (char[]){ c, '\0' });
+    if (c == '\r') {
+        cmd_buf[cmd_len] = '\0';
+        cmd_len = 0;
+        cmd_cr = true;
+        rn42_line(cmd_buf);
+    } else if (cmd_len < sizeof(cmd_buf) - 1) {
+        cmd_buf[cmd_len++] = c;
+    }
+}
+
+static void step(void)
+{
+    if (linked && now >= link_down_at) {
+        linked = false;
+        last_data = now;
+    }
+    pty_read(master, &rn42_got, to_rn42, rn42_char);
+    if (answer_len && now >= answer_due) {
+        rn42_write(answer);
+        answer[0] = '\0';
+        answer_len = 0;
+    }
+    pty_read(slave, &fw_got, to_fw, rn42_cmd_recv);
+    rn42_cmd_task();
+    now++;
+}
+
+static void run(uint32_t ms)
+{
+    while (ms--) step();
+}
+
+/* runs until queue is empty, returns time it took */
+static uint32_t run_idle(void)
+{
+    uint32_t start = now;
+    while (rn42_cmd_busy() && now - start < 60000) step();
+    // answer to last command
+    run(RESP_DELAY + 1);
+    return now - start;
+}
+
+/* fake RN-42 in data mode with link, or in command mode */
+static void setup(bool command_mode, const script_t *s)
+{
+    rn42_cmd_clear();
+    script = s;
+    linked = !command_mode;
+    link_down_at = UINT32_MAX;
+    cmd_mode = command_mode;
+    echo = false;
+    last_data = now;
+    dollars = 0;
+    cmd_len = 0;
+    cmd_cr = false;
+    answer[0] = '\0';
+    answer_len = 0;
+    cmd_log[0] = '\0';
+    data_log[0] = '\0';
+    results[0] = '\0';
+    result_count = 0;
+}
+
+
+/* config sequence of rn42_task.c: init_rn42() */
+static void echo_checked(const char *resp)
+{
+    record(resp);
+    if (!resp) rn42_cmd_queue(PSTR("+\r\n"), PSTR("Echo"), RN42_CMD_TIMEOUT, record, RN42_CMD_FIRST);
+}
+
+static void test_config(void)
+{
+    setup(false, NULL);
+    link_down_at = now + 200;
+    uint32_t start = now;
+
+    CHECK(rn42_cmd_queue(PSTR("$$$"), PSTR("CMD"), 1000, record, RN42_CMD_ENTER));
+    CHECK(rn42_cmd_queue(PSTR("v\r\n"), PSTR("v"), RN42_CMD_TIMEOUT, echo_checked, 0));
+    CHECK(RN42_COMMAND("SF,1\r\n", "AOK", record));
+    CHECK(RN42_COMMAND("S-,TmkBT\r\n", "AOK", record));
+    CHECK(RN42_COMMAND("SS,Keyboard/Mouse\r\n", "AOK", record));
+    CHECK(RN42_COMMAND("SM,4\r\n", "AOK", record));
+    CHECK(RN42_COMMAND("SW,8000\r\n", "AOK", record));
+    CHECK(RN42_COMMAND("S~,6\r\n", "AOK", record));
+    CHECK(RN42_COMMAND("SH,003C\r\n", "AOK", record));
+    CHECK(RN42_COMMAND("SY,FFF4\r\n", "AOK", record));
+    CHECK(RN42_COMMAND("R,1\r\n", "Reboot", record));
+    CHECK(RN42_COMMAND("---\r\n", "END", record));
+    run_idle();
+
+    // "$$$" after link down and guard time
+    CHECK(cmd_entered - start >= 200 + GUARD_TIME);
+    // "v" isn't echoed: times out and echo is turned on right after it
+    CHECK_STR(cmd_log, "v|+|SF,1|S-,TmkBT|SS,Keyboard/Mouse|SM,4|SW,8000|S~,6|SH,003C|SY,FFF4|R,1");
+    // RN-42 has left command mode on reboot: "---" goes as data and times out
+    CHECK_STR(data_log, "---\r\n");
+    CHECK_STR(results, "CMD|NULL|Echo ON|AOK|AOK|AOK|AOK|AOK|AOK|AOK|AOK|Reboot!|NULL");
+}
+
+/* "$$$" waits for link down and gives up when link stays */
+static void test_link(void)
+{
+    setup(false, NULL);
+    link_down_at = now + 1500;
+    uint32_t start = now;
+    CHECK(rn42_cmd_queue(PSTR("$$$"), PSTR("CMD"), 1000, record, RN42_CMD_ENTER));
+    run_idle();
+    CHECK_STR(results, "CMD");
+    CHECK(cmd_entered - start >= 1500 + GUARD_TIME);
+    CHECK(cmd_entered - start <= 1500 + GUARD_TIME + 5);
+
+    setup(false, NULL);
+    start = now;
+    uint32_t sent = to_rn42;
+    CHECK(rn42_cmd_queue(PSTR("$$$"), PSTR("CMD"), 1000, record, RN42_CMD_ENTER));
+    while (rn42_cmd_busy()) step();
+    CHECK_STR(results, "NULL");
+    CHECK(now - start > LINK_TIMEOUT);
+    CHECK(now - start <= LINK_TIMEOUT + 5);
+    CHECK_EQ(to_rn42, sent);
+}
+
+/* local echo is skipped by empty expect, and seen by expect of command */
+static void test_echo(void)
+{
+    setup(true, NULL);
+    echo = true;
+    RN42_COMMAND("GR\r\n", "", record);
+    RN42_COMMAND("v\r\n", "v", record);
+    RN42_COMMAND("SM,4\r\n", "AOK", record);
+    run_idle();
+    CHECK_STR(cmd_log, "GR|v|SM,4");
+    CHECK_STR(results, "0006664A1B2C|v|AOK");
+}
+
+/* "ERR" and "?" complete command with NULL without waiting for timeout */
+static void test_error(void)
+{
+    static const script_t s[] = {
+        { "SY,ZZZZ", "ERR\r\n" },
+        { NULL, NULL }
+    };
+    setup(true, s);
+    RN42_COMMAND("SY,ZZZZ\r\n", "AOK", record);
+    RN42_COMMAND("Q\r\n", "AOK", record);
+    RN42_COMMAND("SM,4\r\n", "AOK", record);
+    CHECK(run_idle() < RN42_CMD_TIMEOUT);
+    CHECK_STR(cmd_log, "SY,ZZZZ|Q|SM,4");
+    CHECK_STR(results, "NULL|NULL|AOK");
+}
+
+/* no answer: NULL after timeout of the command, then next one goes */
+static void test_timeout(void)
+{
+    static const script_t s[] = {
+        { "SN,quiet", NULL },
+        { "SN,chatty", "Ver 6.15 04/26/2013\r\nSomething else\r\n" },
+        { NULL, NULL }
+    };
+    setup(true, s);
+    uint32_t start = now;
+    CHECK(rn42_cmd_queue(PSTR("SN,quiet\r\n"), PSTR("AOK"), 200, record, 0));
+    while (result_count == 0) step();
+    CHECK(now - start > 200);
+    CHECK(now - start <= 200 + 5);
+
+    // lines which match neither expect nor error are ignored
+    start = now;
+    CHECK(rn42_cmd_queue(PSTR("SN,chatty\r\n"), PSTR("AOK"), 300, record, 0));
+    RN42_COMMAND("SM,4\r\n", "AOK", record);
+    run_idle();
+    CHECK(now - start > 300);
+    CHECK_STR(cmd_log, "SN,quiet|SN,chatty|SM,4");
+    CHECK_STR(results, "NULL|NULL|AOK");
+}
+
+/* RN42_CMD_FIRST goes right after command in progress, or in front */
+static void test_first(void)
+{
+    setup(true, NULL);
+    RN42_COMMAND("SA,1\r\n", "AOK", record);
+    RN42_COMMAND("SB,1\r\n", "AOK", record);
+    RN42_COMMAND("SC,1\r\n", "AOK", record);
+    run(3);
+    CHECK_STR(cmd_log, "SA,1");
+    CHECK(rn42_cmd_queue(PSTR("SD,1\r\n"), PSTR("AOK"), RN42_CMD_TIMEOUT, record, RN42_CMD_FIRST));
+    run_idle();
+    CHECK_STR(cmd_log, "SA,1|SD,1|SB,1|SC,1");
+
+    setup(true, NULL);
+    RN42_COMMAND("SA,1\r\n", "AOK", record);
+    RN42_COMMAND("SB,1\r\n", "AOK", record);
+    CHECK(rn42_cmd_queue(PSTR("SD,1\r\n"), PSTR("AOK"), RN42_CMD_TIMEOUT, record, RN42_CMD_FIRST));
+    run_idle();
+    CHECK_STR(cmd_log, "SD,1|SA,1|SB,1");
+    CHECK_STR(results, "AOK|AOK|AOK");
+}
+
+/* full queue refuses command; clear drops queue without callback */
+static void test_full_clear(void)
+{
+    setup(true, NULL);
+    for (uint8_t i = 0; i < RN42_CMD_QUEUE_SIZE - 1; i++) {
+        CHECK(RN42_COMMAND("SM,4\r\n", "AOK", record));
+    }
+    CHECK(!RN42_COMMAND("SM,4\r\n", "AOK", record));
+    CHECK(!rn42_cmd_queue(PSTR("SM,4\r\n"), PSTR("AOK"), RN42_CMD_TIMEOUT, record, RN42_CMD_FIRST));
+
+    // in the middle of a command
+    run(3);
+    rn42_cmd_clear();
+    CHECK(!rn42_cmd_busy());
+    run(100);
+    CHECK_STR(cmd_log, "SM,4");
+    CHECK_EQ(result_count, 0);
+
+    CHECK(RN42_COMMAND("SM,4\r\n", "AOK", record));
+    run_idle();
+    CHECK_STR(results, "AOK");
+}
+
+/* command in RAM */
+static void test_ram(void)
+{
+    static char sr[] = "SR,????????????\r\n";
+    memcpy(&sr[3], "0006664A1B2C", 12);
+
+    setup(true, NULL);
+    CHECK(rn42_cmd_queue(sr, PSTR("AOK"), RN42_CMD_TIMEOUT, record, RN42_CMD_RAM));
+    run_idle();
+    CHECK_STR(cmd_log, "SR,0006664A1B2C");
+    CHECK_STR(results, "AOK");
+}
+
+/* long line is cut to the buffer; characters outside of a command and
+ * partial line before it are dropped */
+static void test_line(void)
+{
+    static const script_t s[] = {
+        { "D", "Settings\r\nBTA=0006664A1B2C and much more than fits\r\n" },
+        { NULL, NULL }
+    };
+    setup(true, s);
+    rn42_write("%CONNECT,0006664A1B2C,0\r\n");
+    rn42_write("junk");
+    run(5);
+    RN42_COMMAND("D\r\n", "BTA=", record);
+    RN42_COMMAND("GR\r\n", "", record);
+    run_idle();
+    CHECK_STR(results, "BTA=0006664A1B2C and mu|0006664A1B2C");
+    CHECK_EQ(strlen("BTA=0006664A1B2C and mu"), LINE_MAX);
+}
+
+
+int main(void)
+{
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) || unlockpt(master) ||
+            (slave = open(ptsname(master), O_RDWR | O_NOCTTY)) < 0) {
+        printf("can't open pty\n");
+        return 1;
+    }
+    // 8-bit clean UART: no echo or CR/LF translation on either end
+    struct termios t;
+    tcgetattr(slave, &t);
+    cfmakeraw(&t);
+    tcsetattr(slave, TCSANOW, &t);
+
+    TEST(test_config);
+    TEST(test_link);
+    TEST(test_echo);
+    TEST(test_error);
+    TEST(test_timeout);
+    TEST(test_first);
+    TEST(test_full_clear);
+    TEST(test_ram);
+    TEST(test_line);
+    return test_result();
+}
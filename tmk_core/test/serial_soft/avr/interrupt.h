@@ -0,0 +1,4 @@
+/* host stub: vector is a plain function called by simulator */
+#define ISR(vect)   void vect(void)
+#define sei()
+#define cli()
@@ -0,0 +1,2 @@
+/* host stub */
+#include <stdint.h>
@@ -0,0 +1,36 @@
+/*
+ * serial_soft.c configuration for simulated line: Sun keyboard style
+ * negative logic, but with even parity to exercise parity bit.
+ */
+#include <stdint.h>
+
+#define F_CPU                       16000000UL
+
+#define SERIAL_SOFT_BAUD            1200
+#define SERIAL_SOFT_PARITY_EVEN
+#define SERIAL_SOFT_BIT_ORDER_LSB
+#define SERIAL_SOFT_LOGIC_NEGATIVE
+#define SERIAL_SOFT_RXD_BUF_SIZE    16
+
+void sim_rxd_edge(void);
+void sim_timer_compare(void);
+uint8_t sim_rxd_read(void);
+void sim_txd(uint8_t pin);
+void sim_timer_start(uint16_t ocr);
+void sim_timer_set(uint16_t ocr);
+void sim_timer_stop(void);
+
+#define SERIAL_SOFT_RXD_VECT        sim_rxd_edge
+#define SERIAL_SOFT_RXD_INIT()
+#define SERIAL_SOFT_RXD_INT_ENTER()
+#define SERIAL_SOFT_RXD_INT_EXIT()
+#define SERIAL_SOFT_RXD_READ()      sim_rxd_read()
+
+#define SERIAL_SOFT_TXD_INIT()      SERIAL_SOFT_TXD_ON()
+#define SERIAL_SOFT_TXD_HI()        sim_txd(1)
+#define SERIAL_SOFT_TXD_LO()        sim_txd(0)
+
+#define SERIAL_SOFT_TIMER_VECT      sim_timer_compare
+#define SERIAL_SOFT_TIMER_START(t)  sim_timer_start(t)
+#define SERIAL_SOFT_TIMER_SET(t)    sim_timer_set(t)
+#define SERIAL_SOFT_TIMER_STOP()    sim_timer_stop()
@@ -0,0 +1,261 @@
+/*
+ * Host test of serial_soft.c RX bit sampler
+ *
+ * Line is a list of logical level changes in CPU cycles. Simulator calls edge
+ * interrupt at start bit edge and timer compare interrupt of CTC mode timer in
+ * time order, so that bits are sampled at the moment timer would fire.
+ */
+#include <stdbool.h>
+#include "test.h"
+#include "serial.h"
+
+#define BIT_CYCLES      ((double)F_CPU / SERIAL_SOFT_BAUD)
+#define ISR_LATENCY     50      // cycles from event to pin read in ISR
+
+typedef struct {
+    uint32_t time;
+    uint8_t level;              // logical: 1 idle/mark, 0 space
+} edge_t;
+
+static edge_t wave[1024];
+static uint16_t wave_len;
+static uint32_t now;
+
+static bool timer_running;
+static uint16_t timer_ocr;
+static uint32_t timer_next;
+
+static uint32_t tx_time;
+
+
+static uint8_t line_level(uint32_t t)
+{
+    uint8_t level = 1;
+    for (uint16_t i = 0; i < wave_len && wave[i].time <= t; i++) {
+        level = wave[i].level;
+    }
+    return level;
+}
+
+static void line_set(uint32_t t, uint8_t level)
+{
+    if (line_level(t) == level) return;
+    wave[wave_len++] = (edge_t){ t, level };
+}
+
+/* hardware seen by serial_soft.c */
+uint8_t sim_rxd_read(void)
+{
+    // pin level of negative logic
+    return !line_level(now);
+}
+
+void sim_timer_start(uint16_t ocr)
+{
+    timer_running = true;
+    timer_ocr = ocr;
+    timer_next = now + ocr + 1;
+}
+
+void sim_timer_set(uint16_t ocr)
+{
+    timer_ocr = ocr;
+}
+
+void sim_timer_stop(void)
+{
+    timer_running = false;
+}
+
+void sim_txd(uint8_t pin)
+{
+    line_set(tx_time, !pin);
+}
+
+void _delay_us(double us)
+{
+    tx_time += us * (F_CPU / 1000000);
+}
+
+void _delay_ms(double ms)
+{
+    _delay_us(ms * 1000);
+}
+
+
+/* runs interrupts until end of line plus idle */
+static void run(void)
+{
+    uint16_t e = 0;
+    uint32_t end = (wave_len ? wave[wave_len - 1].time : now) + 20 * BIT_CYCLES;
+
+    while (true) {
+        // next start edge: logical 1 to 0
+        while (e < wave_len && wave[e].level != 0) e++;
+        uint32_t edge = (e < wave_len) ? wave[e].time + ISR_LATENCY : UINT32_MAX;
+        uint32_t match = timer_running ? timer_next : UINT32_MAX;
+
+        if (edge == UINT32_MAX && match == UINT32_MAX) break;
+        if (edge <= match) {
+            now = edge;
+            e++;
+            sim_rxd_edge();
+        } else {
+            // counter is cleared on match and ISR may change OCR for next match
+            now = match + ISR_LATENCY;
+            uint32_t started = timer_next;
+            sim_timer_compare();
+            if (timer_running && timer_next == started) {
+                timer_next = match + timer_ocr + 1;
+            }
+        }
+    }
+    now = end;
+}
+
+static void line_reset(void)
+{
+    wave_len = 0;
+    now = 0;
+    timer_running = false;
+    while (serial_recv2() != -1) ;
+    serial_framing_errors = 0;
+    serial_parity_errors = 0;
+    serial_overrun_errors = 0;
+}
+
+/* frame with start, 8 data bits LSB first, even parity and stop bit */
+static double put_frame(double t, uint8_t data, double bit, bool parity_ok, bool stop)
+{
+    uint8_t parity = __builtin_parity(data) ^ !parity_ok;
+    uint16_t bits = (data << 1) | (parity << 9) | (stop << 10);
+
+    for (uint8_t i = 0; i < 11; i++) {
+        line_set(t, (bits >> i) & 1);
+        t += bit;
+    }
+    line_set(t, 1);
+    return t;
+}
+
+static void put_bytes(const uint8_t *data, uint8_t len, double bit)
+{
+    double t = BIT_CYCLES;
+    for (uint8_t i = 0; i < len; i++) {
+        t = put_frame(t, data[i], bit, true, true);
+    }
+}
+
+static const uint8_t pattern[] = { 0x00, 0x01, 0x55, 0xAA, 0x7F, 0x80, 0xFE, 0xFF };
+
+static bool received(const uint8_t *data, uint8_t len)
+{
+    for (uint8_t i = 0; i < len; i++) {
+        if (serial_recv2() != data[i]) return false;
+    }
+    return serial_recv2() == -1;
+}
+
+
+static void test_receive(void)
+{
+    line_reset();
+    put_bytes(pattern, sizeof(pattern), BIT_CYCLES);
+    run();
+    CHECK(received(pattern, sizeof(pattern)));
+    CHECK_EQ(serial_framing_errors + serial_parity_errors + serial_overrun_errors, 0);
+}
+
+static void test_baud_tolerance(void)
+{
+    // sampling at bit center tolerates a few percent of clock error both ways
+    line_reset();
+    put_bytes(pattern, sizeof(pattern), BIT_CYCLES * 1.04);
+    run();
+    CHECK(received(pattern, sizeof(pattern)));
+
+    line_reset();
+    put_bytes(pattern, sizeof(pattern), BIT_CYCLES * 0.96);
+    run();
+    CHECK(received(pattern, sizeof(pattern)));
+
+    // sampling drifts out of stop bit
+    line_reset();
+    put_bytes(pattern, sizeof(pattern), BIT_CYCLES * 0.90);
+    run();
+    CHECK(!received(pattern, sizeof(pattern)));
+}
+
+static void test_framing_error(void)
+{
+    line_reset();
+    double t = put_frame(BIT_CYCLES, 0x5A, BIT_CYCLES, true, false);
+    // receiver resyncs on next start edge after idle
+    put_frame(t + 2 * BIT_CYCLES, 0x3C, BIT_CYCLES, true, true);
+    run();
+    CHECK_EQ(serial_framing_errors, 1);
+    CHECK_EQ(serial_recv2(), 0x3C);
+    CHECK_EQ(serial_recv2(), -1);
+}
+
+static void test_parity_error(void)
+{
+    line_reset();
+    double t = put_frame(BIT_CYCLES, 0x13, BIT_CYCLES, false, true);
+    put_frame(t, 0x13, BIT_CYCLES, true, true);
+    run();
+    CHECK_EQ(serial_parity_errors, 1);
+    CHECK_EQ(serial_recv2(), 0x13);
+    CHECK_EQ(serial_recv2(), -1);
+}
+
+static void test_glitch(void)
+{
+    // spike shorter than half bit is not start bit
+    line_reset();
+    line_set(BIT_CYCLES, 0);
+    line_set(BIT_CYCLES * 1.3, 1);
+    put_frame(BIT_CYCLES * 3, 0xC3, BIT_CYCLES, true, true);
+    run();
+    CHECK_EQ(serial_recv2(), 0xC3);
+    CHECK_EQ(serial_recv2(), -1);
+    CHECK_EQ(serial_framing_errors + serial_parity_errors, 0);
+}
+
+static void test_overrun(void)
+{
+    uint8_t data[20];
+    for (uint8_t i = 0; i < sizeof(data); i++) data[i] = i + 1;
+
+    line_reset();
+    put_bytes(data, sizeof(data), BIT_CYCLES);
+    run();
+    // one slot of ring buffer is kept empty
+    CHECK_EQ(serial_overrun_errors, sizeof(data) - (SERIAL_SOFT_RXD_BUF_SIZE - 1));
+    CHECK(received(data, SERIAL_SOFT_RXD_BUF_SIZE - 1));
+}
+
+static void test_loopback(void)
+{
+    // waveform of serial_send() is received as sent
+    line_reset();
+    tx_time = BIT_CYCLES;
+    for (uint8_t i = 0; i < sizeof(pattern); i++) {
+        serial_send(pattern[i]);
+    }
+    run();
+    CHECK(received(pattern, sizeof(pattern)));
+}
+
+int main(void)
+{
+    serial_init();
+    TEST(test_receive);
+    TEST(test_baud_tolerance);
+    TEST(test_framing_error);
+    TEST(test_parity_error);
+    TEST(test_glitch);
+    TEST(test_overrun);
+    TEST(test_loopback);
+    return test_result();
+}
@@ -0,0 +1,3 @@
+/* host stub: advances simulated time of TX */
+void _delay_us(double us);
+void _delay_ms(double ms);
@@ -0,0 +1,62 @@
+/*
+Copyright 2016 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TEST_H
+#define TEST_H
+
+/*
+ * Minimal checks for host-built tests
+ *
+ *     CHECK(cond);
+ *     CHECK_EQ(actual, expected);
+ *     TEST(name) runs static void name(void)
+ *     return test_result();
+ */
+#include <stdio.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        test_failures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+    long _a = (long)(a), _b = (long)(b); \
+    if (_a != _b) { \
+        printf("%s:%d: %s == %s failed: %ld != %ld\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+        test_failures++; \
+    } \
+} while (0)
+
+#define TEST(name) do { \
+    int _f = test_failures; \
+    name(); \
+    printf("%-40s %s\n", #name, (_f == test_failures) ? "ok" : "FAIL"); \
+} while (0)
+
+static inline int test_result(void)
+{
+    if (test_failures) {
+        printf("%d check(s) failed\n", test_failures);
+        return 1;
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,22 @@
+# Host-built test of plain C modules
+#
+# Makefile of a test sets TARGET and SRC then includes this.
+#     make test     build and run
+#     make clean
+TMK_DIR ?= ../..
+
+CC ?= cc
+CFLAGS += -std=gnu99 -g -Wall -I$(TMK_DIR)/test -I.
+
+all: test
+
+$(TARGET): $(SRC) $(wildcard *.h)
+	$(CC) $(CFLAGS) -o $@ $(SRC) $(LDLIBS)
+
+test: $(TARGET)
+	./$(TARGET)
+
+clean:
+	rm -f $(TARGET)
+
+.PHONY: all test clean
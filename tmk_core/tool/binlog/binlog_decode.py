@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+"""Decoder of binary log(BINLOG_ENABLE) on TMK console
+
+Reads console output from hidraw device or file and prints text with binary
+log records formatted. Format strings are looked up in ELF file of the
+firmware, which must be the same build as one running on the keyboard.
+
+    $ binlog_decode.py tmk_keyboard/keyboard/hhkb/hhkb_lufa.elf /dev/hidraw3
+    $ cat console.bin | binlog_decode.py -t hhkb_lufa.elf
+
+See tmk_core/common/binlog.h for the record format.
+"""
+import argparse
+import re
+import struct
+import sys
+
+BINLOG_SOF = 0x01
+
+SHT_PROGBITS = 1
+SHF_ALLOC = 0x2
+
+
+class Elf:
+    """Minimal 32-bit little endian ELF reader for AVR and ARM"""
+
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            self.data = f.read()
+        if self.data[:4] != b'\x7fELF' or self.data[4] != 1 or self.data[5] != 1:
+            raise ValueError('%s: not 32-bit little endian ELF' % path)
+        shoff, = struct.unpack_from('<I', self.data, 0x20)
+        shentsize, shnum = struct.unpack_from('<HH', self.data, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            (name, type_, flags, addr, offset, size) = struct.unpack_from(
+                '<IIIIII', self.data, shoff + i * shentsize)
+            if type_ == SHT_PROGBITS and flags & SHF_ALLOC:
+                self.sections.append((addr, offset, size))
+
+    def string(self, addr):
+        for (start, offset, size) in self.sections:
+            if start <= addr < start + size:
+                pos = offset + addr - start
+                end = self.data.find(b'\0', pos, offset + size)
+                if end < 0:
+                    end = offset + size
+                return self.data[pos:end].decode('latin-1')
+        return None
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            raise ValueError('broken frame')
+        out += data[i + 1:i + code]
+        i += code
+        if i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def crc8(data):
+    """CRC-8 of polynomial 0x07, same as crc8() in binlog.c"""
+    crc = 0
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc << 1 ^ 0x07 if crc & 0x80 else crc << 1) & 0xFF
+    return crc
+
+
+class Record:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def byte(self):
+        if self.pos >= len(self.data):
+            raise IndexError
+        b = self.data[self.pos]
+        self.pos += 1
+        return b
+
+    def varint(self):
+        v = shift = 0
+        while True:
+            b = self.byte()
+            v |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return v
+
+    def string(self):
+        end = self.data.find(b'\0', self.pos)
+        if end < 0:
+            raise IndexError
+        s = self.data[self.pos:end].decode('latin-1')
+        self.pos = end + 1
+        return s
+
+
+SPEC = re.compile(r'%([0-]*)(\d*)([lL]?)(.)', re.S)
+
+
+def format_record(fmt, rec):
+    """Formats arguments in the way of xprintf"""
+    def conv(m):
+        flags, width, long_, type_ = m.groups()
+        if type_ == '%':
+            return '%'
+        try:
+            if type_ == 'd':
+                v = rec.varint()
+                s = str((v >> 1) ^ -(v & 1))
+            elif type_ == 'u':
+                s = str(rec.varint())
+            elif type_ == 'x':
+                s = '%x' % rec.varint()
+            elif type_ == 'X':
+                s = '%X' % rec.varint()
+            elif type_ == 'o':
+                s = '%o' % rec.varint()
+            elif type_ == 'b':
+                s = '{:b}'.format(rec.varint())
+            elif type_ == 'c':
+                s = chr(rec.byte())
+            elif type_ in 'sS':
+                s = rec.string()
+            else:
+                return m.group(0)
+        except IndexError:
+            return '<?>'
+        w = int(width) if width else 0
+        if '-' in flags:
+            return s.ljust(w)
+        if '0' in flags and type_ not in 'csS':
+            return s.rjust(w, '0')
+        return s.rjust(w)
+    return SPEC.sub(conv, fmt)
+
+
+def decode_frame(elf, frame, timestamp):
+    data = cobs_decode(frame)
+    if not data or crc8(data[:-1]) != data[-1]:
+        raise ValueError('checksum error')
+    rec = Record(data[:-1])
+    addr = rec.varint()
+    ms = rec.byte() | rec.byte() << 8
+    fmt = elf.string(addr)
+    if fmt is None:
+        return '<binlog: unknown format %04X>\n' % addr
+    text = format_record(fmt, rec)
+    if timestamp:
+        text = '[%05u] %s' % (ms, text)
+    return text
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode TMK binary log on console')
+    parser.add_argument('elf', help='ELF file of running firmware')
+    parser.add_argument('input', nargs='?', help='hidraw device or file(default: stdin)')
+    parser.add_argument('-t', '--timestamp', action='store_true', help='show timestamp of records')
+    args = parser.parse_args()
+
+    elf = Elf(args.elf)
+    src = open(args.input, 'rb', buffering=0) if args.input else sys.stdin.buffer
+    out = sys.stdout
+
+    frame = None
+    while True:
+        chunk = src.read(64)
+        if not chunk:
+            break
+        for b in chunk:
+            if frame is not None:
+                if b == 0:
+                    try:
+                        out.write(decode_frame(elf, bytes(frame), args.timestamp))
+                    except (ValueError, IndexError):
+                        out.write('<binlog: broken record>\n')
+                    frame = None
+                else:
+                    frame.append(b)
+            elif b == BINLOG_SOF:
+                frame = bytearray()
+            elif b != 0:
+                # text and padding(zero) of console report
+                out.write(chr(b))
+        out.flush()
+
+
+if __name__ == '__main__':
+    try:
+        main()
+    except KeyboardInterrupt:
+        pass
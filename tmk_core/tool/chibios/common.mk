@@ -50,6 +50,15 @@ ifdef NKRO_ENABLE
     OPT_DEFS += -DNKRO_ENABLE
 endif
 
+ifdef RAW_ENABLE
+    SRC += $(COMMON_DIR)/raw_hid.c
+    OPT_DEFS += -DRAW_ENABLE
+    # EEPROM emulation for raw hid access
+    ifndef BOOTMAGIC_ENABLE
+        SRC += $(COMMON_DIR)/chibios/eeconfig.c
+    endif
+endif
+
 ifdef USB_6KRO_ENABLE
     OPT_DEFS += -DUSB_6KRO_ENABLE
 endif
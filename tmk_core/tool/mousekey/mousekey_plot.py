@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+"""Trajectory of mousekey(MOUSEKEY_SMOOTH) from console log
+
+Reads debug output of mousekey with mouse debug enabled(Magic+m) from file
+or stdin, for example output of hid_listen, and prints summary of each
+stroke: duration, distance, peak speed and report intervals. With --plot
+position and speed are plotted with matplotlib.
+
+    $ hid_listen | tee mousekey.log
+    $ mousekey_plot.py mousekey.log
+    $ mousekey_plot.py --plot mousekey.log
+
+Reports look like: mousekey [btn|x y v h](time/acl): [00|3 -1 0 0](41230/0)
+"""
+import argparse
+import re
+import sys
+
+REPORT = re.compile(r'mousekey \[btn\|x y v h\]\(time/acl\): '
+                    r'\[([0-9A-Fa-f]+)\|(-?\d+) (-?\d+) (-?\d+) (-?\d+)\]\((\d+)/(\d+)\)')
+
+# reports apart more than this(ms) belong to different strokes
+STROKE_GAP = 100
+
+
+def read_reports(f):
+    """Returns list of (time, x, y, v, h) with time unwrapped from 16-bit ms"""
+    reports = []
+    base = 0
+    last = None
+    for line in f:
+        m = REPORT.search(line)
+        if not m:
+            continue
+        t = int(m.group(6))
+        if last is not None and t < last:
+            base += 0x10000
+        last = t
+        x, y, v, h = (int(m.group(i)) for i in range(2, 6))
+        reports.append((base + t, x, y, v, h))
+    return reports
+
+
+def strokes(reports):
+    stroke = []
+    for r in reports:
+        if stroke and r[0] - stroke[-1][0] > STROKE_GAP:
+            yield stroke
+            stroke = []
+        stroke.append(r)
+    if stroke:
+        yield stroke
+
+
+def summary(n, stroke):
+    t0 = stroke[0][0]
+    duration = stroke[-1][0] - t0
+    x = sum(r[1] for r in stroke)
+    y = sum(r[2] for r in stroke)
+    intervals = [b[0] - a[0] for a, b in zip(stroke, stroke[1:])]
+    peak = 0.0
+    for dt, r in zip(intervals, stroke[1:]):
+        if dt:
+            peak = max(peak, (r[1] ** 2 + r[2] ** 2) ** 0.5 / dt)
+    print('stroke %d: %dms reports:%d x:%d y:%d distance:%.0f peak:%.2fpx/ms' %
+          (n, duration, len(stroke), x, y, (x ** 2 + y ** 2) ** 0.5, peak))
+    if intervals:
+        print('    interval(ms) min:%d avg:%.1f max:%d' %
+              (min(intervals), sum(intervals) / len(intervals), max(intervals)))
+
+
+def plot(all_strokes):
+    import matplotlib.pyplot as plt
+    fig, (pos, speed) = plt.subplots(2, 1, sharex=True)
+    for n, stroke in enumerate(all_strokes):
+        t0 = stroke[0][0]
+        t, x, y = [], [], []
+        px = py = 0
+        for r in stroke:
+            px += r[1]
+            py += r[2]
+            t.append(r[0] - t0)
+            x.append(px)
+            y.append(py)
+        pos.plot(t, x, label='%d x' % n)
+        pos.plot(t, y, label='%d y' % n)
+        st = [b[0] - t0 for b in stroke[1:]]
+        sv = [(b[1] ** 2 + b[2] ** 2) ** 0.5 / max(b[0] - a[0], 1) for a, b in zip(stroke, stroke[1:])]
+        speed.step(st, sv, label='%d' % n)
+    pos.set_ylabel('position(px)')
+    pos.legend()
+    speed.set_ylabel('speed(px/ms)')
+    speed.set_xlabel('time from first report(ms)')
+    plt.show()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('log', nargs='?', help='console log(default: stdin)')
+    parser.add_argument('--plot', action='store_true', help='plot with matplotlib')
+    args = parser.parse_args()
+
+    f = open(args.log) if args.log else sys.stdin
+    with f:
+        reports = read_reports(f)
+    if not reports:
+        sys.exit('no mousekey report found: build with MOUSEKEY_SMOOTH and enable mouse debug')
+    all_strokes = list(strokes(reports))
+    for n, stroke in enumerate(all_strokes):
+        summary(n, stroke)
+    if args.plot:
+        plot(all_strokes)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,289 @@
+#!/usr/bin/env python3
+"""Client of raw HID channel(RAW_ENABLE) for Linux hidraw
+
+Finds the raw HID interface by its usage page(0xFF60) unless device is given.
+
+    $ raw_hid.py info
+    $ raw_hid.py counters
+    $ raw_hid.py eeprom-read 0 16
+    $ raw_hid.py eeprom-write 3 01
+    $ raw_hid.py eeprom-dump > eeprom.bin
+    $ raw_hid.py -d /dev/hidraw5 trace
+    $ raw_hid.py keymap-update hhkb_lufa.hex
+
+See tmk_core/common/raw_hid.h for the protocol.
+"""
+import argparse
+import binascii
+import glob
+import os
+import select
+import struct
+import sys
+
+EPSIZE = 64
+DATA_SIZE = EPSIZE - 3
+WRITE_SIZE = EPSIZE - 5
+
+CMD_VERSION = 0x01
+CMD_COUNTERS = 0x02
+CMD_EEPROM_READ = 0x03
+CMD_EEPROM_WRITE = 0x04
+CMD_TRACE = 0x05
+CMD_TRACE_DATA = 0x85
+CMD_KEYMAP_INFO = 0x10
+CMD_KEYMAP_CRC = 0x11
+CMD_KEYMAP_DATA = 0x12
+CMD_KEYMAP_WRITE = 0x13
+
+STATUS = {0x00: 'ok', 0x01: 'unknown command', 0x02: 'bad argument',
+          0x03: 'verify error', 0x04: 'no flash helper in bootloader'}
+
+# Usage Page 0xFF60, Usage 0x61
+USAGE_SIGNATURE = bytes([0x06, 0x60, 0xFF, 0x09, 0x61])
+
+
+def find_device():
+    for path in sorted(glob.glob('/sys/class/hidraw/hidraw*')):
+        try:
+            with open(os.path.join(path, 'device', 'report_descriptor'), 'rb') as f:
+                if f.read().startswith(USAGE_SIGNATURE):
+                    return '/dev/' + os.path.basename(path)
+        except OSError:
+            pass
+    return None
+
+
+class RawHid:
+    def __init__(self, path, timeout=1.0):
+        self.fd = os.open(path, os.O_RDWR)
+        self.timeout = timeout
+        self.seq = 0
+
+    def close(self):
+        os.close(self.fd)
+
+    def read_report(self, timeout):
+        r, _, _ = select.select([self.fd], [], [], timeout)
+        if not r:
+            return None
+        return os.read(self.fd, EPSIZE)
+
+    def request(self, cmd, args=b''):
+        self.seq = (self.seq + 1) & 0xFF
+        report = bytes([cmd, self.seq]) + args
+        # first byte is report ID: 0 for device without report ID
+        os.write(self.fd, b'\x00' + report.ljust(EPSIZE, b'\x00'))
+        while True:
+            data = self.read_report(self.timeout)
+            if data is None:
+                raise IOError('no response to command %02X' % cmd)
+            # skip trace reports and stale responses
+            if data[0] == cmd and data[1] == self.seq:
+                break
+        if data[2] != 0:
+            raise IOError('command %02X: %s' % (cmd, STATUS.get(data[2], 'error %02X' % data[2])))
+        return data[3:]
+
+    def info(self):
+        version, rows, cols, eeprom_size = struct.unpack_from('<BBBH', self.request(CMD_VERSION))
+        return {'version': version, 'rows': rows, 'cols': cols, 'eeprom_size': eeprom_size}
+
+    def counters(self):
+        names = ('uptime_ms', 'key_events', 'trace_dropped', 'request_dropped')
+        return dict(zip(names, struct.unpack_from('<IIHH', self.request(CMD_COUNTERS))))
+
+    def eeprom_read(self, addr, length):
+        data = b''
+        while length > 0:
+            n = min(length, DATA_SIZE)
+            data += self.request(CMD_EEPROM_READ, struct.pack('<HB', addr, n))[:n]
+            addr += n
+            length -= n
+        return data
+
+    def eeprom_write(self, addr, data):
+        while data:
+            chunk = data[:WRITE_SIZE]
+            self.request(CMD_EEPROM_WRITE, struct.pack('<HB', addr, len(chunk)) + chunk)
+            addr += len(chunk)
+            data = data[len(chunk):]
+
+    def trace(self, enable):
+        self.request(CMD_TRACE, bytes([1 if enable else 0]))
+
+    def keymap_info(self):
+        start, size, page_size, writable = struct.unpack_from('<HHHB', self.request(CMD_KEYMAP_INFO))
+        return {'start': start, 'size': size, 'page_size': page_size, 'writable': writable}
+
+    def keymap_crcs(self, pages):
+        crcs = []
+        while len(crcs) < pages:
+            n = min(pages - len(crcs), DATA_SIZE // 2)
+            data = self.request(CMD_KEYMAP_CRC, bytes([len(crcs), n]))
+            crcs += struct.unpack_from('<%dH' % n, data)
+        return crcs
+
+    def keymap_write_page(self, page, data):
+        for offset in range(0, len(data), WRITE_SIZE):
+            chunk = data[offset:offset + WRITE_SIZE]
+            self.request(CMD_KEYMAP_DATA, struct.pack('<HB', offset, len(chunk)) + chunk)
+        self.request(CMD_KEYMAP_WRITE, struct.pack('<BH', page, crc16(data)))
+
+
+def crc16(data):
+    """CRC-16/CCITT with initial value 0xFFFF as keymap_flash_crc()"""
+    return binascii.crc_hqx(data, 0xFFFF)
+
+
+def read_ihex(path):
+    """Returns {address: byte} of data records in Intel HEX file"""
+    image = {}
+    base = 0
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith(':'):
+                continue
+            rec = bytes.fromhex(line[1:])
+            if sum(rec) & 0xFF:
+                raise ValueError('%s: checksum error: %s' % (path, line))
+            length, addr, type_ = rec[0], (rec[1] << 8) | rec[2], rec[3]
+            data = rec[4:4 + length]
+            if type_ == 0x00:
+                for i, b in enumerate(data):
+                    image[base + addr + i] = b
+            elif type_ == 0x02:
+                base = ((data[0] << 8) | data[1]) << 4
+            elif type_ == 0x04:
+                base = ((data[0] << 8) | data[1]) << 16
+            elif type_ == 0x01:
+                break
+    return image
+
+
+def keymap_pages(path, info):
+    """Splits keymap region of firmware file into {page: bytes}
+
+    File is Intel HEX or binary of whole firmware, or binary of keymap region
+    only. Pages the file doesn't cover at all are left out; gaps in a page are
+    zero-filled as linker does for keymap section.
+    """
+    start, size, page_size = info['start'], info['size'], info['page_size']
+    if path.endswith('.hex'):
+        image = read_ihex(path)
+    else:
+        with open(path, 'rb') as f:
+            data = f.read()
+        origin = 0 if len(data) > size else start
+        image = dict((origin + i, b) for i, b in enumerate(data))
+
+    pages = {}
+    for page in range(size // page_size):
+        addrs = range(start + page * page_size, start + (page + 1) * page_size)
+        if any(a in image for a in addrs):
+            pages[page] = bytes(image.get(a, 0) for a in addrs)
+    return pages
+
+
+def keymap_update(dev, path, dry_run=False):
+    info = dev.keymap_info()
+    if not info['writable'] and not dry_run:
+        raise IOError('keymap flash is not writable: bootloader has no flash helper')
+    pages = keymap_pages(path, info)
+    if not pages:
+        raise IOError('%s: no data in keymap region %04X-%04X' %
+                      (path, info['start'], info['start'] + info['size'] - 1))
+
+    device_crcs = dev.keymap_crcs(info['size'] // info['page_size'])
+    delta = sorted(p for p, data in pages.items() if crc16(data) != device_crcs[p])
+    print('keymap %04X: %d pages in file, %d changed %s' %
+          (info['start'], len(pages), len(delta), delta))
+    if dry_run:
+        return
+    for page in delta:
+        dev.keymap_write_page(page, pages[page])
+    # verify whole image after update
+    device_crcs = dev.keymap_crcs(info['size'] // info['page_size'])
+    bad = [p for p, data in pages.items() if crc16(data) != device_crcs[p]]
+    if bad:
+        raise IOError('verify failed on pages %s' % bad)
+    print('done')
+
+
+def hexdump(addr, data):
+    for i in range(0, len(data), 16):
+        line = data[i:i + 16]
+        print('%04X: %s' % (addr + i, ' '.join('%02X' % b for b in line)))
+
+
+def run_trace(dev):
+    dev.trace(True)
+    seq = None
+    try:
+        while True:
+            data = dev.read_report(None)
+            if data[0] != CMD_TRACE_DATA:
+                continue
+            if seq is not None and data[1] != (seq + 1) & 0xFF:
+                print('# %d reports lost' % ((data[1] - seq - 1) & 0xFF))
+            seq = data[1]
+            for i in range(data[2]):
+                time, row, col = struct.unpack_from('<HBB', data, 3 + i * 4)
+                print('%5u %02X:%02X %s' % (time, row, col & 0x7F, 'down' if col & 0x80 else 'up'))
+            sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        dev.trace(False)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-d', '--device', help='hidraw device(default: search)')
+    sub = parser.add_subparsers(dest='command')
+    sub.required = True
+    sub.add_parser('info', help='show protocol version and matrix size')
+    sub.add_parser('counters', help='show counters')
+    p = sub.add_parser('eeprom-read', help='hexdump EEPROM')
+    p.add_argument('addr', type=lambda x: int(x, 0))
+    p.add_argument('length', type=lambda x: int(x, 0))
+    p = sub.add_parser('eeprom-write', help='write hex bytes to EEPROM')
+    p.add_argument('addr', type=lambda x: int(x, 0))
+    p.add_argument('data', help='hex string like 0102ff')
+    sub.add_parser('eeprom-dump', help='write whole EEPROM to stdout')
+    sub.add_parser('trace', help='print key events until interrupted')
+    p = sub.add_parser('keymap-update', help='write changed pages of keymap section')
+    p.add_argument('file', help='firmware .hex/.bin or keymap section .bin')
+    p.add_argument('-n', '--dry-run', action='store_true', help='show changed pages only')
+    args = parser.parse_args()
+
+    path = args.device or find_device()
+    if path is None:
+        sys.exit('raw HID device not found')
+    dev = RawHid(path)
+    try:
+        if args.command == 'info':
+            for k, v in dev.info().items():
+                print('%s: %d' % (k, v))
+        elif args.command == 'counters':
+            for k, v in dev.counters().items():
+                print('%s: %d' % (k, v))
+        elif args.command == 'eeprom-read':
+            hexdump(args.addr, dev.eeprom_read(args.addr, args.length))
+        elif args.command == 'eeprom-write':
+            dev.eeprom_write(args.addr, bytes.fromhex(args.data))
+        elif args.command == 'eeprom-dump':
+            sys.stdout.buffer.write(dev.eeprom_read(0, dev.info()['eeprom_size']))
+        elif args.command == 'trace':
+            run_trace(dev)
+        elif args.command == 'keymap-update':
+            keymap_update(dev, args.file, args.dry_run)
+    except IOError as e:
+        sys.exit('%s: %s' % (path, e))
+    finally:
+        dev.close()
+
+
+if __name__ == '__main__':
+    main()